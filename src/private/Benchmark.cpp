@@ -0,0 +1,207 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
+#include "Log.h"
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+
+static const void* volatile keptPointer = nullptr;
+static volatile unsigned char keptBytes = 0;
+#endif
+
+static void writeEscaped(std::ofstream& file, const std::string& text)
+{
+	file << '"';
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			file << '\\';
+		}
+
+		file << c;
+	}
+	file << '"';
+}
+
+// Nearest-rank percentile of sorted samples.
+static double percentile(const std::vector<double>& sorted, double fraction)
+{
+	size_t rank = static_cast<size_t>(std::ceil(sorted.size() * fraction));
+	return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+void BenchmarkSuite::setContext(const std::string& key, const std::string& value)
+{
+	this->context.emplace_back(key, value);
+}
+
+const BenchmarkSuite::Result& BenchmarkSuite::run(const std::string& name, const std::function<void()>& body)
+{
+	using Clock = std::chrono::steady_clock;
+
+	auto timeCalls = [&](uint64_t calls)
+	{
+		auto start = Clock::now();
+		for (uint64_t i = 0; i < calls; i++)
+		{
+			body();
+		}
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	};
+
+	// Warmup doubles as calibration: grow the call count until a repetition lasts long enough to time.
+	uint64_t calls = 1;
+	uint32_t warmupRepetitions = std::max(1u, this->options.warmupRepetitions);
+	for (uint32_t i = 0; i < warmupRepetitions; i++)
+	{
+		double milliseconds = timeCalls(calls);
+		if (milliseconds < this->options.minRepetitionMilliseconds)
+		{
+			double perCall = std::max(milliseconds / calls, 1e-6);
+			calls = std::max(calls + 1, static_cast<uint64_t>(std::ceil(this->options.minRepetitionMilliseconds / perCall)));
+		}
+	}
+
+	Result result{};
+	result.name = name;
+	result.warmupRepetitions = warmupRepetitions;
+	result.callsPerRepetition = calls;
+	result.samples.reserve(this->options.repetitions);
+
+	for (uint32_t i = 0; i < std::max(1u, this->options.repetitions); i++)
+	{
+		result.samples.push_back(timeCalls(calls) / calls);
+	}
+
+	summarize(result);
+	this->results.push_back(std::move(result));
+	return this->results.back();
+}
+
+const BenchmarkSuite::Result& BenchmarkSuite::addSamples(const std::string& name, uint32_t warmupRepetitions, std::vector<double> samples)
+{
+	Result result{};
+	result.name = name;
+	result.warmupRepetitions = warmupRepetitions;
+	result.callsPerRepetition = 1;
+	result.samples = std::move(samples);
+
+	summarize(result);
+	this->results.push_back(std::move(result));
+	return this->results.back();
+}
+
+void BenchmarkSuite::print() const
+{
+	for (const Result& result : this->results)
+	{
+		Log::write(LogSeverity::Info, "  %s: median %g ms (min %g, p90 %g, p99 %g, stddev %g), %zu x %llu call(s)", result.name.c_str(), result.median, result.minimum,
+			result.p90, result.p99, result.standardDeviation, result.samples.size(), static_cast<unsigned long long>(result.callsPerRepetition));
+	}
+}
+
+bool BenchmarkSuite::writeJson(const std::string& path) const
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	file << std::setprecision(9);
+	file << "{\n  \"context\": {";
+
+	for (size_t i = 0; i < this->context.size(); i++)
+	{
+		file << (i == 0 ? "\n    " : ",\n    ");
+		writeEscaped(file, this->context[i].first);
+		file << ": ";
+		writeEscaped(file, this->context[i].second);
+	}
+
+	file << "\n  },\n  \"benchmarks\": [";
+
+	for (size_t i = 0; i < this->results.size(); i++)
+	{
+		const Result& result = this->results[i];
+
+		file << (i == 0 ? "\n    {" : ",\n    {") << "\"name\": ";
+		writeEscaped(file, result.name);
+		file << ", \"unit\": \"ms\", \"warmup\": " << result.warmupRepetitions << ", \"repetitions\": " << result.samples.size()
+			<< ", \"callsPerRepetition\": " << result.callsPerRepetition << ", \"min\": " << result.minimum << ", \"median\": " << result.median
+			<< ", \"mean\": " << result.mean << ", \"stddev\": " << result.standardDeviation << ", \"p90\": " << result.p90
+			<< ", \"p99\": " << result.p99 << ", \"max\": " << result.maximum << ", \"samples\": [";
+
+		for (size_t sample = 0; sample < result.samples.size(); sample++)
+		{
+			file << (sample == 0 ? "" : ", ") << result.samples[sample];
+		}
+
+		file << "]}";
+	}
+
+	file << "\n  ]\n}\n";
+	return static_cast<bool>(file);
+}
+
+void BenchmarkSuite::keep(const void* data, size_t size)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	// No inline assembly on x64: fold the bytes into a volatile, so every one of them has to be computed, and
+	// stop the compiler from moving memory accesses across the call.
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	unsigned char folded = 0;
+	for (size_t i = 0; i < size; i++)
+	{
+		folded ^= bytes[i];
+	}
+
+	keptBytes = folded;
+	keptPointer = data;
+	_ReadWriteBarrier();
+#else
+	// An empty asm that takes the pointer and clobbers memory: the compiler must assume it reads anything
+	// reachable through data, so the stores that produced it can't be dropped.
+	(void)size;
+	asm volatile("" : : "r"(data) : "memory");
+#endif
+}
+
+void BenchmarkSuite::summarize(Result& result)
+{
+	if (result.samples.empty())
+	{
+		return;
+	}
+
+	std::vector<double> sorted = result.samples;
+	std::sort(sorted.begin(), sorted.end());
+
+	double total = 0.0;
+	for (double sample : sorted)
+	{
+		total += sample;
+	}
+
+	result.mean = total / sorted.size();
+
+	double squaredDeviations = 0.0;
+	for (double sample : sorted)
+	{
+		squaredDeviations += (sample - result.mean) * (sample - result.mean);
+	}
+
+	result.standardDeviation = sorted.size() > 1 ? std::sqrt(squaredDeviations / (sorted.size() - 1)) : 0.0;
+	result.minimum = sorted.front();
+	result.median = percentile(sorted, 0.5);
+	result.p90 = percentile(sorted, 0.9);
+	result.p99 = percentile(sorted, 0.99);
+	result.maximum = sorted.back();
+}
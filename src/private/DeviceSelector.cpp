@@ -0,0 +1,469 @@
+#include "DeviceSelector.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "Log.h"
+
+// Capability points. Device type dominates, so an integrated GPU can't outscore a discrete one through the
+// system memory it reports as device local; the remaining terms break ties between similar devices.
+static const double DISCRETE_POINTS = 1000.0;
+static const double INTEGRATED_POINTS = 500.0;
+static const double VIRTUAL_POINTS = 250.0;
+static const double POINTS_PER_DEVICE_LOCAL_GIB = 50.0;
+static const double MAX_DEVICE_LOCAL_GIB = 16.0;
+static const double DEDICATED_QUEUE_POINTS = 100.0;
+static const double FORMAT_POINTS = 100.0;
+static const double POINTS_PER_SAMPLE_COUNT_DOUBLING = 10.0;
+
+// Measured bandwidth outweighs everything above: ten points per GB/s.
+static const double PROBE_POINTS_PER_GIGABYTE_PER_SECOND = 10.0;
+static const uint64_t PROBE_TIMEOUT_NANOSECONDS = 5000000000ull;
+
+static std::vector<VkQueueFamilyProperties> getQueueFamilies(VkPhysicalDevice device)
+{
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+	return queueFamilies;
+}
+
+static std::string toLower(std::string text)
+{
+	std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return text;
+}
+
+void DeviceSelector::configure(const VkAllocationCallbacks* allocationCallbacks, std::vector<DeviceFormatRequirement> formats, bool probe, const std::string& probeCachePath)
+{
+	this->allocationCallbacks = allocationCallbacks;
+	this->formats = std::move(formats);
+	this->probe = probe;
+	this->probeCachePath = probeCachePath;
+	this->probeCache.clear();
+
+	if (this->probe && !this->probeCachePath.empty())
+	{
+		this->loadProbeCache();
+	}
+}
+
+std::vector<DeviceRanking> DeviceSelector::rank(const std::vector<VkPhysicalDevice>& devices, const std::function<bool(VkPhysicalDevice)>& isSuitable)
+{
+	std::vector<DeviceRanking> rankings;
+	bool probeCacheChanged = false;
+
+	for (uint32_t i = 0; i < devices.size(); i++)
+	{
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(devices[i], &properties);
+
+		DeviceRanking ranking{};
+		ranking.device = devices[i];
+		ranking.index = i;
+		ranking.name = properties.deviceName;
+		ranking.type = properties.deviceType;
+		ranking.suitable = isSuitable(devices[i]);
+
+		if (ranking.suitable)
+		{
+			this->rateCapabilities(ranking);
+
+			if (this->probe)
+			{
+				std::string uuid = getUuidString(devices[i]);
+				auto cached = this->probeCache.find(uuid);
+
+				if (cached != this->probeCache.end() && cached->second.driverVersion == properties.driverVersion)
+				{
+					ranking.probeGigabytesPerSecond = cached->second.gigabytesPerSecond;
+					ranking.probeCached = true;
+				}
+				else
+				{
+					ranking.probeGigabytesPerSecond = this->runProbe(devices[i]);
+
+					// A failed probe may be transient (a timeout or a full heap), so it is retried next run
+					// rather than pinning the device at zero probe points until the driver changes.
+					if (ranking.probeGigabytesPerSecond > 0.0)
+					{
+						this->probeCache[uuid] = CachedProbe{ properties.driverVersion, ranking.probeGigabytesPerSecond };
+						probeCacheChanged = true;
+					}
+					else if (this->probeCache.erase(uuid) > 0)
+					{
+						probeCacheChanged = true;
+					}
+				}
+			}
+
+			ranking.score = ranking.capabilityScore + ranking.probeGigabytesPerSecond * PROBE_POINTS_PER_GIGABYTE_PER_SECOND;
+		}
+
+		rankings.push_back(ranking);
+	}
+
+	std::stable_sort(rankings.begin(), rankings.end(), [](const DeviceRanking& a, const DeviceRanking& b)
+	{
+		return a.suitable != b.suitable ? a.suitable : a.score > b.score;
+	});
+
+	if (probeCacheChanged && !this->probeCachePath.empty() && !this->saveProbeCache())
+	{
+		Log::write(LogSeverity::Warning, "Failed to write device probe cache %s", this->probeCachePath.c_str());
+	}
+
+	return rankings;
+}
+
+const DeviceRanking* DeviceSelector::findOverride(const std::vector<DeviceRanking>& rankings, const std::string& nameOrIndex)
+{
+	bool isIndex = !nameOrIndex.empty() && std::all_of(nameOrIndex.begin(), nameOrIndex.end(), [](unsigned char c) { return std::isdigit(c) != 0; });
+	std::string name = toLower(nameOrIndex);
+
+	for (const DeviceRanking& ranking : rankings)
+	{
+		if (isIndex ? std::to_string(ranking.index) == nameOrIndex : toLower(ranking.name).find(name) != std::string::npos)
+		{
+			return &ranking;
+		}
+	}
+
+	return nullptr;
+}
+
+void DeviceSelector::rateCapabilities(DeviceRanking& ranking) const
+{
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(ranking.device, &properties);
+
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+	vkGetPhysicalDeviceMemoryProperties(ranking.device, &memoryProperties);
+
+	double score = 0.0;
+
+	switch (properties.deviceType)
+	{
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+		score += DISCRETE_POINTS;
+		break;
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+		score += INTEGRATED_POINTS;
+		break;
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+		score += VIRTUAL_POINTS;
+		break;
+	default:
+		break;
+	}
+
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+	{
+		if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+		{
+			ranking.deviceLocalBytes += memoryProperties.memoryHeaps[i].size;
+		}
+	}
+
+	double deviceLocalGibibytes = ranking.deviceLocalBytes / (1024.0 * 1024.0 * 1024.0);
+	score += std::min(deviceLocalGibibytes, MAX_DEVICE_LOCAL_GIB) * POINTS_PER_DEVICE_LOCAL_GIB;
+
+	for (const VkQueueFamilyProperties& queueFamily : getQueueFamilies(ranking.device))
+	{
+		bool graphics = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+		bool compute = (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+
+		// Transfer-only families are usually backed by a copy engine that runs beside rendering.
+		ranking.dedicatedTransferQueue |= (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !graphics && !compute;
+		ranking.asyncComputeQueue |= compute && !graphics;
+	}
+
+	score += ranking.dedicatedTransferQueue ? DEDICATED_QUEUE_POINTS : 0.0;
+	score += ranking.asyncComputeQueue ? DEDICATED_QUEUE_POINTS : 0.0;
+
+	for (const DeviceFormatRequirement& requirement : this->formats)
+	{
+		VkFormatProperties formatProperties{};
+		vkGetPhysicalDeviceFormatProperties(ranking.device, requirement.format, &formatProperties);
+
+		if ((formatProperties.optimalTilingFeatures & requirement.features) == requirement.features)
+		{
+			ranking.supportedFormatCount++;
+		}
+	}
+
+	score += ranking.supportedFormatCount * FORMAT_POINTS;
+
+	VkSampleCountFlags sampleCounts = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+	for (VkSampleCountFlags count = VK_SAMPLE_COUNT_2_BIT; count <= VK_SAMPLE_COUNT_64_BIT && (sampleCounts & count); count <<= 1)
+	{
+		score += POINTS_PER_SAMPLE_COUNT_DOUBLING;
+	}
+
+	ranking.capabilityScore = score;
+}
+
+// Copies PROBE_BUFFER_SIZE back and forth between two device-local buffers PROBE_COPY_COUNT times on the
+// graphics queue, timed with timestamps. Returns GB/s copied, or 0 if the device can't run the probe.
+double DeviceSelector::runProbe(VkPhysicalDevice physicalDevice) const
+{
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	std::vector<VkQueueFamilyProperties> queueFamilies = getQueueFamilies(physicalDevice);
+
+	uint32_t queueFamily = UINT32_MAX;
+	for (uint32_t i = 0; i < queueFamilies.size(); i++)
+	{
+		if ((queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) && queueFamilies[i].timestampValidBits > 0)
+		{
+			queueFamily = i;
+			break;
+		}
+	}
+
+	if (queueFamily == UINT32_MAX || properties.limits.timestampPeriod <= 0.0f)
+	{
+		return 0.0;
+	}
+
+	float queuePriority = 1.0f;
+
+	VkDeviceQueueCreateInfo queueInfo{};
+	queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queueInfo.queueFamilyIndex = queueFamily;
+	queueInfo.queueCount = 1;
+	queueInfo.pQueuePriorities = &queuePriority;
+
+	VkDeviceCreateInfo deviceInfo{};
+	deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceInfo.queueCreateInfoCount = 1;
+	deviceInfo.pQueueCreateInfos = &queueInfo;
+
+	VkDevice device = nullptr;
+	if (vkCreateDevice(physicalDevice, &deviceInfo, this->allocationCallbacks, &device) != VK_SUCCESS)
+	{
+		return 0.0;
+	}
+
+	VkBuffer buffers[2] = { nullptr, nullptr };
+	VkDeviceMemory memory = nullptr;
+	VkCommandPool commandPool = nullptr;
+	VkQueryPool queryPool = nullptr;
+	VkFence fence = nullptr;
+
+	auto measure = [&]() -> double
+	{
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = PROBE_BUFFER_SIZE;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		for (VkBuffer& buffer : buffers)
+		{
+			if (vkCreateBuffer(device, &bufferInfo, this->allocationCallbacks, &buffer) != VK_SUCCESS)
+			{
+				return 0.0;
+			}
+		}
+
+		VkMemoryRequirements requirements{};
+		vkGetBufferMemoryRequirements(device, buffers[0], &requirements);
+
+		VkPhysicalDeviceMemoryProperties memoryProperties{};
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+		uint32_t memoryTypeIndex = UINT32_MAX;
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+		{
+			if ((requirements.memoryTypeBits & (1u << i)) && (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+			{
+				memoryTypeIndex = i;
+				break;
+			}
+		}
+
+		if (memoryTypeIndex == UINT32_MAX)
+		{
+			return 0.0;
+		}
+
+		VkDeviceSize alignedSize = (requirements.size + requirements.alignment - 1) / requirements.alignment * requirements.alignment;
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = alignedSize * 2;
+		allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+		if (vkAllocateMemory(device, &allocInfo, this->allocationCallbacks, &memory) != VK_SUCCESS ||
+			vkBindBufferMemory(device, buffers[0], memory, 0) != VK_SUCCESS ||
+			vkBindBufferMemory(device, buffers[1], memory, alignedSize) != VK_SUCCESS)
+		{
+			return 0.0;
+		}
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = queueFamily;
+
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = 2;
+
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		if (vkCreateCommandPool(device, &poolInfo, this->allocationCallbacks, &commandPool) != VK_SUCCESS ||
+			vkCreateQueryPool(device, &queryPoolInfo, this->allocationCallbacks, &queryPool) != VK_SUCCESS ||
+			vkCreateFence(device, &fenceInfo, this->allocationCallbacks, &fence) != VK_SUCCESS)
+		{
+			return 0.0;
+		}
+
+		VkCommandBufferAllocateInfo commandBufferInfo{};
+		commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		commandBufferInfo.commandPool = commandPool;
+		commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		commandBufferInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer = nullptr;
+		if (vkAllocateCommandBuffers(device, &commandBufferInfo, &commandBuffer) != VK_SUCCESS)
+		{
+			return 0.0;
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		VkBufferCopy region{};
+		region.size = PROBE_BUFFER_SIZE;
+
+		vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+
+		// Untimed: commit the pages and warm up the copy engine before the first timestamp.
+		vkCmdFillBuffer(commandBuffer, buffers[0], 0, VK_WHOLE_SIZE, 0x5a5a5a5a);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		vkCmdCopyBuffer(commandBuffer, buffers[0], buffers[1], 1, &region);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, queryPool, 0);
+
+		for (uint32_t i = 0; i < PROBE_COPY_COUNT; i++)
+		{
+			vkCmdCopyBuffer(commandBuffer, buffers[i % 2], buffers[(i + 1) % 2], 1, &region);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, queryPool, 1);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		{
+			return 0.0;
+		}
+
+		VkQueue queue = nullptr;
+		vkGetDeviceQueue(device, queueFamily, 0, &queue);
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+
+		if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS ||
+			vkWaitForFences(device, 1, &fence, VK_TRUE, PROBE_TIMEOUT_NANOSECONDS) != VK_SUCCESS)
+		{
+			return 0.0;
+		}
+
+		uint64_t timestamps[2] = {};
+		if (vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+		{
+			return 0.0;
+		}
+
+		uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+		uint64_t mask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+		double seconds = ((timestamps[1] - timestamps[0]) & mask) * static_cast<double>(properties.limits.timestampPeriod) * 1e-9;
+
+		return seconds > 0.0 ? PROBE_COPY_COUNT * static_cast<double>(PROBE_BUFFER_SIZE) / seconds * 1e-9 : 0.0;
+	};
+
+	double gigabytesPerSecond = measure();
+
+	vkDeviceWaitIdle(device);
+	vkDestroyFence(device, fence, this->allocationCallbacks);
+	vkDestroyQueryPool(device, queryPool, this->allocationCallbacks);
+	vkDestroyCommandPool(device, commandPool, this->allocationCallbacks);
+	vkDestroyBuffer(device, buffers[0], this->allocationCallbacks);
+	vkDestroyBuffer(device, buffers[1], this->allocationCallbacks);
+	vkFreeMemory(device, memory, this->allocationCallbacks);
+	vkDestroyDevice(device, this->allocationCallbacks);
+
+	return gigabytesPerSecond;
+}
+
+// One line per device: UUID, driver version, GB/s.
+void DeviceSelector::loadProbeCache()
+{
+	std::ifstream file(this->probeCachePath);
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		std::istringstream fields(line);
+		std::string uuid;
+		CachedProbe probe{};
+
+		// A zero is a failed probe; skip it so the device is probed again.
+		if (fields >> uuid >> probe.driverVersion >> probe.gigabytesPerSecond && probe.gigabytesPerSecond > 0.0)
+		{
+			this->probeCache[uuid] = probe;
+		}
+	}
+}
+
+bool DeviceSelector::saveProbeCache() const
+{
+	std::ofstream file(this->probeCachePath, std::ios::trunc);
+
+	for (const auto& entry : this->probeCache)
+	{
+		file << entry.first << ' ' << entry.second.driverVersion << ' ' << entry.second.gigabytesPerSecond << '\n';
+	}
+
+	return static_cast<bool>(file.flush());
+}
+
+std::string DeviceSelector::getUuidString(VkPhysicalDevice device)
+{
+	VkPhysicalDeviceIDProperties idProperties{};
+	idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+	VkPhysicalDeviceProperties2 properties2{};
+	properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties2.pNext = &idProperties;
+	vkGetPhysicalDeviceProperties2(device, &properties2);
+
+	char text[VK_UUID_SIZE * 2 + 1] = {};
+	for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+	{
+		std::snprintf(text + i * 2, 3, "%02x", idProperties.deviceUUID[i]);
+	}
+
+	return text;
+}
@@ -0,0 +1,220 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+
+#include "Log.h"
+
+// Safety margin added to the predicted CPU + GPU time of a low-latency frame.
+static const double LOW_LATENCY_MARGIN_MILLISECONDS = 1.0;
+
+// Weight of the newest sample in the exponential moving averages.
+static const double AVERAGE_WEIGHT = 0.1;
+
+LatencyMode parseLatencyMode(const std::string& name)
+{
+	if (name == "uncapped")
+	{
+		return LatencyMode::Uncapped;
+	}
+	else if (name == "vsync")
+	{
+		return LatencyMode::Vsync;
+	}
+	else if (name == "low-latency")
+	{
+		return LatencyMode::LowLatency;
+	}
+
+	throw std::invalid_argument("Unknown latency mode: " + name);
+}
+
+const char* getLatencyModeName(LatencyMode mode)
+{
+	switch (mode)
+	{
+	case LatencyMode::Uncapped:
+		return "uncapped";
+	case LatencyMode::Vsync:
+		return "vsync";
+	case LatencyMode::LowLatency:
+		return "low-latency";
+	}
+
+	return "unknown";
+}
+
+void FramePacer::configure(LatencyMode mode, double refreshIntervalMilliseconds, bool logTiming)
+{
+	this->mode = mode;
+	this->logTiming = logTiming;
+
+	if (refreshIntervalMilliseconds > 0.0)
+	{
+		this->refreshIntervalMilliseconds = refreshIntervalMilliseconds;
+	}
+}
+
+void FramePacer::waitForFrameStart()
+{
+	this->pendingSleepMilliseconds = 0.0;
+
+	if (this->mode != LatencyMode::LowLatency || !this->hasLastPresent)
+	{
+		return;
+	}
+
+	// Predict the first vblank after the previous frame's present that this frame can still make, then
+	// start just early enough for the expected CPU and GPU work to finish before it.
+	double budget = this->averageCpuMilliseconds + this->averageGpuMilliseconds + LOW_LATENCY_MARGIN_MILLISECONDS;
+	Clock::time_point now = Clock::now();
+	double sincePresent = toMilliseconds(now - this->lastPresentTime);
+
+	double vblankOffset = this->refreshIntervalMilliseconds;
+	while (vblankOffset - sincePresent < budget)
+	{
+		vblankOffset += this->refreshIntervalMilliseconds;
+	}
+
+	double sleepMilliseconds = vblankOffset - sincePresent - budget;
+	if (sleepMilliseconds <= 0.0)
+	{
+		return;
+	}
+
+	std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(sleepMilliseconds));
+	this->pendingSleepMilliseconds = toMilliseconds(Clock::now() - now);
+}
+
+void FramePacer::beginFrame(uint64_t frame)
+{
+	FrameRecord& record = this->records[frame % RECORD_COUNT];
+	record = {};
+	record.timing.frame = frame;
+	record.timing.sleepMilliseconds = this->pendingSleepMilliseconds;
+	record.startTime = Clock::now();
+
+	// Only the first frame to see a given input event gets charged with its latency.
+	int64_t inputTime = this->lastInputTime.load(std::memory_order_acquire);
+	if (inputTime != this->lastSampledInputTime)
+	{
+		record.inputTime = inputTime;
+		this->lastSampledInputTime = inputTime;
+	}
+
+	this->pendingSleepMilliseconds = 0.0;
+}
+
+void FramePacer::frameSubmitted(uint64_t frame)
+{
+	FrameRecord* record = this->findRecord(frame);
+	if (record == nullptr)
+	{
+		return;
+	}
+
+	record->timing.cpuMilliseconds = toMilliseconds(Clock::now() - record->startTime);
+	this->averageCpuMilliseconds += (record->timing.cpuMilliseconds - this->averageCpuMilliseconds) * AVERAGE_WEIGHT;
+}
+
+void FramePacer::gpuTimeAvailable(uint64_t frame, double gpuMilliseconds)
+{
+	FrameRecord* record = this->findRecord(frame);
+	if (record == nullptr)
+	{
+		return;
+	}
+
+	record->timing.gpuMilliseconds = gpuMilliseconds;
+	record->gpuKnown = true;
+
+	if (gpuMilliseconds >= 0.0)
+	{
+		this->averageGpuMilliseconds += (gpuMilliseconds - this->averageGpuMilliseconds) * AVERAGE_WEIGHT;
+	}
+
+	if (record->presentKnown)
+	{
+		this->finishFrame(*record);
+	}
+}
+
+void FramePacer::presentCompleted(uint64_t frame, Clock::time_point presentTime, bool measured)
+{
+	// Measured present-to-present deltas refine the refresh interval; skip outliers from missed vblanks.
+	if (measured && this->hasLastPresent && this->lastPresentMeasured)
+	{
+		double delta = toMilliseconds(presentTime - this->lastPresentTime);
+		if (delta > 0.0 && delta < this->refreshIntervalMilliseconds * 1.5)
+		{
+			this->refreshIntervalMilliseconds += (delta - this->refreshIntervalMilliseconds) * AVERAGE_WEIGHT;
+		}
+	}
+
+	this->lastPresentTime = presentTime;
+	this->lastPresentMeasured = measured;
+	this->hasLastPresent = true;
+
+	FrameRecord* record = this->findRecord(frame);
+	if (record == nullptr)
+	{
+		return;
+	}
+
+	record->timing.presentMilliseconds = toMilliseconds(presentTime - record->startTime);
+	record->timing.presentMeasured = measured;
+	record->presentKnown = true;
+
+	if (record->inputTime != 0)
+	{
+		record->timing.inputToPhotonMilliseconds = (toNanoseconds(presentTime) - record->inputTime) / 1.0e6;
+	}
+
+	if (record->gpuKnown)
+	{
+		this->finishFrame(*record);
+	}
+}
+
+void FramePacer::notifyInput()
+{
+	this->lastInputTime.store(toNanoseconds(Clock::now()), std::memory_order_release);
+}
+
+FramePacer::FrameRecord* FramePacer::findRecord(uint64_t frame)
+{
+	FrameRecord& record = this->records[frame % RECORD_COUNT];
+	return record.timing.frame == frame ? &record : nullptr;
+}
+
+void FramePacer::finishFrame(FrameRecord& record)
+{
+	if (this->logTiming && Log::isEnabled(LogSeverity::Info))
+	{
+		char inputToPhoton[64] = "";
+		if (record.timing.inputToPhotonMilliseconds >= 0.0)
+		{
+			std::snprintf(inputToPhoton, sizeof(inputToPhoton), ", input-to-photon %.2f ms", record.timing.inputToPhotonMilliseconds);
+		}
+
+		Log::write(LogSeverity::Info, "frame %llu [%s] cpu %.2f ms, gpu %.2f ms, present %.2f ms (%s), sleep %.2f ms%s",
+			static_cast<unsigned long long>(record.timing.frame), getLatencyModeName(this->mode),
+			record.timing.cpuMilliseconds, record.timing.gpuMilliseconds, record.timing.presentMilliseconds,
+			record.timing.presentMeasured ? "measured" : "estimated", record.timing.sleepMilliseconds, inputToPhoton);
+	}
+
+	// Marks the record as reported so a late duplicate notification cannot log it twice.
+	record.timing.frame = UINT64_MAX;
+}
+
+int64_t FramePacer::toNanoseconds(Clock::time_point time)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+double FramePacer::toMilliseconds(Clock::duration duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
@@ -0,0 +1,120 @@
+#include "FrameScheduler.h"
+
+#include <stdexcept>
+
+void FrameScheduler::create(VkDevice device, const VkAllocationCallbacks* allocationCallbacks, uint32_t framesInFlight)
+{
+	if (framesInFlight < 1 || framesInFlight > MAX_FRAMES_IN_FLIGHT)
+	{
+		throw std::invalid_argument("Frames in flight must be between 1 and 4!");
+	}
+
+	this->device = device;
+	this->allocationCallbacks = allocationCallbacks;
+	this->framesInFlight = framesInFlight;
+	this->frameSlot = 0;
+	this->frameValue = 1;
+	this->lastSubmittedValue = 0;
+
+	VkSemaphoreTypeCreateInfo typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+
+	if (vkCreateSemaphore(this->device, &semaphoreInfo, this->allocationCallbacks, &this->timelineSemaphore) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create timeline semaphore!");
+	}
+}
+
+void FrameScheduler::destroy()
+{
+	this->waitIdle();
+
+	vkDestroySemaphore(this->device, this->timelineSemaphore, this->allocationCallbacks);
+	this->timelineSemaphore = nullptr;
+}
+
+void FrameScheduler::beginFrame()
+{
+	// The slot was last used by the frame framesInFlight frames ago.
+	if (this->frameValue > this->framesInFlight)
+	{
+		this->waitForFrame(this->frameValue - this->framesInFlight);
+	}
+
+	this->collectGarbage();
+}
+
+void FrameScheduler::endFrame()
+{
+	this->lastSubmittedValue = this->frameValue;
+	this->frameValue++;
+	this->frameSlot = (this->frameSlot + 1) % this->framesInFlight;
+}
+
+void FrameScheduler::deferDestroy(std::function<void()> destructor)
+{
+	this->deferredDestructions.push_back({ this->frameValue, std::move(destructor) });
+}
+
+void FrameScheduler::collectGarbage()
+{
+	if (!this->deferredDestructions.empty())
+	{
+		this->runCompletedDestructors(this->getCompletedValue());
+	}
+}
+
+void FrameScheduler::waitIdle()
+{
+	this->waitForFrame(this->lastSubmittedValue);
+
+	// Destructors queued for the frame being recorded are safe too once nothing is in flight.
+	this->runCompletedDestructors(UINT64_MAX);
+}
+
+uint64_t FrameScheduler::getCompletedValue() const
+{
+	uint64_t value = 0;
+	if (vkGetSemaphoreCounterValue(this->device, this->timelineSemaphore, &value) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to query timeline semaphore!");
+	}
+
+	return value;
+}
+
+void FrameScheduler::waitForFrame(uint64_t value) const
+{
+	if (value == 0)
+	{
+		return;
+	}
+
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &this->timelineSemaphore;
+	waitInfo.pValues = &value;
+
+	if (vkWaitSemaphores(this->device, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to wait for timeline semaphore!");
+	}
+}
+
+void FrameScheduler::runCompletedDestructors(uint64_t completedValue)
+{
+	// Destructions are queued in non-decreasing frame order.
+	while (!this->deferredDestructions.empty() && this->deferredDestructions.front().value <= completedValue)
+	{
+		auto destructor = std::move(this->deferredDestructions.front().destructor);
+		this->deferredDestructions.pop_front();
+		destructor();
+	}
+}
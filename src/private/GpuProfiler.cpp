@@ -0,0 +1,303 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+struct StatisticName
+{
+	VkQueryPipelineStatisticFlagBits flag;
+	const char* name;
+};
+
+// In bit order, which is the order vkGetQueryPoolResults writes the enabled counters in.
+static const StatisticName STATISTIC_NAMES[] =
+{
+	{ VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT, "Input assembly vertices" },
+	{ VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT, "Input assembly primitives" },
+	{ VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT, "Vertex shader invocations" },
+	{ VK_QUERY_PIPELINE_STATISTIC_GEOMETRY_SHADER_INVOCATIONS_BIT, "Geometry shader invocations" },
+	{ VK_QUERY_PIPELINE_STATISTIC_GEOMETRY_SHADER_PRIMITIVES_BIT, "Geometry shader primitives" },
+	{ VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT, "Clipping invocations" },
+	{ VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT, "Clipping primitives" },
+	{ VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT, "Fragment shader invocations" },
+	{ VK_QUERY_PIPELINE_STATISTIC_TESSELLATION_CONTROL_SHADER_PATCHES_BIT, "Tessellation control shader patches" },
+	{ VK_QUERY_PIPELINE_STATISTIC_TESSELLATION_EVALUATION_SHADER_INVOCATIONS_BIT, "Tessellation evaluation shader invocations" },
+	{ VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT, "Compute shader invocations" },
+};
+
+void GpuProfiler::History::add(double sample)
+{
+	if (this->samples.size() < HISTORY_LENGTH)
+	{
+		this->samples.push_back(sample);
+		return;
+	}
+
+	this->samples[this->next] = sample;
+	this->next = (this->next + 1) % HISTORY_LENGTH;
+}
+
+void GpuProfiler::create(VkDevice device, const VkAllocationCallbacks* allocationCallbacks, uint32_t framesInFlight, float timestampPeriod, uint32_t timestampValidBits, VkQueryPipelineStatisticFlags statistics)
+{
+	this->device = device;
+	this->allocationCallbacks = allocationCallbacks;
+	this->timestampPeriod = timestampPeriod;
+	this->timestampMask = timestampValidBits >= 64 ? ~0ull : (1ull << timestampValidBits) - 1;
+	this->statistics = statistics;
+	this->slotLayouts.assign(framesInFlight, SlotLayout{});
+
+	if (timestampValidBits > 0 && timestampPeriod > 0.0f)
+	{
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = framesInFlight * QUERIES_PER_SLOT;
+
+		if (vkCreateQueryPool(this->device, &queryPoolInfo, this->allocationCallbacks, &this->timestampQueryPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create timestamp query pool!");
+		}
+	}
+
+	if (this->statistics != 0)
+	{
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		queryPoolInfo.queryCount = framesInFlight;
+		queryPoolInfo.pipelineStatistics = this->statistics;
+
+		if (vkCreateQueryPool(this->device, &queryPoolInfo, this->allocationCallbacks, &this->statisticsQueryPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create pipeline statistics query pool!");
+		}
+
+		for (const StatisticName& statistic : STATISTIC_NAMES)
+		{
+			if (this->statistics & statistic.flag)
+			{
+				this->statisticHistories.push_back(History{ statistic.name });
+			}
+		}
+
+		this->lastStatistics.assign(this->statisticHistories.size(), 0);
+	}
+}
+
+void GpuProfiler::destroy()
+{
+	vkDestroyQueryPool(this->device, this->timestampQueryPool, this->allocationCallbacks);
+	vkDestroyQueryPool(this->device, this->statisticsQueryPool, this->allocationCallbacks);
+	this->timestampQueryPool = nullptr;
+	this->statisticsQueryPool = nullptr;
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+	this->recordingSlot = frameSlot;
+	this->slotLayouts[frameSlot].scopes.clear();
+	this->slotLayouts[frameSlot].recorded = true;
+
+	if (this->timestampQueryPool != nullptr)
+	{
+		vkCmdResetQueryPool(commandBuffer, this->timestampQueryPool, frameSlot * QUERIES_PER_SLOT, QUERIES_PER_SLOT);
+	}
+
+	if (this->statisticsQueryPool != nullptr)
+	{
+		vkCmdResetQueryPool(commandBuffer, this->statisticsQueryPool, frameSlot, 1);
+		vkCmdBeginQuery(commandBuffer, this->statisticsQueryPool, frameSlot, 0);
+	}
+
+	this->beginScope(commandBuffer, "Frame");
+}
+
+void GpuProfiler::endFrame(VkCommandBuffer commandBuffer)
+{
+	this->endScope(commandBuffer, 0);
+
+	if (this->statisticsQueryPool != nullptr)
+	{
+		vkCmdEndQuery(commandBuffer, this->statisticsQueryPool, this->recordingSlot);
+	}
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer commandBuffer, const char* name)
+{
+	SlotLayout& layout = this->slotLayouts[this->recordingSlot];
+	if (this->timestampQueryPool == nullptr || layout.scopes.size() >= MAX_SCOPES)
+	{
+		return UINT32_MAX;
+	}
+
+	uint32_t scope = static_cast<uint32_t>(layout.scopes.size());
+	layout.scopes.push_back(this->findScope(name));
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, this->timestampQueryPool, this->recordingSlot * QUERIES_PER_SLOT + scope * 2);
+	return scope;
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope)
+{
+	if (scope == UINT32_MAX || this->timestampQueryPool == nullptr)
+	{
+		return;
+	}
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, this->timestampQueryPool, this->recordingSlot * QUERIES_PER_SLOT + scope * 2 + 1);
+}
+
+bool GpuProfiler::collect(uint32_t frameSlot)
+{
+	const SlotLayout& layout = this->slotLayouts[frameSlot];
+	this->lastFrameMilliseconds = -1.0;
+
+	if (!layout.recorded)
+	{
+		return false;
+	}
+
+	if (this->statisticsQueryPool != nullptr &&
+		vkGetQueryPoolResults(this->device, this->statisticsQueryPool, frameSlot, 1, sizeof(uint64_t) * this->lastStatistics.size(), this->lastStatistics.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+	{
+		for (size_t i = 0; i < this->lastStatistics.size(); i++)
+		{
+			this->statisticHistories[i].add(static_cast<double>(this->lastStatistics[i]));
+		}
+	}
+	else
+	{
+		std::fill(this->lastStatistics.begin(), this->lastStatistics.end(), 0);
+	}
+
+	if (this->timestampQueryPool == nullptr || layout.scopes.empty())
+	{
+		return false;
+	}
+
+	uint64_t timestamps[QUERIES_PER_SLOT] = {};
+	uint32_t queryCount = static_cast<uint32_t>(layout.scopes.size()) * 2;
+
+	// Without VK_QUERY_RESULT_WAIT_BIT this returns VK_NOT_READY instead of blocking.
+	if (vkGetQueryPoolResults(this->device, this->timestampQueryPool, frameSlot * QUERIES_PER_SLOT, queryCount, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	for (size_t scope = 0; scope < layout.scopes.size(); scope++)
+	{
+		uint64_t ticks = (timestamps[scope * 2 + 1] - timestamps[scope * 2]) & this->timestampMask;
+		double milliseconds = ticks * this->timestampPeriod / 1.0e6;
+
+		this->scopeHistories[layout.scopes[scope]].add(milliseconds);
+
+		if (scope == 0)
+		{
+			this->lastFrameMilliseconds = milliseconds;
+		}
+	}
+
+	return true;
+}
+
+uint64_t GpuProfiler::getStatistic(VkQueryPipelineStatisticFlagBits statistic) const
+{
+	size_t index = 0;
+	for (const StatisticName& name : STATISTIC_NAMES)
+	{
+		if (name.flag == statistic)
+		{
+			return (this->statistics & statistic) ? this->lastStatistics[index] : 0;
+		}
+
+		if (this->statistics & name.flag)
+		{
+			index++;
+		}
+	}
+
+	return 0;
+}
+
+std::vector<GpuProfiler::Summary> GpuProfiler::getSummaries() const
+{
+	std::vector<Summary> summaries;
+
+	for (const History& history : this->scopeHistories)
+	{
+		summaries.push_back(summarize(history, "ms"));
+	}
+
+	for (const History& history : this->statisticHistories)
+	{
+		summaries.push_back(summarize(history, "count"));
+	}
+
+	return summaries;
+}
+
+bool GpuProfiler::writeCsv(const std::string& path) const
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	file << "name,unit,samples,last,min,avg,p99\n";
+
+	for (const Summary& summary : this->getSummaries())
+	{
+		file << '"' << summary.name << "\"," << summary.unit << ',' << summary.sampleCount << ',' << summary.last << ','
+			<< summary.minimum << ',' << summary.average << ',' << summary.p99 << '\n';
+	}
+
+	return static_cast<bool>(file);
+}
+
+uint32_t GpuProfiler::findScope(const char* name)
+{
+	for (size_t i = 0; i < this->scopeHistories.size(); i++)
+	{
+		if (this->scopeHistories[i].name == name)
+		{
+			return static_cast<uint32_t>(i);
+		}
+	}
+
+	this->scopeHistories.push_back(History{ name });
+	return static_cast<uint32_t>(this->scopeHistories.size() - 1);
+}
+
+GpuProfiler::Summary GpuProfiler::summarize(const History& history, const char* unit)
+{
+	Summary summary{};
+	summary.name = history.name;
+	summary.unit = unit;
+	summary.sampleCount = history.samples.size();
+
+	if (history.samples.empty())
+	{
+		return summary;
+	}
+
+	size_t newest = history.samples.size() < HISTORY_LENGTH ? history.samples.size() - 1 : (history.next + HISTORY_LENGTH - 1) % HISTORY_LENGTH;
+	summary.last = history.samples[newest];
+
+	std::vector<double> sorted = history.samples;
+	std::sort(sorted.begin(), sorted.end());
+
+	double total = 0.0;
+	for (double sample : sorted)
+	{
+		total += sample;
+	}
+
+	summary.minimum = sorted.front();
+	summary.average = total / sorted.size();
+	summary.p99 = sorted[static_cast<size_t>(std::ceil(sorted.size() * 0.99)) - 1];
+
+	return summary;
+}
@@ -0,0 +1,282 @@
+#include "HostAllocator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+static const uint64_t ARENA_OFFSET_MASK = (1ull << 40) - 1;
+static const uint64_t ARENA_OUTSTANDING_ONE = 1ull << 40;
+
+// Sits immediately before every pointer handed out, so frees and reallocations know where the block came
+// from. sizeof is a multiple of alignof, so a user pointer aligned for the header leaves the header aligned.
+struct AllocationHeader
+{
+	void* base;       // what malloc returned; nullptr for arena allocations
+	size_t size;
+	uint32_t scope;
+	uint32_t fromArena;
+};
+
+static uintptr_t alignUp(uintptr_t value, size_t alignment)
+{
+	return (value + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+}
+
+template<typename T>
+static void updateMaximum(std::atomic<T>& maximum, T value)
+{
+	T current = maximum.load(std::memory_order_relaxed);
+	while (current < value && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+static AllocationHeader* getHeader(void* memory)
+{
+	return reinterpret_cast<AllocationHeader*>(memory) - 1;
+}
+
+void HostAllocator::create(size_t commandArenaSize)
+{
+	this->callbacks.pUserData = this;
+	this->callbacks.pfnAllocation = allocationCallback;
+	this->callbacks.pfnReallocation = reallocationCallback;
+	this->callbacks.pfnFree = freeCallback;
+	this->callbacks.pfnInternalAllocation = internalAllocationCallback;
+	this->callbacks.pfnInternalFree = internalFreeCallback;
+
+	this->arenaSize = std::min<size_t>(commandArenaSize, ARENA_OFFSET_MASK);
+	this->arena.reset(this->arenaSize > 0 ? new unsigned char[this->arenaSize] : nullptr);
+	this->arenaState.store(0, std::memory_order_relaxed);
+}
+
+void HostAllocator::destroy()
+{
+	this->arena.reset();
+	this->arenaSize = 0;
+}
+
+void HostAllocator::beginFrame()
+{
+	if (this->arena == nullptr)
+	{
+		return;
+	}
+
+	uint64_t state = this->arenaState.load(std::memory_order_relaxed);
+
+	while ((state & ARENA_OFFSET_MASK) != 0)
+	{
+		if ((state & ~ARENA_OFFSET_MASK) != 0)
+		{
+			this->arenaSkippedResets.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		if (this->arenaState.compare_exchange_weak(state, 0, std::memory_order_acq_rel))
+		{
+			return;
+		}
+	}
+}
+
+HostAllocator::ScopeStatistics HostAllocator::getStatistics(VkSystemAllocationScope scope) const
+{
+	const Counters& counters = this->counters[scope];
+
+	ScopeStatistics statistics{};
+	statistics.allocations = counters.allocations.load(std::memory_order_relaxed);
+	statistics.reallocations = counters.reallocations.load(std::memory_order_relaxed);
+	statistics.frees = counters.frees.load(std::memory_order_relaxed);
+	statistics.totalBytes = counters.totalBytes.load(std::memory_order_relaxed);
+	statistics.liveBytes = counters.liveBytes.load(std::memory_order_relaxed);
+	statistics.peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+	statistics.arenaAllocations = counters.arenaAllocations.load(std::memory_order_relaxed);
+	statistics.internalLiveBytes = counters.internalLiveBytes.load(std::memory_order_relaxed);
+	statistics.internalPeakBytes = counters.internalPeakBytes.load(std::memory_order_relaxed);
+	return statistics;
+}
+
+const char* HostAllocator::getScopeName(VkSystemAllocationScope scope)
+{
+	switch (scope)
+	{
+	case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND:
+		return "Command";
+	case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT:
+		return "Object";
+	case VK_SYSTEM_ALLOCATION_SCOPE_CACHE:
+		return "Cache";
+	case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE:
+		return "Device";
+	case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE:
+		return "Instance";
+	default:
+		return "Unknown";
+	}
+}
+
+void* HostAllocator::allocate(size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	if (size == 0 || static_cast<uint32_t>(scope) >= SCOPE_COUNT)
+	{
+		return nullptr;
+	}
+
+	alignment = std::max(alignment, alignof(AllocationHeader));
+
+	Counters& counters = this->counters[scope];
+	void* memory = nullptr;
+	void* base = nullptr;
+
+	if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && this->arena != nullptr)
+	{
+		memory = this->allocateFromArena(size, alignment);
+	}
+
+	if (memory != nullptr)
+	{
+		counters.arenaAllocations.fetch_add(1, std::memory_order_relaxed);
+	}
+	else
+	{
+		base = std::malloc(size + sizeof(AllocationHeader) + alignment - 1);
+		if (base == nullptr)
+		{
+			return nullptr;
+		}
+
+		memory = reinterpret_cast<void*>(alignUp(reinterpret_cast<uintptr_t>(base) + sizeof(AllocationHeader), alignment));
+	}
+
+	AllocationHeader* header = getHeader(memory);
+	header->base = base;
+	header->size = size;
+	header->scope = static_cast<uint32_t>(scope);
+	header->fromArena = base == nullptr ? 1 : 0;
+
+	counters.allocations.fetch_add(1, std::memory_order_relaxed);
+	counters.totalBytes.fetch_add(size, std::memory_order_relaxed);
+	updateMaximum<uint64_t>(counters.peakBytes, counters.liveBytes.fetch_add(size, std::memory_order_relaxed) + size);
+
+	return memory;
+}
+
+void* HostAllocator::reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	if (original == nullptr)
+	{
+		return this->allocate(size, alignment, scope);
+	}
+
+	if (size == 0)
+	{
+		this->release(original);
+		return nullptr;
+	}
+
+	// On failure the original must stay valid, so it is only released once the copy has been made.
+	void* memory = this->allocate(size, alignment, scope);
+	if (memory == nullptr)
+	{
+		return nullptr;
+	}
+
+	std::memcpy(memory, original, std::min(size, getHeader(original)->size));
+	this->release(original);
+
+	this->counters[scope].reallocations.fetch_add(1, std::memory_order_relaxed);
+	return memory;
+}
+
+void HostAllocator::release(void* memory)
+{
+	if (memory == nullptr)
+	{
+		return;
+	}
+
+	AllocationHeader* header = getHeader(memory);
+	Counters& counters = this->counters[header->scope];
+
+	counters.frees.fetch_add(1, std::memory_order_relaxed);
+	counters.liveBytes.fetch_sub(header->size, std::memory_order_relaxed);
+
+	if (header->fromArena)
+	{
+		// Release, so a rewind that observes the count reaching zero also sees every use of the memory.
+		this->arenaState.fetch_sub(ARENA_OUTSTANDING_ONE, std::memory_order_release);
+	}
+	else
+	{
+		std::free(header->base);
+	}
+}
+
+void* HostAllocator::allocateFromArena(size_t size, size_t alignment)
+{
+	uintptr_t arenaBase = reinterpret_cast<uintptr_t>(this->arena.get());
+	uint64_t state = this->arenaState.load(std::memory_order_relaxed);
+	uint64_t offset = 0;
+	uint64_t end = 0;
+
+	do
+	{
+		offset = alignUp(arenaBase + (state & ARENA_OFFSET_MASK) + sizeof(AllocationHeader), alignment) - arenaBase;
+		end = offset + size;
+
+		if (end > this->arenaSize)
+		{
+			this->arenaOverflows.fetch_add(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+	}
+	while (!this->arenaState.compare_exchange_weak(state, ((state & ~ARENA_OFFSET_MASK) + ARENA_OUTSTANDING_ONE) | end, std::memory_order_acq_rel));
+
+	updateMaximum<size_t>(this->arenaPeakBytes, static_cast<size_t>(end));
+	return this->arena.get() + offset;
+}
+
+void HostAllocator::notifyInternal(size_t size, VkSystemAllocationScope scope, bool allocated)
+{
+	if (static_cast<uint32_t>(scope) >= SCOPE_COUNT)
+	{
+		return;
+	}
+
+	Counters& counters = this->counters[scope];
+
+	if (allocated)
+	{
+		updateMaximum<uint64_t>(counters.internalPeakBytes, counters.internalLiveBytes.fetch_add(size, std::memory_order_relaxed) + size);
+	}
+	else
+	{
+		counters.internalLiveBytes.fetch_sub(size, std::memory_order_relaxed);
+	}
+}
+
+void* VKAPI_CALL HostAllocator::allocationCallback(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	return static_cast<HostAllocator*>(userData)->allocate(size, alignment, scope);
+}
+
+void* VKAPI_CALL HostAllocator::reallocationCallback(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	return static_cast<HostAllocator*>(userData)->reallocate(original, size, alignment, scope);
+}
+
+void VKAPI_CALL HostAllocator::freeCallback(void* userData, void* memory)
+{
+	static_cast<HostAllocator*>(userData)->release(memory);
+}
+
+void VKAPI_CALL HostAllocator::internalAllocationCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+	static_cast<HostAllocator*>(userData)->notifyInternal(size, scope, true);
+}
+
+void VKAPI_CALL HostAllocator::internalFreeCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+	static_cast<HostAllocator*>(userData)->notifyInternal(size, scope, false);
+}
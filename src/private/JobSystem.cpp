@@ -0,0 +1,524 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+
+#include "Trace.h"
+
+// Number of failed attempts to find work before an idle worker goes to sleep.
+static const uint32_t IDLE_SPIN_COUNT = 64;
+
+static thread_local uint32_t currentWorkerIndex = UINT32_MAX;
+
+bool WorkStealingDeque::push(Job* job)
+{
+	int64_t b = this->bottom.load(std::memory_order_relaxed);
+	int64_t t = this->top.load(std::memory_order_acquire);
+
+	if (b - t >= CAPACITY)
+	{
+		return false;
+	}
+
+	this->buffer[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	this->bottom.store(b + 1, std::memory_order_relaxed);
+	return true;
+}
+
+Job* WorkStealingDeque::pop()
+{
+	int64_t b = this->bottom.load(std::memory_order_relaxed) - 1;
+	this->bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = this->top.load(std::memory_order_relaxed);
+
+	if (t > b)
+	{
+		// Empty.
+		this->bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = this->buffer[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+	if (t == b)
+	{
+		// Last element: race any thief for it.
+		if (!this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			job = nullptr;
+		}
+
+		this->bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+Job* WorkStealingDeque::steal()
+{
+	int64_t t = this->top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t b = this->bottom.load(std::memory_order_acquire);
+
+	if (t >= b)
+	{
+		return nullptr;
+	}
+
+	Job* job = this->buffer[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+	if (!this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+	{
+		return nullptr;
+	}
+
+	return job;
+}
+
+TaskGraph::Task::Task(Task&& other) noexcept :
+	name(std::move(other.name)),
+	function(std::move(other.function)),
+	successors(std::move(other.successors)),
+	dependencyCount(other.dependencyCount),
+	pendingDependencies(other.pendingDependencies.load()),
+	timing(other.timing)
+{
+}
+
+TaskGraph::TaskId TaskGraph::addTask(const std::string& name, std::function<void()> function)
+{
+	Task task{};
+	task.name = name;
+	task.function = std::move(function);
+	this->tasks.push_back(std::move(task));
+
+	return static_cast<TaskId>(this->tasks.size() - 1);
+}
+
+void TaskGraph::addDependency(TaskId before, TaskId after)
+{
+	this->tasks[before].successors.push_back(after);
+	this->tasks[after].dependencyCount++;
+}
+
+std::vector<TaskGraph::TaskId> TaskGraph::getCriticalPath() const
+{
+	size_t taskCount = this->tasks.size();
+
+	// Kahn's algorithm gives a topological order; then relax the longest finishing chain through it.
+	std::vector<uint32_t> remaining(taskCount);
+	std::vector<TaskId> order;
+	order.reserve(taskCount);
+
+	for (size_t i = 0; i < taskCount; i++)
+	{
+		remaining[i] = this->tasks[i].dependencyCount;
+		if (remaining[i] == 0)
+		{
+			order.push_back(static_cast<TaskId>(i));
+		}
+	}
+
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		for (TaskId successor : this->tasks[order[i]].successors)
+		{
+			if (--remaining[successor] == 0)
+			{
+				order.push_back(successor);
+			}
+		}
+	}
+
+	std::vector<uint64_t> pathLength(taskCount, 0);
+	std::vector<TaskId> previous(taskCount, UINT32_MAX);
+
+	for (TaskId task : order)
+	{
+		const TaskTiming& timing = this->tasks[task].timing;
+		pathLength[task] += timing.endNanoseconds - timing.startNanoseconds;
+
+		for (TaskId successor : this->tasks[task].successors)
+		{
+			if (pathLength[task] > pathLength[successor])
+			{
+				pathLength[successor] = pathLength[task];
+				previous[successor] = task;
+			}
+		}
+	}
+
+	std::vector<TaskId> path;
+	if (order.empty())
+	{
+		return path;
+	}
+
+	TaskId last = *std::max_element(order.begin(), order.end(), [&](TaskId a, TaskId b) { return pathLength[a] < pathLength[b]; });
+	for (TaskId task = last; task != UINT32_MAX; task = previous[task])
+	{
+		path.push_back(task);
+	}
+
+	std::reverse(path.begin(), path.end());
+	return path;
+}
+
+void TaskGraph::printTimings(std::ostream& stream) const
+{
+	auto milliseconds = [](uint64_t nanoseconds) { return nanoseconds / 1.0e6; };
+
+	stream << std::fixed << std::setprecision(3);
+	stream << "Task graph: " << milliseconds(this->runEndNanoseconds - this->runStartNanoseconds) << " ms" << std::endl;
+
+	for (const Task& task : this->tasks)
+	{
+		stream << "\t" << task.name << ": +" << milliseconds(task.timing.startNanoseconds - this->runStartNanoseconds)
+			<< " ms, " << milliseconds(task.timing.endNanoseconds - task.timing.startNanoseconds) << " ms on worker " << task.timing.workerIndex << std::endl;
+	}
+
+	uint64_t criticalNanoseconds = 0;
+	stream << "\tcritical path:";
+	for (TaskId task : this->getCriticalPath())
+	{
+		const TaskTiming& timing = this->tasks[task].timing;
+		criticalNanoseconds += timing.endNanoseconds - timing.startNanoseconds;
+		stream << " " << this->tasks[task].name;
+	}
+
+	stream << " (" << milliseconds(criticalNanoseconds) << " ms)" << std::endl;
+	stream << std::defaultfloat;
+}
+
+void JobSystem::start(uint32_t workerCount)
+{
+	workerCount = std::max(1u, workerCount);
+
+	this->stopping = false;
+	for (uint32_t i = 0; i < workerCount; i++)
+	{
+		this->deques.push_back(std::make_unique<WorkStealingDeque>());
+	}
+
+	currentWorkerIndex = 0;
+
+	for (uint32_t i = 1; i < workerCount; i++)
+	{
+		this->threads.emplace_back([this, i]() { this->workerLoop(i); });
+	}
+
+	this->backgroundThread = std::thread(&JobSystem::backgroundLoop, this);
+}
+
+void JobSystem::stop()
+{
+	this->stopping = true;
+
+	{
+		std::lock_guard<std::mutex> lock(this->sleepMutex);
+		this->workEpoch++;
+	}
+
+	this->sleepCondition.notify_all();
+
+	{
+		std::lock_guard<std::mutex> lock(this->backgroundMutex);
+	}
+
+	this->backgroundCondition.notify_all();
+
+	for (auto& thread : this->threads)
+	{
+		thread.join();
+	}
+
+	if (this->backgroundThread.joinable())
+	{
+		this->backgroundThread.join();
+	}
+
+	this->threads.clear();
+	this->deques.clear();
+	currentWorkerIndex = UINT32_MAX;
+}
+
+uint32_t JobSystem::getCurrentWorkerIndex()
+{
+	return currentWorkerIndex;
+}
+
+void JobSystem::submit(Job* job)
+{
+	uint32_t workerIndex = currentWorkerIndex;
+	if (workerIndex >= this->deques.size())
+	{
+		throw std::logic_error("Jobs can only be submitted from job system worker threads!");
+	}
+
+	if (!this->deques[workerIndex]->push(job))
+	{
+		// Deque full: run it now rather than block.
+		this->execute(job, workerIndex);
+		return;
+	}
+
+	// Pairs with the sleepingCount increment in workerLoop(): either the worker sees the new epoch and
+	// stays awake, or we see it sleeping and wake it.
+	this->workEpoch.fetch_add(1, std::memory_order_seq_cst);
+	if (this->sleepingCount.load(std::memory_order_seq_cst) > 0)
+	{
+		std::lock_guard<std::mutex> lock(this->sleepMutex);
+		this->sleepCondition.notify_one();
+	}
+}
+
+void JobSystem::submitBackground(Job* job)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->backgroundMutex);
+		this->backgroundJobs.push_back(job);
+	}
+
+	this->backgroundCondition.notify_one();
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+	uint32_t workerIndex = currentWorkerIndex;
+
+	while (counter.pending.load(std::memory_order_acquire) > 0)
+	{
+		Job* job = workerIndex < this->deques.size() ? this->findJob(workerIndex) : nullptr;
+		if (job != nullptr)
+		{
+			this->execute(job, workerIndex);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	std::exception_ptr jobError = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(counter.errorMutex);
+		std::swap(jobError, counter.error);
+	}
+
+	if (jobError)
+	{
+		std::rethrow_exception(jobError);
+	}
+}
+
+void JobSystem::parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t, uint32_t)>& body)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	grainSize = std::max<size_t>(1, grainSize);
+	size_t chunkCount = (count + grainSize - 1) / grainSize;
+
+	JobCounter counter{};
+	counter.pending.store(static_cast<int32_t>(chunkCount), std::memory_order_relaxed);
+	std::vector<Job> jobs(chunkCount);
+
+	// Push in reverse so the owning worker pops the chunks front to back.
+	for (size_t chunk = chunkCount; chunk-- > 0;)
+	{
+		size_t begin = chunk * grainSize;
+		size_t end = std::min(count, begin + grainSize);
+
+		jobs[chunk].function = [&body, begin, end](uint32_t workerIndex) { body(begin, end, workerIndex); };
+		jobs[chunk].counter = &counter;
+		this->submit(&jobs[chunk]);
+	}
+
+	this->wait(counter);
+}
+
+void JobSystem::run(TaskGraph& graph)
+{
+	JobCounter counter{};
+	counter.pending.store(static_cast<int32_t>(graph.tasks.size()), std::memory_order_relaxed);
+	graph.failed.store(false, std::memory_order_relaxed);
+
+	for (TaskGraph::TaskId i = 0; i < graph.tasks.size(); i++)
+	{
+		TaskGraph::Task& task = graph.tasks[i];
+		task.pendingDependencies.store(task.dependencyCount, std::memory_order_relaxed);
+		task.job.counter = &counter;
+		task.job.function = [this, &graph, i](uint32_t workerIndex) { this->runTask(graph, i, workerIndex); };
+	}
+
+	graph.runStartNanoseconds = now();
+
+	for (TaskGraph::Task& task : graph.tasks)
+	{
+		if (task.dependencyCount == 0)
+		{
+			this->submit(&task.job);
+		}
+	}
+
+	this->wait(counter);
+	graph.runEndNanoseconds = now();
+}
+
+uint64_t JobSystem::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void JobSystem::workerLoop(uint32_t workerIndex)
+{
+	currentWorkerIndex = workerIndex;
+	TRACE_THREAD_NAME("Worker " + std::to_string(workerIndex));
+	uint32_t idleCount = 0;
+
+	while (!this->stopping.load(std::memory_order_relaxed))
+	{
+		uint64_t epoch = this->workEpoch.load(std::memory_order_seq_cst);
+
+		Job* job = this->findJob(workerIndex);
+		if (job != nullptr)
+		{
+			this->execute(job, workerIndex);
+			idleCount = 0;
+			continue;
+		}
+
+		if (++idleCount < IDLE_SPIN_COUNT)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(this->sleepMutex);
+		this->sleepingCount.fetch_add(1, std::memory_order_seq_cst);
+		this->sleepCondition.wait(lock, [&]() { return this->stopping.load() || this->workEpoch.load(std::memory_order_seq_cst) != epoch; });
+		this->sleepingCount.fetch_sub(1, std::memory_order_seq_cst);
+		idleCount = 0;
+	}
+}
+
+void JobSystem::backgroundLoop()
+{
+	TRACE_THREAD_NAME("Background jobs");
+
+	while (true)
+	{
+		Job* job = nullptr;
+
+		{
+			std::unique_lock<std::mutex> lock(this->backgroundMutex);
+			this->backgroundCondition.wait(lock, [&]() { return this->stopping.load() || !this->backgroundJobs.empty(); });
+
+			// Queued jobs are still run on stop so their counters reach zero.
+			if (this->backgroundJobs.empty())
+			{
+				return;
+			}
+
+			job = this->backgroundJobs.front();
+			this->backgroundJobs.pop_front();
+		}
+
+		this->execute(job, UINT32_MAX);
+	}
+}
+
+Job* JobSystem::findJob(uint32_t workerIndex)
+{
+	Job* job = this->deques[workerIndex]->pop();
+	if (job != nullptr)
+	{
+		return job;
+	}
+
+	// Steal round-robin, starting after ourselves so victims are spread across workers.
+	uint32_t workerCount = this->getWorkerCount();
+	for (uint32_t i = 1; i < workerCount; i++)
+	{
+		job = this->deques[(workerIndex + i) % workerCount]->steal();
+		if (job != nullptr)
+		{
+			return job;
+		}
+	}
+
+	return nullptr;
+}
+
+void JobSystem::execute(Job* job, uint32_t workerIndex)
+{
+	// Read the counter first: finishing the job may let the submitter release it.
+	JobCounter* counter = job->counter;
+
+	if (counter == nullptr)
+	{
+		job->function(workerIndex);
+		return;
+	}
+
+	try
+	{
+		job->function(workerIndex);
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(counter->errorMutex);
+		if (!counter->error)
+		{
+			counter->error = std::current_exception();
+		}
+	}
+
+	counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::runTask(TaskGraph& graph, TaskGraph::TaskId taskId, uint32_t workerIndex)
+{
+	TaskGraph::Task& task = graph.tasks[taskId];
+	task.timing.workerIndex = workerIndex;
+	task.timing.startNanoseconds = now();
+
+	// After a failure the rest of the run is skipped, but every task still releases its successors, so
+	// each one completes, the run's counter drains and run() can rethrow.
+	std::exception_ptr taskError = nullptr;
+	if (!graph.failed.load(std::memory_order_acquire))
+	{
+		try
+		{
+			task.function();
+		}
+		catch (...)
+		{
+			taskError = std::current_exception();
+			graph.failed.store(true, std::memory_order_release);
+		}
+	}
+
+	task.timing.endNanoseconds = now();
+
+	for (TaskGraph::TaskId successor : task.successors)
+	{
+		if (graph.tasks[successor].pendingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			this->submit(&graph.tasks[successor].job);
+		}
+	}
+
+	if (taskError)
+	{
+		std::rethrow_exception(taskError);
+	}
+}
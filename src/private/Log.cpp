@@ -0,0 +1,312 @@
+#include "Log.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+#include "Trace.h"
+
+static const uint32_t QUEUE_CAPACITY = 512; // power of two
+static const uint32_t REPEAT_TABLE_SIZE = 512; // distinct rate-limited message IDs tracked; power of two
+static const std::chrono::milliseconds WRITER_IDLE_SLEEP(2);
+
+// One slot of the ring buffer. sequence says whose turn the slot is: equal to a producer's claimed position
+// when the slot is free for it, position + 1 once the message is published, and position + QUEUE_CAPACITY
+// once the writer has consumed it and it is free for the next lap.
+struct LogEntry
+{
+	std::atomic<uint64_t> sequence{ 0 };
+	LogSeverity severity = LogSeverity::Info;
+	uint32_t length = 0;
+	char text[Log::MAX_MESSAGE_LENGTH];
+};
+
+struct RepeatCounter
+{
+	std::atomic<int32_t> messageId{ 0 }; // 0 = unused
+	std::atomic<uint32_t> count{ 0 };
+};
+
+static std::unique_ptr<LogEntry[]> entries;
+static std::atomic<uint64_t> enqueuePosition{ 0 };
+static uint64_t dequeuePosition = 0; // writer only
+static std::atomic<uint64_t> droppedCount{ 0 };
+static RepeatCounter repeatCounters[REPEAT_TABLE_SIZE];
+
+static std::atomic<int> minSeverity{ static_cast<int>(LogSeverity::Info) };
+static std::atomic<bool> running{ false };
+static std::thread writerThread;
+
+static FILE* getStream(LogSeverity severity)
+{
+	return severity >= LogSeverity::Warning ? stderr : stdout;
+}
+
+// Formats into text, truncating with "..." when the message doesn't fit. Returns the length without the
+// terminator, which is replaced by a newline.
+static uint32_t formatMessage(char* text, const char* format, va_list args, bool appendSuppressedNote)
+{
+	static const char SUPPRESSED_NOTE[] = " (further repeats suppressed)";
+	const uint32_t capacity = Log::MAX_MESSAGE_LENGTH - 1; // room for the newline
+
+	int written = std::vsnprintf(text, capacity, format, args);
+	uint32_t length = written < 0 ? 0 : static_cast<uint32_t>(written);
+
+	if (length >= capacity)
+	{
+		length = capacity - 1;
+		text[length - 3] = text[length - 2] = text[length - 1] = '.';
+	}
+
+	if (appendSuppressedNote && length + sizeof(SUPPRESSED_NOTE) <= capacity)
+	{
+		std::snprintf(text + length, capacity - length, "%s", SUPPRESSED_NOTE);
+		length += sizeof(SUPPRESSED_NOTE) - 1;
+	}
+
+	text[length++] = '\n';
+	return length;
+}
+
+// Counts one more message with messageId; returns how many there have been including this one, or 0 if the
+// table is full and the ID can't be tracked.
+static uint32_t countRepeat(int32_t messageId)
+{
+	uint32_t hash = static_cast<uint32_t>(messageId) * 2654435761u;
+
+	for (uint32_t probe = 0; probe < REPEAT_TABLE_SIZE; probe++)
+	{
+		RepeatCounter& counter = repeatCounters[(hash + probe) & (REPEAT_TABLE_SIZE - 1)];
+		int32_t id = counter.messageId.load(std::memory_order_acquire);
+
+		if (id == 0)
+		{
+			int32_t expected = 0;
+			if (counter.messageId.compare_exchange_strong(expected, messageId, std::memory_order_acq_rel) || expected == messageId)
+			{
+				return counter.count.fetch_add(1, std::memory_order_relaxed) + 1;
+			}
+
+			id = expected;
+		}
+
+		if (id == messageId)
+		{
+			return counter.count.fetch_add(1, std::memory_order_relaxed) + 1;
+		}
+	}
+
+	return 0;
+}
+
+// Claims the next free slot, or returns nullptr when the writer has fallen a whole buffer behind.
+static LogEntry* claimEntry(uint64_t& position)
+{
+	position = enqueuePosition.load(std::memory_order_relaxed);
+
+	for (;;)
+	{
+		LogEntry& entry = entries[position & (QUEUE_CAPACITY - 1)];
+		int64_t difference = static_cast<int64_t>(entry.sequence.load(std::memory_order_acquire)) - static_cast<int64_t>(position);
+
+		if (difference == 0)
+		{
+			if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				return &entry;
+			}
+		}
+		else if (difference < 0)
+		{
+			return nullptr;
+		}
+		else
+		{
+			position = enqueuePosition.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+static void writeMessage(LogSeverity severity, int32_t messageId, const char* format, va_list args)
+{
+	if (!Log::isEnabled(severity))
+	{
+		return;
+	}
+
+	uint32_t repeats = messageId != 0 ? countRepeat(messageId) : 0;
+	if (repeats > Log::REPEAT_LIMIT)
+	{
+		return;
+	}
+
+	bool lastRepeat = repeats == Log::REPEAT_LIMIT;
+
+	if (!running.load(std::memory_order_acquire))
+	{
+		char text[Log::MAX_MESSAGE_LENGTH];
+		uint32_t length = formatMessage(text, format, args, lastRepeat);
+		std::fwrite(text, 1, length, getStream(severity));
+		std::fflush(getStream(severity));
+		return;
+	}
+
+	uint64_t position = 0;
+	LogEntry* entry = claimEntry(position);
+	if (entry == nullptr)
+	{
+		droppedCount.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	entry->severity = severity;
+	entry->length = formatMessage(entry->text, format, args, lastRepeat);
+	entry->sequence.store(position + 1, std::memory_order_release);
+}
+
+// Writes every published message, stopping at the first slot still being filled. Returns false if there
+// was nothing to write.
+static bool drainEntries()
+{
+	bool wroteAny = false;
+
+	for (;;)
+	{
+		LogEntry& entry = entries[dequeuePosition & (QUEUE_CAPACITY - 1)];
+		if (entry.sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+		{
+			break;
+		}
+
+		std::fwrite(entry.text, 1, entry.length, getStream(entry.severity));
+		entry.sequence.store(dequeuePosition + QUEUE_CAPACITY, std::memory_order_release);
+		dequeuePosition++;
+		wroteAny = true;
+	}
+
+	if (wroteAny)
+	{
+		std::fflush(stdout);
+		std::fflush(stderr);
+	}
+
+	return wroteAny;
+}
+
+static void writerMain()
+{
+	TRACE_THREAD_NAME("Log writer");
+
+	for (;;)
+	{
+		bool stopping = !running.load(std::memory_order_acquire);
+
+		if (!drainEntries())
+		{
+			if (stopping)
+			{
+				return;
+			}
+
+			std::this_thread::sleep_for(WRITER_IDLE_SLEEP);
+		}
+	}
+}
+
+LogSeverity parseLogSeverity(const std::string& name)
+{
+	if (name == "verbose")
+	{
+		return LogSeverity::Verbose;
+	}
+	else if (name == "info")
+	{
+		return LogSeverity::Info;
+	}
+	else if (name == "warning")
+	{
+		return LogSeverity::Warning;
+	}
+	else if (name == "error")
+	{
+		return LogSeverity::Error;
+	}
+
+	throw std::invalid_argument("Unknown log level: " + name);
+}
+
+void Log::start(LogSeverity severity)
+{
+	if (writerThread.joinable())
+	{
+		return;
+	}
+
+	minSeverity.store(static_cast<int>(severity), std::memory_order_relaxed);
+
+	if (entries == nullptr)
+	{
+		entries.reset(new LogEntry[QUEUE_CAPACITY]);
+		for (uint32_t i = 0; i < QUEUE_CAPACITY; i++)
+		{
+			entries[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	running.store(true, std::memory_order_release);
+	writerThread = std::thread(writerMain);
+}
+
+void Log::stop()
+{
+	if (!writerThread.joinable())
+	{
+		return;
+	}
+
+	running.store(false, std::memory_order_release);
+	writerThread.join();
+	drainEntries(); // Anything published after the writer's last pass.
+
+	uint64_t dropped = droppedCount.exchange(0, std::memory_order_relaxed);
+	if (dropped > 0)
+	{
+		std::fprintf(stderr, "Log: dropped %llu message(s) while the buffer was full.\n", static_cast<unsigned long long>(dropped));
+	}
+
+	for (RepeatCounter& counter : repeatCounters)
+	{
+		uint32_t count = counter.count.load(std::memory_order_relaxed);
+		if (count > REPEAT_LIMIT)
+		{
+			std::fprintf(stderr, "Log: suppressed %u repeat(s) of message 0x%08x.\n", count - REPEAT_LIMIT, static_cast<uint32_t>(counter.messageId.load(std::memory_order_relaxed)));
+		}
+	}
+
+	std::fflush(stderr);
+}
+
+bool Log::isEnabled(LogSeverity severity)
+{
+	return static_cast<int>(severity) >= minSeverity.load(std::memory_order_relaxed);
+}
+
+void Log::write(LogSeverity severity, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	writeMessage(severity, 0, format, args);
+	va_end(args);
+}
+
+void Log::writeRateLimited(LogSeverity severity, int32_t messageId, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	writeMessage(severity, messageId, format, args);
+	va_end(args);
+}
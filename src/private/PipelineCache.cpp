@@ -0,0 +1,136 @@
+#include "PipelineCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "Log.h"
+
+static std::vector<char> readCacheFile(const std::string& path)
+{
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open())
+	{
+		return {};
+	}
+
+	std::vector<char> data(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(data.data(), data.size());
+
+	if (!file)
+	{
+		return {};
+	}
+
+	return data;
+}
+
+void PipelineCache::create(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks* allocationCallbacks, const std::string& path)
+{
+	this->device = device;
+	this->allocationCallbacks = allocationCallbacks;
+	this->path = path;
+	vkGetPhysicalDeviceProperties(physicalDevice, &this->deviceProperties);
+
+	std::vector<char> data = readCacheFile(path);
+
+	if (!data.empty() && !this->validateHeader(data))
+	{
+		Log::write(LogSeverity::Info, "Discarding pipeline cache %s: created by a different device or driver.", path.c_str());
+		data.clear();
+	}
+
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	if (vkCreatePipelineCache(device, &cacheInfo, this->allocationCallbacks, &this->pipelineCache) != VK_SUCCESS)
+	{
+		// Some drivers reject data that passes the header check; fall back to an empty cache.
+		cacheInfo.initialDataSize = 0;
+		cacheInfo.pInitialData = nullptr;
+		data.clear();
+
+		if (vkCreatePipelineCache(device, &cacheInfo, this->allocationCallbacks, &this->pipelineCache) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create pipeline cache!");
+		}
+	}
+
+	this->initialSize = data.size();
+	this->warm = !data.empty();
+}
+
+bool PipelineCache::save() const
+{
+	if (this->pipelineCache == nullptr)
+	{
+		return false;
+	}
+
+	size_t size = 0;
+	if (vkGetPipelineCacheData(this->device, this->pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0)
+	{
+		return false;
+	}
+
+	std::vector<char> data(size);
+	if (vkGetPipelineCacheData(this->device, this->pipelineCache, &size, data.data()) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	std::string temporaryPath = this->path + ".tmp";
+
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!file.write(data.data(), size) || !file.flush())
+		{
+			std::remove(temporaryPath.c_str());
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, this->path, error);
+	if (error)
+	{
+		std::remove(temporaryPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void PipelineCache::destroy()
+{
+	if (this->pipelineCache != nullptr)
+	{
+		vkDestroyPipelineCache(this->device, this->pipelineCache, this->allocationCallbacks);
+		this->pipelineCache = nullptr;
+	}
+}
+
+bool PipelineCache::validateHeader(const std::vector<char>& data) const
+{
+	VkPipelineCacheHeaderVersionOne header{};
+
+	if (data.size() < sizeof(header))
+	{
+		return false;
+	}
+
+	std::memcpy(&header, data.data(), sizeof(header));
+
+	return header.headerSize >= sizeof(header)
+		&& header.headerSize <= data.size()
+		&& header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& header.vendorID == this->deviceProperties.vendorID
+		&& header.deviceID == this->deviceProperties.deviceID
+		&& std::memcmp(header.pipelineCacheUUID, this->deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
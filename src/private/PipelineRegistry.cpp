@@ -0,0 +1,576 @@
+#include "PipelineRegistry.h"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include "Log.h"
+
+static const char* getBlendModeName(BlendMode mode)
+{
+	switch (mode)
+	{
+	case BlendMode::Opaque:
+		return "opaque";
+	case BlendMode::Alpha:
+		return "alpha";
+	case BlendMode::Additive:
+		return "additive";
+	}
+
+	return "unknown";
+}
+
+static const char* getPolygonModeName(VkPolygonMode mode)
+{
+	switch (mode)
+	{
+	case VK_POLYGON_MODE_LINE:
+		return "line";
+	case VK_POLYGON_MODE_POINT:
+		return "point";
+	default:
+		return "fill";
+	}
+}
+
+static const char* getCullModeName(VkCullModeFlags mode)
+{
+	switch (mode)
+	{
+	case VK_CULL_MODE_NONE:
+		return "none";
+	case VK_CULL_MODE_FRONT_BIT:
+		return "front";
+	case VK_CULL_MODE_FRONT_AND_BACK:
+		return "both";
+	default:
+		return "back";
+	}
+}
+
+static const char* getCompareOpName(VkCompareOp op)
+{
+	switch (op)
+	{
+	case VK_COMPARE_OP_EQUAL:
+		return "equal";
+	case VK_COMPARE_OP_LESS_OR_EQUAL:
+		return "less-or-equal";
+	default:
+		return "less";
+	}
+}
+
+// Matches the layout of the VkSpecializationMapEntry table in createPipeline(). Bools are 32-bit in SPIR-V.
+struct SpecializationData
+{
+	VkBool32 useTexture;          // constant_id 0, shader.frag
+	VkBool32 useVertexColor;      // constant_id 1, shader.frag
+	VkBool32 quantizedPositions;  // constant_id 2, shader.vert
+	float positionScale;          // constant_id 3, shader.vert
+};
+
+static const std::pair<ShaderFeatureBits, const char*> shaderFeatureNames[] =
+{
+	{ SHADER_FEATURE_TEXTURE, "texture" },
+	{ SHADER_FEATURE_VERTEX_COLOR, "vertex-color" },
+	{ SHADER_FEATURE_QUANTIZED_POSITIONS, "quantized" }
+};
+
+ShaderFeatureFlags parseShaderFeatures(const std::string& text)
+{
+	ShaderFeatureFlags features = 0;
+
+	if (text == "none")
+	{
+		return features;
+	}
+
+	size_t start = 0;
+	while (start <= text.size())
+	{
+		size_t end = text.find('+', start);
+		std::string name = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+
+		bool found = false;
+		for (const auto& [bit, featureName] : shaderFeatureNames)
+		{
+			if (name == featureName)
+			{
+				features |= bit;
+				found = true;
+			}
+		}
+
+		if (!found)
+		{
+			throw std::invalid_argument("Unknown shader feature: " + name);
+		}
+
+		if (end == std::string::npos)
+		{
+			break;
+		}
+
+		start = end + 1;
+	}
+
+	return features;
+}
+
+std::string getShaderFeatureNames(ShaderFeatureFlags features)
+{
+	std::string names;
+
+	for (const auto& [bit, featureName] : shaderFeatureNames)
+	{
+		if (features & bit)
+		{
+			names += names.empty() ? "" : "+";
+			names += featureName;
+		}
+	}
+
+	return names.empty() ? "none" : names;
+}
+
+bool PipelineStateDesc::operator==(const PipelineStateDesc& other) const
+{
+	return this->shaderFeatures == other.shaderFeatures
+		&& this->blendMode == other.blendMode
+		&& this->polygonMode == other.polygonMode
+		&& this->cullMode == other.cullMode
+		&& this->depthTest == other.depthTest
+		&& this->depthWrite == other.depthWrite
+		&& this->depthCompareOp == other.depthCompareOp
+		&& this->depthOnly == other.depthOnly;
+}
+
+uint64_t PipelineStateDesc::hash() const
+{
+	// FNV-1a over the fields rather than the raw bytes, so padding never leaks into the key.
+	uint64_t hash = 14695981039346656037ull;
+	auto mix = [&hash](uint64_t value)
+	{
+		for (int i = 0; i < 8; i++)
+		{
+			hash ^= (value >> (i * 8)) & 0xff;
+			hash *= 1099511628211ull;
+		}
+	};
+
+	mix(static_cast<uint64_t>(this->shaderFeatures));
+	mix(static_cast<uint64_t>(this->blendMode));
+	mix(static_cast<uint64_t>(this->polygonMode));
+	mix(static_cast<uint64_t>(this->cullMode));
+	mix(this->depthTest ? 1 : 0);
+	mix(this->depthWrite ? 1 : 0);
+	mix(static_cast<uint64_t>(this->depthCompareOp));
+	mix(this->depthOnly ? 1 : 0);
+
+	return hash;
+}
+
+std::string PipelineStateDesc::toString() const
+{
+	std::ostringstream stream;
+	stream << "features=" << getShaderFeatureNames(this->shaderFeatures)
+		<< " blend=" << getBlendModeName(this->blendMode)
+		<< " polygon=" << getPolygonModeName(this->polygonMode)
+		<< " cull=" << getCullModeName(this->cullMode)
+		<< " depth-test=" << (this->depthTest ? 1 : 0)
+		<< " depth-write=" << (this->depthWrite ? 1 : 0)
+		<< " depth-compare=" << getCompareOpName(this->depthCompareOp)
+		<< " depth-only=" << (this->depthOnly ? 1 : 0);
+	return stream.str();
+}
+
+PipelineStateDesc PipelineStateDesc::parse(const std::string& text)
+{
+	PipelineStateDesc desc{};
+	std::istringstream stream(text);
+	std::string token;
+
+	while (stream >> token)
+	{
+		size_t separator = token.find('=');
+		if (separator == std::string::npos)
+		{
+			throw std::invalid_argument("Expected key=value in pipeline state: " + token);
+		}
+
+		std::string key = token.substr(0, separator);
+		std::string value = token.substr(separator + 1);
+
+		bool parsed = false;
+
+		if (key == "features")
+		{
+			desc.shaderFeatures = parseShaderFeatures(value);
+			parsed = true;
+		}
+		else if (key == "blend")
+		{
+			for (BlendMode mode : { BlendMode::Opaque, BlendMode::Alpha, BlendMode::Additive })
+			{
+				if (value == getBlendModeName(mode))
+				{
+					desc.blendMode = mode;
+					parsed = true;
+				}
+			}
+		}
+		else if (key == "polygon")
+		{
+			for (VkPolygonMode mode : { VK_POLYGON_MODE_FILL, VK_POLYGON_MODE_LINE, VK_POLYGON_MODE_POINT })
+			{
+				if (value == getPolygonModeName(mode))
+				{
+					desc.polygonMode = mode;
+					parsed = true;
+				}
+			}
+		}
+		else if (key == "cull")
+		{
+			for (VkCullModeFlags mode : { VK_CULL_MODE_NONE, VK_CULL_MODE_FRONT_BIT, VK_CULL_MODE_BACK_BIT, VK_CULL_MODE_FRONT_AND_BACK })
+			{
+				if (value == getCullModeName(mode))
+				{
+					desc.cullMode = mode;
+					parsed = true;
+				}
+			}
+		}
+		else if (key == "depth-test" || key == "depth-write" || key == "depth-only")
+		{
+			bool& field = key == "depth-test" ? desc.depthTest : key == "depth-write" ? desc.depthWrite : desc.depthOnly;
+			parsed = value == "0" || value == "1";
+			field = value == "1";
+		}
+		else if (key == "depth-compare")
+		{
+			for (VkCompareOp op : { VK_COMPARE_OP_LESS, VK_COMPARE_OP_EQUAL, VK_COMPARE_OP_LESS_OR_EQUAL })
+			{
+				if (value == getCompareOpName(op))
+				{
+					desc.depthCompareOp = op;
+					parsed = true;
+				}
+			}
+		}
+
+		if (!parsed)
+		{
+			throw std::invalid_argument("Unknown pipeline state: " + token);
+		}
+	}
+
+	return desc;
+}
+
+void PipelineRegistry::create(const PipelineRegistryContext& context, JobSystem& jobSystem, const PipelineStateDesc& fallbackDesc)
+{
+	this->context = context;
+	this->jobSystem = &jobSystem;
+	this->fallbackPipeline = this->createPipeline(fallbackDesc);
+
+	if (this->fallbackPipeline == nullptr)
+	{
+		throw std::runtime_error("Failed to create graphics pipeline!");
+	}
+
+	auto entry = std::make_unique<Entry>();
+	entry->desc = fallbackDesc;
+	entry->pipeline = this->fallbackPipeline;
+	entry->state = EntryState::Ready;
+	this->entries.emplace(fallbackDesc, std::move(entry));
+}
+
+void PipelineRegistry::destroy()
+{
+	if (this->jobSystem != nullptr)
+	{
+		this->jobSystem->wait(this->pendingCompiles);
+	}
+
+	for (auto& [desc, entry] : this->entries)
+	{
+		VkPipeline pipeline = entry->pipeline.load();
+		if (pipeline != nullptr)
+		{
+			vkDestroyPipeline(this->context.device, pipeline, this->context.allocationCallbacks);
+		}
+	}
+
+	this->entries.clear();
+	this->fallbackPipeline = nullptr;
+	this->jobSystem = nullptr;
+}
+
+VkPipeline PipelineRegistry::get(const PipelineStateDesc& desc)
+{
+	Entry& entry = this->findOrQueue(desc);
+
+	if (entry.state.load(std::memory_order_acquire) == EntryState::Ready)
+	{
+		return entry.pipeline.load(std::memory_order_relaxed);
+	}
+
+	return this->fallbackPipeline;
+}
+
+void PipelineRegistry::request(const PipelineStateDesc& desc)
+{
+	this->findOrQueue(desc);
+}
+
+size_t PipelineRegistry::loadManifest(const std::string& path)
+{
+	std::ifstream file(path);
+
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open pipeline manifest " + path);
+	}
+
+	size_t count = 0;
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		size_t start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#')
+		{
+			continue;
+		}
+
+		this->request(PipelineStateDesc::parse(line));
+		count++;
+	}
+
+	return count;
+}
+
+bool PipelineRegistry::isReady(const PipelineStateDesc& desc)
+{
+	std::lock_guard<std::mutex> lock(this->entriesMutex);
+
+	auto it = this->entries.find(desc);
+	return it != this->entries.end() && it->second->state.load(std::memory_order_acquire) == EntryState::Ready;
+}
+
+PipelineRegistry::Entry& PipelineRegistry::findOrQueue(const PipelineStateDesc& desc)
+{
+	std::lock_guard<std::mutex> lock(this->entriesMutex);
+
+	auto it = this->entries.find(desc);
+	if (it != this->entries.end())
+	{
+		return *it->second;
+	}
+
+	// Entries are heap-allocated so the job and the returned reference survive rehashing.
+	Entry& entry = *this->entries.emplace(desc, std::make_unique<Entry>()).first->second;
+	entry.desc = desc;
+	entry.job.function = [this, &entry](uint32_t) { this->compile(entry); };
+	entry.job.counter = &this->pendingCompiles;
+
+	this->pendingCompiles.pending.fetch_add(1, std::memory_order_acq_rel);
+	this->jobSystem->submitBackground(&entry.job);
+
+	return entry;
+}
+
+void PipelineRegistry::compile(Entry& entry)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	VkPipeline pipeline = this->createPipeline(entry.desc);
+	auto endTime = std::chrono::high_resolution_clock::now();
+
+	if (pipeline == nullptr)
+	{
+		entry.state.store(EntryState::Failed, std::memory_order_release);
+		Log::write(LogSeverity::Warning, "Failed to compile pipeline (%s), using the fallback.", entry.desc.toString().c_str());
+		return;
+	}
+
+	entry.pipeline.store(pipeline, std::memory_order_relaxed);
+	entry.state.store(EntryState::Ready, std::memory_order_release);
+	this->readyGeneration.fetch_add(1, std::memory_order_acq_rel);
+
+	if (Log::isEnabled(LogSeverity::Info))
+	{
+		Log::write(LogSeverity::Info, "Compiled pipeline (%s) in %.3f ms", entry.desc.toString().c_str(),
+			std::chrono::duration<double, std::milli>(endTime - startTime).count());
+	}
+}
+
+VkPipeline PipelineRegistry::createPipeline(const PipelineStateDesc& desc) const
+{
+	if (desc.polygonMode != VK_POLYGON_MODE_FILL && !this->context.fillModeNonSolid)
+	{
+		return nullptr;
+	}
+
+	bool quantizedPositions = (desc.shaderFeatures & SHADER_FEATURE_QUANTIZED_POSITIONS) != 0;
+
+	SpecializationData specializationData{};
+	specializationData.useTexture = (desc.shaderFeatures & SHADER_FEATURE_TEXTURE) ? VK_TRUE : VK_FALSE;
+	specializationData.useVertexColor = (desc.shaderFeatures & SHADER_FEATURE_VERTEX_COLOR) ? VK_TRUE : VK_FALSE;
+	specializationData.quantizedPositions = quantizedPositions ? VK_TRUE : VK_FALSE;
+	specializationData.positionScale = this->context.positionScale;
+
+	// Both stages share one table; entries for constants a stage does not declare are ignored.
+	VkSpecializationMapEntry specializationEntries[] =
+	{
+		{ 0, offsetof(SpecializationData, useTexture), sizeof(VkBool32) },
+		{ 1, offsetof(SpecializationData, useVertexColor), sizeof(VkBool32) },
+		{ 2, offsetof(SpecializationData, quantizedPositions), sizeof(VkBool32) },
+		{ 3, offsetof(SpecializationData, positionScale), sizeof(float) }
+	};
+
+	VkSpecializationInfo specializationInfo{};
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(std::size(specializationEntries));
+	specializationInfo.pMapEntries = specializationEntries;
+	specializationInfo.dataSize = sizeof(specializationData);
+	specializationInfo.pData = &specializationData;
+
+	std::vector<VkPipelineShaderStageCreateInfo> shaderStages{};
+	for (const auto& stage : this->context.shaderStages)
+	{
+		// A depth-only pipeline has no fragment shader; depth comes straight from rasterization.
+		if (desc.depthOnly && stage.stage != VK_SHADER_STAGE_VERTEX_BIT)
+		{
+			continue;
+		}
+
+		shaderStages.push_back(stage);
+		shaderStages.back().pSpecializationInfo = &specializationInfo;
+	}
+
+	std::vector<VkVertexInputBindingDescription> vertexBindings = { this->context.vertexBinding };
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes = this->context.vertexAttributes;
+
+	if (quantizedPositions)
+	{
+		vertexBindings.push_back(this->context.quantizedPositionBinding);
+
+		for (auto& attribute : vertexAttributes)
+		{
+			if (attribute.location == this->context.quantizedPositionAttribute.location)
+			{
+				attribute = this->context.quantizedPositionAttribute;
+			}
+		}
+	}
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexBindings.size());
+	vertexInputInfo.pVertexBindingDescriptions = vertexBindings.data();
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexAttributes.size());
+	vertexInputInfo.pVertexAttributeDescriptions = vertexAttributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	// Viewport and scissor are dynamic, so pipelines survive swapchain resizes.
+	std::vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicState.pDynamicStates = dynamicStates.data();
+
+	VkPipelineViewportStateCreateInfo viewportState{};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = desc.polygonMode;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = desc.cullMode;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.depthBiasEnable = VK_FALSE;
+
+	VkPipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = desc.depthOnly ? VK_FALSE : VK_TRUE;
+	multisampling.minSampleShading = 1.0f; // min fraction for sample shading; closer to one is smoother
+	multisampling.rasterizationSamples = this->context.samples;
+	multisampling.alphaToCoverageEnable = VK_FALSE;
+	multisampling.alphaToOneEnable = VK_FALSE;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask = desc.depthOnly ? 0 : VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = desc.blendMode != BlendMode::Opaque && !desc.depthOnly ? VK_TRUE : VK_FALSE;
+	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	colorBlendAttachment.dstColorBlendFactor = desc.blendMode == BlendMode::Additive ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending{};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = desc.depthTest ? VK_TRUE : VK_FALSE;
+	depthStencil.depthWriteEnable = desc.depthWrite ? VK_TRUE : VK_FALSE;
+	depthStencil.depthCompareOp = desc.depthCompareOp;
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.minDepthBounds = 0.0f;
+	depthStencil.maxDepthBounds = 1.0f;
+	depthStencil.stencilTestEnable = VK_FALSE;
+
+	// Without a render pass the attachment formats are declared on the pipeline instead (VK_KHR_dynamic_rendering).
+	VkPipelineRenderingCreateInfoKHR renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachmentFormats = &this->context.colorFormat;
+	renderingInfo.depthAttachmentFormat = this->context.depthFormat;
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext = this->context.renderPass == nullptr ? &renderingInfo : nullptr;
+	pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+	pipelineInfo.pStages = shaderStages.data();
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = this->context.pipelineLayout;
+	pipelineInfo.renderPass = this->context.renderPass;
+	pipelineInfo.subpass = 0;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	// The pipeline cache is internally synchronized, so background compiles can share it.
+	VkPipeline pipeline = nullptr;
+	if (vkCreateGraphicsPipelines(this->context.device, this->context.pipelineCache, 1, &pipelineInfo, this->context.allocationCallbacks, &pipeline) != VK_SUCCESS)
+	{
+		return nullptr;
+	}
+
+	return pipeline;
+}
@@ -0,0 +1,86 @@
+#include "ResolutionController.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// Scaling down aims this far below the budget so the next frame isn't right at the edge again.
+static const double TARGET_FRACTION = 0.9;
+
+// Scaling up requires the average to be this far below the budget, leaving room for the larger frame.
+static const double UPSCALE_FRACTION = 0.75;
+
+// Consecutive cheap frames required before each step up.
+static const uint32_t UPSCALE_FRAMES = 30;
+
+// Weight of the newest sample in the moving average.
+static const double AVERAGE_WEIGHT = 0.1;
+
+void ResolutionController::configure(double budgetMilliseconds, double minScale, double maxScale)
+{
+	if (budgetMilliseconds <= 0.0 || minScale <= 0.0 || minScale > maxScale || maxScale > 1.0)
+	{
+		throw std::invalid_argument("Invalid dynamic resolution configuration!");
+	}
+
+	this->budgetMilliseconds = budgetMilliseconds;
+	this->minScale = minScale;
+	this->maxScale = maxScale;
+	this->scale = maxScale;
+	this->averageGpuMilliseconds = 0.0;
+	this->cheapFrames = 0;
+	this->firstFrameAtScale = 0;
+	this->changeCount = 0;
+}
+
+bool ResolutionController::update(uint64_t frame, double gpuMilliseconds, uint64_t currentFrame)
+{
+	if (gpuMilliseconds < 0.0 || frame < this->firstFrameAtScale)
+	{
+		return false;
+	}
+
+	double previousScale = this->scale;
+
+	if (gpuMilliseconds > this->budgetMilliseconds)
+	{
+		// GPU cost is roughly proportional to the pixel count, i.e. the square of the scale.
+		double target = this->scale * std::sqrt(this->budgetMilliseconds * TARGET_FRACTION / gpuMilliseconds);
+		this->setScale(std::floor(target / SCALE_STEP) * SCALE_STEP, currentFrame);
+		return this->scale != previousScale;
+	}
+
+	this->averageGpuMilliseconds = this->averageGpuMilliseconds == 0.0 ? gpuMilliseconds
+		: this->averageGpuMilliseconds + (gpuMilliseconds - this->averageGpuMilliseconds) * AVERAGE_WEIGHT;
+
+	if (this->averageGpuMilliseconds < this->budgetMilliseconds * UPSCALE_FRACTION)
+	{
+		if (++this->cheapFrames >= UPSCALE_FRAMES)
+		{
+			this->setScale(this->scale + SCALE_STEP, currentFrame);
+		}
+	}
+	else
+	{
+		this->cheapFrames = 0;
+	}
+
+	return this->scale != previousScale;
+}
+
+void ResolutionController::setScale(double newScale, uint64_t currentFrame)
+{
+	newScale = std::clamp(newScale, this->minScale, this->maxScale);
+
+	if (std::abs(newScale - this->scale) < SCALE_STEP * 0.5)
+	{
+		this->cheapFrames = 0;
+		return;
+	}
+
+	this->scale = newScale;
+	this->averageGpuMilliseconds = 0.0;
+	this->cheapFrames = 0;
+	this->firstFrameAtScale = currentFrame;
+	this->changeCount++;
+}
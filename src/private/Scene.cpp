@@ -0,0 +1,216 @@
+#include "Scene.h"
+
+#include <atomic>
+#include <stdexcept>
+
+#include "JobSystem.h"
+
+static const uint32_t INVALID_INDEX = UINT32_MAX;
+
+Entity Scene::create(const TransformComponent& transform, const MeshComponent& mesh, const MaterialComponent& material, const BoundsComponent& bounds)
+{
+	Entity entity{};
+
+	if (!this->freeIndices.empty())
+	{
+		entity.index = this->freeIndices.back();
+		this->freeIndices.pop_back();
+	}
+	else
+	{
+		entity.index = static_cast<uint32_t>(this->sparse.size());
+		this->sparse.push_back(INVALID_INDEX);
+		this->generations.push_back(0);
+	}
+
+	entity.generation = this->generations[entity.index];
+	this->sparse[entity.index] = static_cast<uint32_t>(this->entities.size());
+
+	this->entities.push_back(entity);
+	this->transforms.push_back(transform);
+	this->meshes.push_back(mesh);
+	this->materials.push_back(material);
+	this->bounds.push_back(bounds);
+	this->visibility.push_back(1);
+	this->visibleCount++;
+	this->transformVersion++;
+
+	return entity;
+}
+
+void Scene::destroy(Entity entity)
+{
+	if (!this->isAlive(entity))
+	{
+		throw std::invalid_argument("Destroying an entity that is not alive!");
+	}
+
+	uint32_t denseIndex = this->sparse[entity.index];
+	uint32_t lastIndex = static_cast<uint32_t>(this->entities.size() - 1);
+
+	this->visibleCount -= this->visibility[denseIndex];
+
+	// Fill the hole with the last entity so the arrays stay contiguous.
+	if (denseIndex != lastIndex)
+	{
+		Entity moved = this->entities[lastIndex];
+
+		this->entities[denseIndex] = moved;
+		this->transforms[denseIndex] = this->transforms[lastIndex];
+		this->meshes[denseIndex] = this->meshes[lastIndex];
+		this->materials[denseIndex] = this->materials[lastIndex];
+		this->bounds[denseIndex] = this->bounds[lastIndex];
+		this->visibility[denseIndex] = this->visibility[lastIndex];
+		this->sparse[moved.index] = denseIndex;
+	}
+
+	this->entities.pop_back();
+	this->transforms.pop_back();
+	this->meshes.pop_back();
+	this->materials.pop_back();
+	this->bounds.pop_back();
+	this->visibility.pop_back();
+
+	this->sparse[entity.index] = INVALID_INDEX;
+	this->generations[entity.index]++;
+	this->freeIndices.push_back(entity.index);
+	this->transformVersion++;
+}
+
+void Scene::clear()
+{
+	for (const Entity& entity : this->entities)
+	{
+		this->sparse[entity.index] = INVALID_INDEX;
+		this->generations[entity.index]++;
+		this->freeIndices.push_back(entity.index);
+	}
+
+	this->entities.clear();
+	this->transforms.clear();
+	this->meshes.clear();
+	this->materials.clear();
+	this->bounds.clear();
+	this->visibility.clear();
+	this->visibleCount = 0;
+	this->transformVersion++;
+}
+
+bool Scene::isAlive(Entity entity) const
+{
+	return entity.index < this->sparse.size() && this->sparse[entity.index] != INVALID_INDEX && this->generations[entity.index] == entity.generation;
+}
+
+uint32_t Scene::getDenseIndex(Entity entity) const
+{
+	if (!this->isAlive(entity))
+	{
+		throw std::invalid_argument("Entity is not alive!");
+	}
+
+	return this->sparse[entity.index];
+}
+
+void Scene::setTransform(Entity entity, const TransformComponent& transform)
+{
+	this->transforms[this->getDenseIndex(entity)] = transform;
+	this->transformVersion++;
+}
+
+void Scene::forEach(JobSystem* jobSystem, const std::function<void(size_t begin, size_t end)>& body) const
+{
+	size_t count = this->entities.size();
+
+	if (jobSystem == nullptr || count <= SYSTEM_GRAIN_SIZE)
+	{
+		if (count > 0)
+		{
+			body(0, count);
+		}
+
+		return;
+	}
+
+	jobSystem->parallelFor(count, SYSTEM_GRAIN_SIZE, [&body](size_t begin, size_t end, uint32_t workerIndex)
+	{
+		body(begin, end);
+	});
+}
+
+bool Scene::updateVisibility(const glm::mat4& modelViewProj, JobSystem* jobSystem)
+{
+	// Frustum planes in the root's model space, extracted from the rows of the combined matrix (Vulkan's
+	// [0, 1] depth); the same test cull.comp runs on the GPU.
+	const glm::mat4& m = modelViewProj;
+	glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+	const glm::vec4 planes[6] = { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row2, row3 - row2 };
+
+	float planeLengths[6];
+	for (int i = 0; i < 6; i++)
+	{
+		planeLengths[i] = glm::length(glm::vec3(planes[i]));
+	}
+
+	std::atomic<size_t> visibleCount{ 0 };
+	std::atomic<bool> changed{ false };
+
+	this->forEach(jobSystem, [&](size_t begin, size_t end)
+	{
+		size_t rangeVisible = 0;
+		bool rangeChanged = false;
+
+		for (size_t i = begin; i < end; i++)
+		{
+			const TransformComponent& transform = this->transforms[i];
+			const glm::vec4& sphere = this->bounds[i].sphere;
+
+			glm::vec3 center = transform.position + transform.rotation * (glm::vec3(sphere) * transform.scale);
+			float radius = sphere.w * transform.scale;
+
+			uint8_t visible = 1;
+			for (int plane = 0; plane < 6; plane++)
+			{
+				if (glm::dot(glm::vec3(planes[plane]), center) + planes[plane].w < -radius * planeLengths[plane])
+				{
+					visible = 0;
+					break;
+				}
+			}
+
+			rangeChanged |= this->visibility[i] != visible;
+			this->visibility[i] = visible;
+			rangeVisible += visible;
+		}
+
+		visibleCount.fetch_add(rangeVisible, std::memory_order_relaxed);
+		if (rangeChanged)
+		{
+			changed.store(true, std::memory_order_relaxed);
+		}
+	});
+
+	this->visibleCount = visibleCount.load(std::memory_order_relaxed);
+	return changed.load(std::memory_order_relaxed);
+}
+
+void Scene::writeModelMatrices(glm::mat4* matrices, JobSystem* jobSystem) const
+{
+	this->forEach(jobSystem, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const TransformComponent& transform = this->transforms[i];
+
+			// Translation * rotation * uniform scale; the same placement updateVisibility() gives the bounds.
+			glm::mat4 matrix = glm::mat4_cast(transform.rotation);
+			matrix[0] *= transform.scale;
+			matrix[1] *= transform.scale;
+			matrix[2] *= transform.scale;
+			matrix[3] = glm::vec4(transform.position, 1.0f);
+			matrices[i] = matrix;
+		}
+	});
+}
@@ -0,0 +1,133 @@
+#include "ShaderLibrary.h"
+
+#include <fstream>
+#include <stdexcept>
+
+#include "Log.h"
+
+// Generated by src/shaders/compile.bat and compile.sh (glslc -mfmt=num).
+static constexpr uint32_t VERTEX_SHADER_CODE[] =
+{
+#include "../shaders/vert.spv.inc"
+};
+
+static constexpr uint32_t FRAGMENT_SHADER_CODE[] =
+{
+#include "../shaders/frag.spv.inc"
+};
+
+static constexpr uint32_t CULL_SHADER_CODE[] =
+{
+#include "../shaders/cull.spv.inc"
+};
+
+static constexpr uint32_t CULL_OCCLUSION_SHADER_CODE[] =
+{
+#include "../shaders/cull_occlusion.spv.inc"
+};
+
+static constexpr uint32_t DEPTH_PYRAMID_SHADER_CODE[] =
+{
+#include "../shaders/hiz.spv.inc"
+};
+
+static constexpr uint32_t DEPTH_PYRAMID_MULTISAMPLED_SHADER_CODE[] =
+{
+#include "../shaders/hiz_ms.spv.inc"
+};
+
+static bool readOverrideFile(const std::string& path, std::vector<uint32_t>& words)
+{
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	if (fileSize == 0 || fileSize % sizeof(uint32_t) != 0)
+	{
+		throw std::runtime_error("Invalid SPIR-V file " + path);
+	}
+
+	words.resize(fileSize / sizeof(uint32_t));
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(words.data()), fileSize);
+
+	return static_cast<bool>(file);
+}
+
+ShaderLibrary::ShaderLibrary(const std::string& overrideDirectory)
+	: overrideDirectory(overrideDirectory)
+{
+}
+
+ShaderBinary ShaderLibrary::loadShader(ShaderId id) const
+{
+	ShaderBinary binary{};
+
+	if (!this->overrideDirectory.empty())
+	{
+		std::string path = this->overrideDirectory + "/" + getFileName(id);
+
+		if (readOverrideFile(path, binary.storage))
+		{
+			Log::write(LogSeverity::Info, "Loaded shader override %s", path.c_str());
+			binary.code = binary.storage.data();
+			binary.size = binary.storage.size() * sizeof(uint32_t);
+			return binary;
+		}
+	}
+
+	switch (id)
+	{
+	case ShaderId::Vertex:
+		binary.code = VERTEX_SHADER_CODE;
+		binary.size = sizeof(VERTEX_SHADER_CODE);
+		break;
+	case ShaderId::Fragment:
+		binary.code = FRAGMENT_SHADER_CODE;
+		binary.size = sizeof(FRAGMENT_SHADER_CODE);
+		break;
+	case ShaderId::Cull:
+		binary.code = CULL_SHADER_CODE;
+		binary.size = sizeof(CULL_SHADER_CODE);
+		break;
+	case ShaderId::CullOcclusion:
+		binary.code = CULL_OCCLUSION_SHADER_CODE;
+		binary.size = sizeof(CULL_OCCLUSION_SHADER_CODE);
+		break;
+	case ShaderId::DepthPyramid:
+		binary.code = DEPTH_PYRAMID_SHADER_CODE;
+		binary.size = sizeof(DEPTH_PYRAMID_SHADER_CODE);
+		break;
+	case ShaderId::DepthPyramidMultisampled:
+		binary.code = DEPTH_PYRAMID_MULTISAMPLED_SHADER_CODE;
+		binary.size = sizeof(DEPTH_PYRAMID_MULTISAMPLED_SHADER_CODE);
+		break;
+	}
+
+	return binary;
+}
+
+const char* ShaderLibrary::getFileName(ShaderId id)
+{
+	switch (id)
+	{
+	case ShaderId::Vertex:
+		return "vert.spv";
+	case ShaderId::Fragment:
+		return "frag.spv";
+	case ShaderId::Cull:
+		return "cull.spv";
+	case ShaderId::CullOcclusion:
+		return "cull_occlusion.spv";
+	case ShaderId::DepthPyramid:
+		return "hiz.spv";
+	case ShaderId::DepthPyramidMultisampled:
+		return "hiz_ms.spv";
+	}
+
+	return "";
+}
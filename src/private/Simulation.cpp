@@ -0,0 +1,126 @@
+#include "Simulation.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "Trace.h"
+
+// Rotation speed of the model around its Z axis.
+static const float ANGULAR_VELOCITY_RADIANS = glm::radians(90.0f);
+
+SimulationThread::~SimulationThread()
+{
+	this->stop();
+}
+
+void SimulationThread::start(double ticksPerSecond, double extraTickMilliseconds)
+{
+	if (ticksPerSecond <= 0.0)
+	{
+		throw std::invalid_argument("Simulation rate must be greater than zero!");
+	}
+
+	this->tickDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / ticksPerSecond));
+	this->extraTickMilliseconds = extraTickMilliseconds;
+
+	// Seed the reader with a valid snapshot so frames rendered before the first tick have a transform.
+	SimulationSnapshot& initial = this->snapshots.getWriteBuffer();
+	initial = SimulationSnapshot{};
+	initial.tickTime = Clock::now();
+	this->snapshots.publish();
+
+	this->running = true;
+	this->thread = std::thread(&SimulationThread::threadMain, this);
+}
+
+void SimulationThread::stop()
+{
+	this->running = false;
+
+	if (this->thread.joinable())
+	{
+		this->thread.join();
+	}
+}
+
+TransformState SimulationThread::sample(Clock::time_point time)
+{
+	this->snapshots.update();
+	const SimulationSnapshot& snapshot = this->snapshots.getReadBuffer();
+
+	// Render one tick behind: at tickTime we show previous, one tick later we reach current.
+	float alpha = 1.0f;
+	if (this->tickDuration.count() > 0)
+	{
+		alpha = static_cast<float>(std::chrono::duration<double>(time - snapshot.tickTime).count() / std::chrono::duration<double>(this->tickDuration).count());
+		alpha = std::clamp(alpha, 0.0f, 1.0f);
+	}
+
+	TransformState state{};
+	state.position = glm::mix(snapshot.previous.position, snapshot.current.position, alpha);
+	state.rotation = glm::slerp(snapshot.previous.rotation, snapshot.current.rotation, alpha);
+	return state;
+}
+
+void SimulationThread::threadMain()
+{
+	TRACE_THREAD_NAME("Simulation");
+
+	double tickSeconds = std::chrono::duration<double>(this->tickDuration).count();
+	TransformState state{};
+	uint64_t tick = 0;
+	Clock::time_point nextTick = Clock::now() + this->tickDuration;
+
+	while (this->running)
+	{
+		std::this_thread::sleep_until(nextTick);
+
+		Clock::time_point now = Clock::now();
+		uint32_t steps = 0;
+
+		while (nextTick <= now && steps < MAX_CATCH_UP_TICKS)
+		{
+			TRACE_SCOPE("Simulation tick");
+			TransformState previous = state;
+			state = step(state, ++tick, tickSeconds);
+
+			if (this->extraTickMilliseconds > 0.0)
+			{
+				Clock::time_point busyUntil = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(this->extraTickMilliseconds));
+				while (Clock::now() < busyUntil)
+				{
+				}
+			}
+
+			SimulationSnapshot& snapshot = this->snapshots.getWriteBuffer();
+			snapshot.tick = tick;
+			snapshot.tickTime = nextTick;
+			snapshot.previous = previous;
+			snapshot.current = state;
+			this->snapshots.publish();
+
+			this->tickCount.store(tick, std::memory_order_relaxed);
+			nextTick += this->tickDuration;
+			steps++;
+		}
+
+		// Too far behind to catch up: skip the missed ticks and resynchronise with real time.
+		if (nextTick <= now)
+		{
+			uint64_t missed = static_cast<uint64_t>((now - nextTick) / this->tickDuration) + 1;
+			this->droppedTickCount.fetch_add(missed, std::memory_order_relaxed);
+			nextTick += this->tickDuration * missed;
+		}
+	}
+}
+
+TransformState SimulationThread::step(const TransformState& state, uint64_t tick, double tickSeconds)
+{
+	TransformState next = state;
+
+	// Derive the angle from the tick count rather than accumulating deltas so the rotation never drifts.
+	float angle = static_cast<float>(static_cast<double>(tick) * tickSeconds) * ANGULAR_VELOCITY_RADIANS;
+	next.rotation = glm::angleAxis(angle, glm::vec3(0.0f, 0.0f, 1.0f));
+
+	return next;
+}
@@ -0,0 +1,159 @@
+#include "Trace.h"
+
+#ifdef ENABLE_TRACING
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Zones each thread can record; later zones are counted and dropped rather than growing the buffer.
+static const uint32_t THREAD_BUFFER_CAPACITY = 1 << 16;
+
+struct TraceEvent
+{
+	const char* name;
+	uint64_t start;
+	uint64_t end;
+};
+
+// Written only by its own thread. count is published with release ordering, so the writer of the trace
+// sees every event below it. Naming a thread only registers this small slot; the events are allocated by
+// the thread's first zone, so threads that never record while tracing is on never pay for them.
+struct ThreadBuffer
+{
+	uint32_t threadId = 0;
+	std::string threadName{};
+	std::unique_ptr<TraceEvent[]> events{};
+	std::atomic<uint32_t> count{ 0 };
+	std::atomic<uint64_t> dropped{ 0 };
+};
+
+// Buffers are owned here rather than by their threads, so zones survive a thread exiting before the dump.
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+static std::atomic<bool> recording{ false };
+static thread_local ThreadBuffer* currentBuffer = nullptr;
+
+static ThreadBuffer& getThreadBuffer()
+{
+	if (currentBuffer == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		threadBuffers.push_back(std::make_unique<ThreadBuffer>());
+		currentBuffer = threadBuffers.back().get();
+		currentBuffer->threadId = static_cast<uint32_t>(threadBuffers.size());
+	}
+
+	return *currentBuffer;
+}
+
+static void writeEscaped(std::ofstream& file, const std::string& text)
+{
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			file << '\\';
+		}
+
+		file << c;
+	}
+}
+
+uint64_t Trace::now()
+{
+	static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	// Never 0, which TraceZone uses for "not recording".
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count() + 1;
+}
+
+void Trace::start()
+{
+	Trace::now(); // Pin the epoch before the first zone.
+	recording.store(true, std::memory_order_relaxed);
+}
+
+bool Trace::isRecording()
+{
+	return recording.load(std::memory_order_relaxed);
+}
+
+void Trace::setThreadName(const std::string& name)
+{
+	ThreadBuffer& buffer = getThreadBuffer();
+	std::lock_guard<std::mutex> lock(registryMutex);
+	buffer.threadName = name;
+}
+
+void Trace::recordZone(const char* name, uint64_t startNanoseconds, uint64_t endNanoseconds)
+{
+	ThreadBuffer& buffer = getThreadBuffer();
+	uint32_t index = buffer.count.load(std::memory_order_relaxed);
+
+	if (!buffer.events)
+	{
+		buffer.events.reset(new TraceEvent[THREAD_BUFFER_CAPACITY]);
+	}
+
+	if (index >= THREAD_BUFFER_CAPACITY)
+	{
+		buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	buffer.events[index] = { name, startNanoseconds, endNanoseconds };
+	buffer.count.store(index + 1, std::memory_order_release);
+}
+
+bool Trace::writeChromeTrace(const std::string& path)
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	file << std::fixed << std::setprecision(3);
+
+	// Complete ("X") events in microseconds, plus a metadata event naming each thread.
+	file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	bool first = true;
+
+	for (const auto& buffer : threadBuffers)
+	{
+		if (!buffer->threadName.empty())
+		{
+			file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"args\":{\"name\":\"";
+			writeEscaped(file, buffer->threadName);
+			file << "\"}}";
+			first = false;
+		}
+
+		uint32_t count = buffer->count.load(std::memory_order_acquire);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const TraceEvent& event = buffer->events[i];
+			file << (first ? "" : ",\n") << "{\"name\":\"";
+			writeEscaped(file, event.name);
+			file << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+			first = false;
+		}
+
+		uint64_t dropped = buffer->dropped.load(std::memory_order_relaxed);
+		if (dropped > 0)
+		{
+			file << (first ? "" : ",\n") << "{\"name\":\"" << dropped << " zone(s) dropped\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"ts\":0}";
+			first = false;
+		}
+	}
+
+	file << "\n]}\n";
+	return static_cast<bool>(file);
+}
+
+#endif
@@ -20,25 +20,57 @@
 #include <stdexcept>
 #include <cstdlib>
 #include <vector>
-#include <map>
 #include <unordered_map>
 #include <optional>
 #include <set>
 #include <limits>
 #include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <string>
+#include <thread>
+#include <deque>
+#include <sstream>
+
+#include "Benchmark.h"
+#include "DeviceSelector.h"
+#include "FrameScheduler.h"
+#include "FramePacer.h"
+#include "GpuProfiler.h"
+#include "HostAllocator.h"
+#include "JobSystem.h"
+#include "Log.h"
+#include "Simulation.h"
+#include "PipelineCache.h"
+#include "PipelineRegistry.h"
+#include "ResolutionController.h"
+#include "Scene.h"
+#include "ShaderLibrary.h"
+#include "Trace.h"
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
+// Offscreen color format with --headless: the surface format the windowed path prefers, and one every
+// device must support as a color attachment and blit destination.
+const VkFormat HEADLESS_COLOR_FORMAT = VK_FORMAT_B8G8R8A8_SRGB;
+
 const std::string MODEL_PATH = "src/mesh/viking_room.obj";
 const std::string TEXTURE_PATH = "src/textures/viking_room.png";
 
-const int MAX_FRAMES_IN_FLIGHT = 2;
+const uint32_t CULL_WORKGROUP_SIZE = 64; // local_size_x in cull.comp
+const uint32_t HIZ_MAX_LEVELS = 13; // MAX_LEVELS in hiz.comp: down to 1x1 for depth buffers up to 8192 texels wide
+const uint32_t HIZ_TILE_SIZE = 32; // Level 0 texels reduced by one hiz.comp workgroup, per axis.
 
 const std::vector<const char*> validationLayers = { "VK_LAYER_KHRONOS_validation" };
 const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
+// Enabled when available: precise present timing for the latency modes.
+const std::vector<const char*> presentWaitExtensions = { VK_KHR_PRESENT_ID_EXTENSION_NAME, VK_KHR_PRESENT_WAIT_EXTENSION_NAME };
+
+// Enabled with --dynamic-rendering. Its dependencies (depth_stencil_resolve, create_renderpass2) are core in 1.2.
+const std::vector<const char*> dynamicRenderingExtensions = { VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME };
+
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
 #else
@@ -128,6 +160,36 @@ struct Vertex
 	}
 };
 
+// 16-bit SNORM position for the quantized position stream; w is padding to keep the attribute 8-byte aligned.
+struct QuantizedPosition
+{
+	int16_t x;
+	int16_t y;
+	int16_t z;
+	int16_t w;
+
+	static VkVertexInputBindingDescription getBindingDescription()
+	{
+		VkVertexInputBindingDescription bindingDescription{};
+		bindingDescription.binding = 1;
+		bindingDescription.stride = sizeof(QuantizedPosition);
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		return bindingDescription;
+	}
+
+	static VkVertexInputAttributeDescription getAttributeDescription()
+	{
+		VkVertexInputAttributeDescription attributeDescription{};
+		attributeDescription.binding = 1;
+		attributeDescription.location = 0;
+		attributeDescription.format = VK_FORMAT_R16G16B16A16_SNORM;
+		attributeDescription.offset = 0;
+
+		return attributeDescription;
+	}
+};
+
 namespace std 
 {
 	template<> struct hash<Vertex> 
@@ -144,17 +206,445 @@ struct UniformBufferObject
 	alignas(16) glm::mat4 model;
 	alignas(16) glm::mat4 view;
 	alignas(16) glm::mat4 proj;
+	alignas(16) glm::mat4 previousModelViewProj; // Last frame's transform, which its depth pyramid was rendered with.
+};
+
+// One entry of the GPU-driven object buffer; matches ObjectData in cull.comp (std430).
+struct ObjectData
+{
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t padding;
+	glm::vec4 boundingSphere; // Entity-space center in xyz, radius in w.
+};
+
+// Written by cull.comp for each frame and read back once the frame has completed.
+struct CullCounters
+{
+	uint32_t drawCount[2]; // Draws generated before the depth pyramid rebuild, and after it.
+	uint32_t frustumCulled;
+	uint32_t occlusionCulled;
+};
+
+// The Hi-Z depth pyramid and the descriptors that reference it. Sized to the swapchain, so it is rebuilt and
+// retired along with the other attachments.
+struct DepthPyramid
+{
+	VkImage image = nullptr;
+	VkDeviceMemory memory = nullptr;
+	VkImageView view = nullptr; // Every level, sampled by the culling pass.
+	std::vector<VkImageView> levelViews{}; // One per level, written by the pyramid build.
+	uint32_t levelCount = 0;
+	VkBuffer infoBuffer = nullptr; // PyramidInfo in hiz.comp and cull.comp.
+	VkDeviceMemory infoBufferMemory = nullptr;
+	VkDescriptorPool descriptorPool = nullptr;
+	VkDescriptorSet buildDescriptorSet = nullptr;
+	VkDescriptorSet cullDescriptorSet = nullptr;
+};
+
+// A pre-recorded primary command buffer (plus the secondaries it executes when parallel recording is
+// enabled) for one frame slot and swapchain image. Re-recorded only after it has been invalidated.
+struct CachedCommandBuffer
+{
+	VkCommandBuffer primary = nullptr;
+	std::vector<VkCommandBuffer> secondaries{};
+	bool valid = false;
+};
+
+// Everything sized to or created from one swapchain, so a retired set can be destroyed as a unit once the
+// frames that rendered with it have completed.
+struct SwapChainResources
+{
+	VkSwapchainKHR swapChain = nullptr;
+	std::vector<VkImage> offscreenImages{}; // Only with --headless; swapchain images belong to the swapchain.
+	std::vector<VkDeviceMemory> offscreenImagesMemory{};
+	std::vector<VkImageView> imageViews{};
+	std::vector<VkFramebuffer> framebuffers{};
+	VkImage colorImage = nullptr;
+	VkDeviceMemory colorImageMemory = nullptr;
+	VkImageView colorImageView = nullptr;
+	VkImage depthImage = nullptr;
+	VkDeviceMemory depthImageMemory = nullptr;
+	VkImageView depthImageView = nullptr;
+	VkImage sceneImage = nullptr;
+	VkDeviceMemory sceneImageMemory = nullptr;
+	VkImageView sceneImageView = nullptr;
+	DepthPyramid depthPyramid{};
+};
+
+// State of the DepthPrepassMode::Auto measurement: phase 0 runs without the prepass, phase 1 with it.
+struct DepthPrepassTrial
+{
+	static const uint32_t WARMUP_FRAMES = 10;
+	static const uint32_t MEASURED_FRAMES = 120;
+
+	uint32_t phase = 0;
+	uint64_t phaseStartFrame = 0;
+	uint32_t samples[2] = {};
+	double gpuMilliseconds[2] = {};
+	bool decided = false;
+};
+
+enum class DepthPrepassMode
+{
+	Off,
+	On,
+	Auto // Times a stretch of frames with and without the prepass and keeps whichever is faster on the GPU.
+};
+
+struct DeviceMemoryAllocation
+{
+	VkDeviceSize size = 0;
+	uint32_t memoryTypeIndex = 0;
+};
+
+struct ApplicationSettings
+{
+	uint32_t framesInFlight = 2;
+	LatencyMode latencyMode = LatencyMode::Uncapped;
+	bool logFrameTiming = false;
+	bool commandBufferCache = true;
+	uint32_t workerThreadCount = 0; // 0 = one per hardware thread.
+	bool logTaskGraph = false;
+	bool parallelRecording = false;
+	uint32_t recordingThreadCount = 0; // 0 = one per job system worker.
+	uint32_t drawCount = 0; // 0 = one draw per shape in the model.
+	bool benchmarkRecording = false;
+	bool benchmarkJobs = false;
+	uint32_t benchmarkIterations = 500;
+	uint32_t simulationRate = 60; // Fixed simulation ticks per second.
+	uint32_t simulationLoadMilliseconds = 0; // Artificial cost added to every simulation tick.
+	std::string pipelineCachePath = "pipeline_cache.bin"; // Empty disables the on-disk cache.
+	std::string pipelineManifestPath{}; // Pipeline permutations to precompile at startup.
+	ShaderFeatureFlags shaderFeatures = SHADER_FEATURE_TEXTURE;
+	std::string shaderOverrideDirectory{}; // Load SPIR-V from here instead of the embedded copies.
+	bool dynamicRendering = false; // Render without VkRenderPass/VkFramebuffer objects when supported.
+	bool benchmarkResize = false;
+	uint32_t soakResizeCount = 0; // Resizes to perform while checking that device memory use stays flat.
+	bool dynamicResolution = false; // Render at a scale chosen from GPU frame time, then upscale to the swapchain.
+	double gpuBudgetMilliseconds = 0.0; // GPU frame-time target for dynamic resolution; 0 uses the refresh interval.
+	double minResolutionScale = 0.5;
+	uint32_t maxSampleCount = 64; // Upper bound on the MSAA sample count picked for the device.
+	bool memoryReport = false; // Print device memory use, including what lazily allocated attachments saved.
+	DepthPrepassMode depthPrepass = DepthPrepassMode::Off;
+	bool pipelineStatistics = false; // Count shader invocations and primitives per frame with a pipeline statistics query.
+	std::string gpuProfilePath{}; // Write the GPU profiler's per-scope summary here as CSV on exit.
+	std::string tracePath{}; // Record CPU zones and write them here as a Chrome trace on exit (ENABLE_TRACING builds).
+	bool gpuDriven = false; // Cull and generate draws in a compute pass, then draw with one indirect count call.
+	bool occlusionCulling = false; // Also cull against a Hi-Z depth pyramid, in two phases. Implies gpuDriven.
+	bool headless = false; // No window, surface or swapchain: render offscreen images and report throughput.
+	uint32_t headlessFrameCount = 1000;
+	std::string benchmarkSuitePath{}; // Run the benchmark suite (headless) and write its results here as JSON.
+	LogSeverity logSeverity = LogSeverity::Info; // Validation and engine messages below this are dropped unformatted.
+	bool hostAllocationReport = false; // Route driver host allocations through counting callbacks and print them on exit.
+	uint32_t commandArenaKilobytes = 0; // Serve command-scope host allocations from a per-frame arena this large.
+	std::string deviceOverride{}; // Name substring or enumeration index of the device to use instead of the best ranked.
+	bool probeDevices = false; // Rank devices by a copy bandwidth probe as well as their capabilities.
+	std::string deviceProbeCachePath = "device_probe_cache.txt"; // Empty probes every run.
+	bool cpuCulling = false; // Frustum cull the scene's entities on the job system before recording CPU draws.
 };
 
+ApplicationSettings parseCommandLine(int argc, char** argv)
+{
+	ApplicationSettings settings{};
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		auto nextString = [&]() -> std::string
+		{
+			if (i + 1 >= argc)
+			{
+				throw std::invalid_argument("Missing value for " + arg);
+			}
+
+			return argv[++i];
+		};
+
+		auto nextValue = [&]() -> uint32_t
+		{
+			return static_cast<uint32_t>(std::stoul(nextString()));
+		};
+
+		if (arg == "--frames-in-flight")
+		{
+			settings.framesInFlight = nextValue();
+			if (settings.framesInFlight < 1 || settings.framesInFlight > FrameScheduler::MAX_FRAMES_IN_FLIGHT)
+			{
+				throw std::invalid_argument("--frames-in-flight must be between 1 and 4");
+			}
+		}
+		else if (arg == "--latency-mode")
+		{
+			settings.latencyMode = parseLatencyMode(nextString());
+		}
+		else if (arg == "--log-frame-timing")
+		{
+			settings.logFrameTiming = true;
+		}
+		else if (arg == "--no-command-cache")
+		{
+			settings.commandBufferCache = false;
+		}
+		else if (arg == "--worker-threads")
+		{
+			settings.workerThreadCount = nextValue();
+		}
+		else if (arg == "--log-task-graph")
+		{
+			settings.logTaskGraph = true;
+		}
+		else if (arg == "--benchmark-jobs")
+		{
+			settings.benchmarkJobs = true;
+		}
+		else if (arg == "--parallel-recording")
+		{
+			settings.parallelRecording = true;
+		}
+		else if (arg == "--recording-threads")
+		{
+			settings.recordingThreadCount = nextValue();
+		}
+		else if (arg == "--draw-count")
+		{
+			settings.drawCount = nextValue();
+		}
+		else if (arg == "--benchmark-recording")
+		{
+			settings.benchmarkRecording = true;
+		}
+		else if (arg == "--benchmark-iterations")
+		{
+			settings.benchmarkIterations = nextValue();
+		}
+		else if (arg == "--simulation-rate")
+		{
+			settings.simulationRate = nextValue();
+			if (settings.simulationRate == 0)
+			{
+				throw std::invalid_argument("--simulation-rate must be greater than zero");
+			}
+		}
+		else if (arg == "--simulation-load")
+		{
+			settings.simulationLoadMilliseconds = nextValue();
+		}
+		else if (arg == "--pipeline-cache")
+		{
+			settings.pipelineCachePath = nextString();
+		}
+		else if (arg == "--no-pipeline-cache")
+		{
+			settings.pipelineCachePath.clear();
+		}
+		else if (arg == "--pipeline-manifest")
+		{
+			settings.pipelineManifestPath = nextString();
+		}
+		else if (arg == "--shader-features")
+		{
+			settings.shaderFeatures = parseShaderFeatures(nextString());
+		}
+		else if (arg == "--shader-dir")
+		{
+			settings.shaderOverrideDirectory = nextString();
+		}
+		else if (arg == "--dynamic-rendering")
+		{
+			settings.dynamicRendering = true;
+		}
+		else if (arg == "--benchmark-resize")
+		{
+			settings.benchmarkResize = true;
+		}
+		else if (arg == "--soak-resize")
+		{
+			settings.soakResizeCount = nextValue();
+		}
+		else if (arg == "--dynamic-resolution")
+		{
+			settings.dynamicResolution = true;
+		}
+		else if (arg == "--gpu-budget")
+		{
+			settings.gpuBudgetMilliseconds = std::stod(nextString());
+		}
+		else if (arg == "--min-resolution-scale")
+		{
+			settings.minResolutionScale = std::stod(nextString());
+			if (settings.minResolutionScale <= 0.0 || settings.minResolutionScale > 1.0)
+			{
+				throw std::invalid_argument("--min-resolution-scale must be greater than 0 and at most 1");
+			}
+		}
+		else if (arg == "--depth-prepass")
+		{
+			std::string mode = nextString();
+			if (mode == "off")
+			{
+				settings.depthPrepass = DepthPrepassMode::Off;
+			}
+			else if (mode == "on")
+			{
+				settings.depthPrepass = DepthPrepassMode::On;
+			}
+			else if (mode == "auto")
+			{
+				settings.depthPrepass = DepthPrepassMode::Auto;
+			}
+			else
+			{
+				throw std::invalid_argument("Unknown depth prepass mode: " + mode);
+			}
+		}
+		else if (arg == "--gpu-driven")
+		{
+			settings.gpuDriven = true;
+		}
+		else if (arg == "--cpu-culling")
+		{
+			settings.cpuCulling = true;
+		}
+		else if (arg == "--occlusion-culling")
+		{
+			settings.occlusionCulling = true;
+			settings.gpuDriven = true;
+		}
+		else if (arg == "--pipeline-stats")
+		{
+			settings.pipelineStatistics = true;
+		}
+		else if (arg == "--gpu-profile")
+		{
+			settings.gpuProfilePath = nextString();
+		}
+		else if (arg == "--trace")
+		{
+			settings.tracePath = nextString();
+		}
+		else if (arg == "--headless")
+		{
+			settings.headless = true;
+		}
+		else if (arg == "--frames")
+		{
+			settings.headlessFrameCount = nextValue();
+		}
+		else if (arg == "--benchmark-suite")
+		{
+			settings.benchmarkSuitePath = nextString();
+			settings.headless = true;
+		}
+		else if (arg == "--log-level")
+		{
+			settings.logSeverity = parseLogSeverity(nextString());
+		}
+		else if (arg == "--host-allocation-report")
+		{
+			settings.hostAllocationReport = true;
+		}
+		else if (arg == "--command-arena")
+		{
+			settings.commandArenaKilobytes = nextValue();
+			settings.hostAllocationReport = true;
+		}
+		else if (arg == "--device")
+		{
+			settings.deviceOverride = nextString();
+		}
+		else if (arg == "--probe-devices")
+		{
+			settings.probeDevices = true;
+		}
+		else if (arg == "--device-probe-cache")
+		{
+			settings.deviceProbeCachePath = nextString();
+		}
+		else if (arg == "--memory-report")
+		{
+			settings.memoryReport = true;
+		}
+		else if (arg == "--max-samples")
+		{
+			settings.maxSampleCount = nextValue();
+			if (settings.maxSampleCount < 1)
+			{
+				throw std::invalid_argument("--max-samples must be at least 1");
+			}
+		}
+		else
+		{
+			throw std::invalid_argument("Unknown argument: " + arg);
+		}
+	}
+
+	if (settings.headless && (settings.benchmarkResize || settings.soakResizeCount > 0))
+	{
+		throw std::invalid_argument("--benchmark-resize and --soak-resize need a window and can't be combined with --headless");
+	}
+
+	return settings;
+}
+
 class HelloTriangleApplication 
 {
 public:
 
+	explicit HelloTriangleApplication(const ApplicationSettings& settings) : settings(settings)
+	{
+	}
+
 	void run() 
 	{
-		this->initWindow();
+		if (this->settings.benchmarkJobs)
+		{
+			this->benchmarkJobSystem();
+			return;
+		}
+
+		uint32_t workerCount = this->settings.workerThreadCount;
+		if (workerCount == 0)
+		{
+			workerCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		this->jobSystem.start(workerCount);
+
+		if (!this->settings.headless)
+		{
+			this->initWindow();
+		}
+
 		this->initVulkan();
-		this->mainLoop();
+
+		if (this->settings.benchmarkRecording)
+		{
+			this->benchmarkRecording();
+		}
+		else if (this->settings.benchmarkResize)
+		{
+			this->benchmarkResize();
+		}
+		else if (this->settings.soakResizeCount > 0)
+		{
+			this->soakResize();
+		}
+		else if (!this->settings.benchmarkSuitePath.empty())
+		{
+			this->runBenchmarkSuite();
+		}
+		else if (this->settings.headless)
+		{
+			this->runHeadless();
+		}
+		else
+		{
+			this->mainLoop();
+		}
+
 		this->cleanup();
 	}
 
@@ -266,6 +756,10 @@ public:
 
 private:
 
+	ApplicationSettings settings{};
+	HostAllocator hostAllocator{};
+	const VkAllocationCallbacks* allocationCallbacks = nullptr; // The host allocator's callbacks with --host-allocation-report.
+	HostAllocator::ScopeStatistics startupHostAllocations[HostAllocator::SCOPE_COUNT]{};
 	GLFWwindow* window = nullptr;
 	VkInstance instance = nullptr;
 	VkDebugUtilsMessengerEXT debugMessenger = nullptr;
@@ -275,29 +769,106 @@ private:
 	VkSurfaceKHR surface = nullptr;
 	VkQueue presentQueue = nullptr;
 	VkSwapchainKHR swapChain = nullptr;
-	std::vector<VkImage> swapChainImages{};
+	std::vector<VkImage> swapChainImages{}; // Offscreen images, one per frame slot, with --headless.
+	std::vector<VkDeviceMemory> offscreenImagesMemory{}; // Backs swapChainImages with --headless.
 	VkFormat swapChainImageFormat{};
 	VkExtent2D swapChainExtent{};
 	std::vector<VkImageView> swapChainImageViews{};
 	VkRenderPass renderPass = nullptr;
 	VkDescriptorSetLayout descriptorSetLayout = nullptr;
 	VkPipelineLayout pipelineLayout = nullptr;
-	VkPipeline graphicsPipeline = nullptr;
+	VkShaderModule vertShaderModule = nullptr;
+	VkShaderModule fragShaderModule = nullptr;
+	PipelineRegistry pipelineRegistry{};
+	PipelineStateDesc activePipelineDesc{};
+	uint64_t pipelineReadyGeneration = 0; // Registry generation the cached command buffers were recorded against.
+	size_t pipelineVariantIndex = 0;
+	bool fillModeNonSolidSupported = false;
 	std::vector<VkFramebuffer> swapChainFramebuffers{};
 	VkCommandPool commandPool = nullptr;
-	std::vector<VkCommandBuffer> commandBuffers{};
+	std::vector<CachedCommandBuffer> commandBufferCache{}; // [frame * swapChainImages.size() + image]
+	uint64_t commandBufferRecordCount = 0;
+	uint64_t frameCount = 0;
 	std::vector<VkSemaphore> imageAvailableSemaphores{};
 	std::vector<VkSemaphore> renderFinishedSemaphores{};
-	std::vector<VkFence> inFlightFences{};
-	uint32_t currentFrame = 0;
+	FrameScheduler frameScheduler{};
+	FramePacer framePacer{};
+	SimulationThread simulation{};
+	PipelineCache pipelineCache{};
+	GpuProfiler gpuProfiler{};
+	bool pipelineStatisticsSupported = false;
+	bool inheritedQueriesSupported = false;
+	uint64_t fragmentInvocationTotal = 0;
+	uint64_t fragmentInvocationFrames = 0;
+	bool gpuDrivenEnabled = false;
+	VkBuffer objectBuffer = nullptr; // ObjectData for every draw command.
+	VkDeviceMemory objectBufferMemory = nullptr;
+	std::vector<VkBuffer> indirectDrawBuffers{}; // Per frame slot: the draws written by the culling pass.
+	std::vector<VkDeviceMemory> indirectDrawBuffersMemory{};
+	std::vector<VkBuffer> drawCountBuffers{}; // Per frame slot: how many of those draws were written.
+	std::vector<VkDeviceMemory> drawCountBuffersMemory{};
+	VkDescriptorSetLayout cullDescriptorSetLayout = nullptr;
+	std::vector<VkDescriptorSet> cullDescriptorSets{};
+	VkPipelineLayout cullPipelineLayout = nullptr;
+	VkPipeline cullPipeline = nullptr;
+	std::vector<VkBuffer> cullCounterReadbackBuffers{}; // Per frame slot: host-visible copy of the CullCounters.
+	std::vector<VkDeviceMemory> cullCounterReadbackBuffersMemory{};
+	std::vector<void*> cullCounterReadbackBuffersMapped{};
+	CullCounters cullCounters{}; // The most recently completed frame's.
+	uint64_t culledObjectTotal = 0;
+	uint64_t cullCounterFrames = 0;
+	uint64_t cpuVisibleTotal = 0;
+	uint64_t cpuCullingFrames = 0;
+	uint64_t cpuCullingRecordCount = 0; // Frames whose visible set changed, invalidating the cached command buffers.
+	bool occlusionCullingEnabled = false;
+	uint32_t recordingCullPhase = 0; // Which of the two occlusion culling draw lists recordDraws() draws.
+	std::vector<VkBuffer> retestBuffers{}; // Per frame slot: objects phase 0 hid behind last frame's depth.
+	std::vector<VkDeviceMemory> retestBuffersMemory{};
+	VkDescriptorSetLayout depthPyramidSetLayout = nullptr; // Culling set 1: the pyramid and its PyramidInfo.
+	VkDescriptorSetLayout depthPyramidBuildSetLayout = nullptr;
+	VkPipelineLayout depthPyramidPipelineLayout = nullptr;
+	VkPipeline depthPyramidPipeline = nullptr;
+	VkSampler depthPyramidSampler = nullptr;
+	DepthPyramid depthPyramid{};
+	VkCommandBuffer depthPyramidInitCommandBuffer = nullptr; // Submitted ahead of the next frame, then freed.
+	VkRenderPass resumeRenderPass = nullptr; // Continues the frame after the pyramid build, loading the attachments.
+	glm::mat4 previousModelViewProj{ 1.0f };
+	bool depthPrepassEnabled = false;
+	bool recordingDepthPrepass = false; // Set while recording a command buffer that uses the prepass.
+	DepthPrepassTrial depthPrepassTrial{};
+	bool presentWaitSupported = false;
+	PFN_vkWaitForPresentKHR waitForPresent = nullptr;
+	bool dynamicRenderingEnabled = false;
+	bool dynamicResolutionEnabled = false;
+	ResolutionController resolutionController{};
+	VkExtent2D renderExtent{}; // Scaled region of the scene target rendered to; the swapchain extent without dynamic resolution.
+	VkImage sceneImage = nullptr; // Single-sampled scene target, upscaled into the swapchain image with dynamic resolution.
+	VkDeviceMemory sceneImageMemory = nullptr;
+	VkImageView sceneImageView = nullptr;
+	PFN_vkCmdBeginRenderingKHR cmdBeginRendering = nullptr;
+	PFN_vkCmdEndRenderingKHR cmdEndRendering = nullptr;
+	uint64_t swapChainRecreateCount = 0;
+	double swapChainRecreateMilliseconds = 0.0;
+	double framebufferRebuildMilliseconds = 0.0; // framebuffer creation only; the old ones are destroyed later
+	std::unordered_map<VkDeviceMemory, DeviceMemoryAllocation> deviceMemoryAllocations{};
+	VkDeviceSize deviceMemoryInUse = 0;
+	VkDeviceSize deviceMemoryPeak = 0;
+	std::deque<uint64_t> pendingPresents{}; // Frame values whose present completion has not been observed yet.
+	uint64_t firstPresentOnSwapChain = 1; // Present ids are per swapchain; older ids can't be waited on.
 	bool framebufferResized = false;
 	VkBuffer vertexBuffer = nullptr;
 	VkDeviceMemory vertexBufferMemory = nullptr;
+	VkBuffer quantizedPositionBuffer = nullptr;
+	VkDeviceMemory quantizedPositionBufferMemory = nullptr;
 	VkBuffer indexBuffer = nullptr;
 	VkDeviceMemory indexBufferMemory = nullptr;
 	std::vector<VkBuffer> uniformBuffers{};
 	std::vector<VkDeviceMemory> uniformBuffersMemory{};
 	std::vector<void*> uniformBuffersMapped{};
+	std::vector<VkBuffer> objectTransformBuffers{}; // Per frame slot: every entity's model matrix relative to the scene root.
+	std::vector<VkDeviceMemory> objectTransformBuffersMemory{};
+	std::vector<void*> objectTransformBuffersMapped{};
+	std::vector<uint64_t> objectTransformVersions{}; // Scene transform version each slot's buffer was written at.
 	VkDescriptorPool descriptorPool = nullptr;
 	std::vector<VkDescriptorSet> descriptorSets{};
 	VkImage textureImage = nullptr;
@@ -309,11 +880,20 @@ private:
 	VkDeviceMemory depthImageMemory = nullptr;
 	VkImageView depthImageView = nullptr;
 	std::vector<Vertex> vertices{};
+	std::vector<QuantizedPosition> quantizedPositions{};
+	float positionScale = 1.0f; // Largest absolute position component, which SNORM 1.0 maps back to.
 	std::vector<uint32_t> indices{};
 	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
 	VkImage colorImage = nullptr;
 	VkDeviceMemory colorImageMemory = nullptr;
 	VkImageView colorImageView = nullptr;
+	Scene scene{}; // One entity per draw.
+	TransformState frameTransform{}; // The scene root, sampled from the simulation once per frame.
+	JobSystem jobSystem{};
+	TaskGraph frameTaskGraph{};
+	uint32_t frameImageIndex = 0; // Swapchain image the frame task graph is working on.
+	uint32_t recordingThreadCount = 0; // Number of secondary command buffers the draw stream is split into.
+	std::vector<VkCommandPool> recordingCommandPools{}; // [frame * recordingThreadCount + range]
 
 	void initWindow()
 	{
@@ -324,6 +904,25 @@ private:
 		this->window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
 		glfwSetWindowUserPointer(this->window, this);
 		glfwSetFramebufferSizeCallback(this->window, framebufferSizeCallback);
+		glfwSetKeyCallback(this->window, keyCallback);
+		glfwSetCursorPosCallback(this->window, cursorPosCallback);
+	}
+
+	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+	{
+		auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+		app->framePacer.notifyInput();
+
+		if (key == GLFW_KEY_P && action == GLFW_PRESS)
+		{
+			app->cyclePipelineVariant();
+		}
+	}
+
+	static void cursorPosCallback(GLFWwindow* window, double x, double y)
+	{
+		auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+		app->framePacer.notifyInput();
 	}
 
 	static void framebufferSizeCallback(GLFWwindow* window, int width, int height)
@@ -334,16 +933,28 @@ private:
 
 	void initVulkan() 
 	{
+		TRACE_FUNCTION();
+
+		auto startupStart = std::chrono::high_resolution_clock::now();
+
+		this->createHostAllocator();
 		this->createInstance();
 		this->setupDebugMessenger();
 		this->createSurface();
 		this->pickPhysicalDevice();
 		this->createLogicalDevice();
+		this->createPipelineCache();
+		this->checkDynamicResolutionSupport();
 		this->createSwapChain();
 		this->createImageViews();
 		this->createRenderPass();
 		this->createDescriptorSetLayout();
+		this->loadModel(); // Before the pipelines: the quantized position scale is a specialization constant.
+
+		auto pipelineStart = std::chrono::high_resolution_clock::now();
 		this->createGraphicsPipeline();
+		auto pipelineEnd = std::chrono::high_resolution_clock::now();
+
 		this->createCommandPool();
 		this->createColorResources();
 		this->createDepthResources();
@@ -351,66 +962,269 @@ private:
 		this->createTextureImage();
 		this->createTextureImageView();
 		this->createTextureSampler();
-		this->loadModel();
 		this->createVertexBuffer();
+		this->createQuantizedPositionBuffer();
 		this->createIndexBuffer();
 		this->createUniformBuffers();
 		this->createDescriptorPool();
 		this->createDescriptorSets();
+		this->createCullingResources();
+		this->createDepthPyramid();
+		this->createRecordingCommandPools();
 		this->createCommandBuffers();
 		this->createSyncObjects();
-	}
+		this->createGpuProfiler();
+		this->configureFramePacing();
+		this->configureDepthPrepass();
+		this->configureDynamicResolution();
+		this->createFrameTaskGraph();
 
-	void mainLoop()
-	{
-		while (!glfwWindowShouldClose(this->window))
+		for (uint32_t scope = 0; scope < HostAllocator::SCOPE_COUNT; scope++)
 		{
-			glfwPollEvents();
-			this->drawFrame();
+			this->startupHostAllocations[scope] = this->hostAllocator.getStatistics(static_cast<VkSystemAllocationScope>(scope));
 		}
 
-		vkDeviceWaitIdle(this->logicalDevice);
+		auto startupEnd = std::chrono::high_resolution_clock::now();
+
+		Log::write(LogSeverity::Info, "Startup (%s pipeline cache): %.2f ms, graphics pipeline %.2f ms", this->pipelineCache.isWarm() ? "warm" : "cold",
+			std::chrono::duration<double, std::milli>(startupEnd - startupStart).count(), std::chrono::duration<double, std::milli>(pipelineEnd - pipelineStart).count());
 	}
 
-	void createSurface()
+	// Must come before the instance: every object is destroyed with the callbacks it was created with.
+	void createHostAllocator()
 	{
-		if (glfwCreateWindowSurface(this->instance, this->window, nullptr, &this->surface) != VK_SUCCESS)
+		if (!this->settings.hostAllocationReport)
 		{
-			throw std::runtime_error("Failed to create window surface!");
+			return;
 		}
+
+		this->hostAllocator.create(static_cast<size_t>(this->settings.commandArenaKilobytes) * 1024);
+		this->allocationCallbacks = this->hostAllocator.getCallbacks();
 	}
 
-	void createLogicalDevice()
+	void createPipelineCache()
 	{
-		QueueFamilyIndices indicies = findQueueFamilies(this->physicalDevice);
-
-		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-		std::set<uint32_t> uniqueQueueFamilies = { indicies.graphicsFamily.value(), indicies.presentFamily.value() };
-		float queuePriority = 1.0f;
+		TRACE_FUNCTION();
 
-		for (uint32_t queueFamily : uniqueQueueFamilies)
+		if (this->settings.pipelineCachePath.empty())
 		{
-			VkDeviceQueueCreateInfo queueCreateInfo{};
-			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-			queueCreateInfo.queueFamilyIndex = queueFamily;
-			queueCreateInfo.queueCount = 1;
-			queueCreateInfo.pQueuePriorities = &queuePriority;
-			queueCreateInfos.push_back(queueCreateInfo);
+			return;
 		}
 
-		VkPhysicalDeviceFeatures deviceFeatures{};
-		deviceFeatures.samplerAnisotropy = VK_TRUE;
-		deviceFeatures.sampleRateShading = VK_TRUE; // enable sample shading feature for the device
-
-		VkDeviceCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-		createInfo.pQueueCreateInfos = queueCreateInfos.data();
-		createInfo.pEnabledFeatures = &deviceFeatures;
-		createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-		createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+		this->pipelineCache.create(this->physicalDevice, this->logicalDevice, this->allocationCallbacks, this->settings.pipelineCachePath);
 
-		if (enableValidationLayers)
+		if (this->pipelineCache.isWarm())
+		{
+			Log::write(LogSeverity::Info, "Loaded pipeline cache %s (%zu bytes).", this->pipelineCache.getPath().c_str(), this->pipelineCache.getInitialSize());
+		}
+	}
+
+	void mainLoop()
+	{
+		this->simulation.start(this->settings.simulationRate, this->settings.simulationLoadMilliseconds);
+
+		while (!glfwWindowShouldClose(this->window))
+		{
+			glfwPollEvents();
+			this->drawFrame();
+		}
+
+		this->simulation.stop();
+		vkDeviceWaitIdle(this->logicalDevice);
+
+		this->printRunSummary();
+	}
+
+	// Renders a fixed number of frames back to back into the offscreen images. Nothing is presented, so
+	// throughput is bound only by the frame's own CPU and GPU work.
+	void runHeadless()
+	{
+		uint32_t frames = this->settings.headlessFrameCount;
+
+		this->simulation.start(this->settings.simulationRate, this->settings.simulationLoadMilliseconds);
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+
+		for (uint32_t i = 0; i < frames; i++)
+		{
+			this->drawFrame();
+		}
+
+		vkDeviceWaitIdle(this->logicalDevice);
+		auto endTime = std::chrono::high_resolution_clock::now();
+
+		this->simulation.stop();
+
+		double milliseconds = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+
+		Log::write(LogSeverity::Info, "Headless: %u frame(s) at %ux%u in %.2f ms, %.1f frames/s, %.3f ms per frame", frames, this->swapChainExtent.width, this->swapChainExtent.height,
+			milliseconds, frames * 1000.0 / std::max(milliseconds, 1e-3), milliseconds / std::max(1u, frames));
+
+		this->printRunSummary();
+	}
+
+	void printRunSummary()
+	{
+		Log::write(LogSeverity::Info, "Simulated %llu tick(s), dropped %llu.", static_cast<unsigned long long>(this->simulation.getTickCount()),
+			static_cast<unsigned long long>(this->simulation.getDroppedTickCount()));
+
+		Log::write(LogSeverity::Info, "Recorded %llu command buffer(s) over %llu frame(s).", static_cast<unsigned long long>(this->commandBufferRecordCount),
+			static_cast<unsigned long long>(this->frameCount));
+
+		if (this->fragmentInvocationFrames > 0)
+		{
+			Log::write(LogSeverity::Info, "Fragment shader invocations: %llu per frame on average.", static_cast<unsigned long long>(this->fragmentInvocationTotal / this->fragmentInvocationFrames));
+		}
+
+		this->printGpuProfile();
+
+		if (this->cullCounterFrames > 0)
+		{
+			Log::write(LogSeverity::Info, "Culled %llu of %zu object(s) per frame on average.", static_cast<unsigned long long>(this->culledObjectTotal / this->cullCounterFrames), this->scene.size());
+		}
+
+		if (this->cpuCullingFrames > 0)
+		{
+			Log::write(LogSeverity::Info, "CPU culling: %llu of %zu object(s) visible per frame on average, visible set changed on %llu frame(s).",
+				static_cast<unsigned long long>(this->cpuVisibleTotal / this->cpuCullingFrames), this->scene.size(), static_cast<unsigned long long>(this->cpuCullingRecordCount));
+		}
+
+		if (this->settings.memoryReport)
+		{
+			this->printMemoryReport();
+		}
+
+		if (this->settings.hostAllocationReport)
+		{
+			this->printHostAllocationReport();
+		}
+
+		if (this->dynamicResolutionEnabled)
+		{
+			Log::write(LogSeverity::Info, "Dynamic resolution: %llu scale change(s), final scale %.3f (%ux%u).", static_cast<unsigned long long>(this->resolutionController.getChangeCount()),
+				this->resolutionController.getScale(), this->renderExtent.width, this->renderExtent.height);
+		}
+	}
+
+	void createSurface()
+	{
+		TRACE_FUNCTION();
+
+		if (this->settings.headless)
+		{
+			return;
+		}
+
+		if (glfwCreateWindowSurface(this->instance, this->window, this->allocationCallbacks, &this->surface) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create window surface!");
+		}
+	}
+
+	void createLogicalDevice()
+	{
+		TRACE_FUNCTION();
+
+		QueueFamilyIndices indicies = findQueueFamilies(this->physicalDevice);
+
+		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+		std::set<uint32_t> uniqueQueueFamilies = { indicies.graphicsFamily.value(), indicies.presentFamily.value() };
+		float queuePriority = 1.0f;
+
+		for (uint32_t queueFamily : uniqueQueueFamilies)
+		{
+			VkDeviceQueueCreateInfo queueCreateInfo{};
+			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+			queueCreateInfo.queueFamilyIndex = queueFamily;
+			queueCreateInfo.queueCount = 1;
+			queueCreateInfo.pQueuePriorities = &queuePriority;
+			queueCreateInfos.push_back(queueCreateInfo);
+		}
+
+		VkPhysicalDeviceFeatures deviceFeatures{};
+		deviceFeatures.samplerAnisotropy = VK_TRUE;
+		deviceFeatures.sampleRateShading = VK_TRUE; // enable sample shading feature for the device
+
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(this->physicalDevice, &supportedFeatures);
+		this->fillModeNonSolidSupported = supportedFeatures.fillModeNonSolid;
+		deviceFeatures.fillModeNonSolid = supportedFeatures.fillModeNonSolid; // wireframe pipeline permutations
+
+		this->pipelineStatisticsSupported = this->settings.pipelineStatistics && supportedFeatures.pipelineStatisticsQuery;
+		this->inheritedQueriesSupported = this->pipelineStatisticsSupported && supportedFeatures.inheritedQueries;
+		deviceFeatures.pipelineStatisticsQuery = this->pipelineStatisticsSupported ? VK_TRUE : VK_FALSE;
+		deviceFeatures.inheritedQueries = this->inheritedQueriesSupported ? VK_TRUE : VK_FALSE; // queries active across vkCmdExecuteCommands
+
+		VkPhysicalDeviceVulkan12Features vulkan12Features{};
+		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		vulkan12Features.timelineSemaphore = VK_TRUE; // frame pacing runs on a single timeline semaphore
+
+		this->gpuDrivenEnabled = this->settings.gpuDriven && this->checkGpuDrivenSupport(this->physicalDevice);
+		if (this->gpuDrivenEnabled)
+		{
+			deviceFeatures.multiDrawIndirect = VK_TRUE;
+			deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+			vulkan12Features.drawIndirectCount = VK_TRUE;
+		}
+		else if (this->settings.gpuDriven)
+		{
+			Log::write(LogSeverity::Warning, "vkCmdDrawIndexedIndirectCount, multi-draw indirect or indirect firstInstance is not supported; using CPU draws.");
+		}
+
+		this->occlusionCullingEnabled = this->gpuDrivenEnabled && this->settings.occlusionCulling && this->checkOcclusionCullingSupport(this->physicalDevice);
+		if (this->occlusionCullingEnabled)
+		{
+			deviceFeatures.shaderStorageImageArrayDynamicIndexing = VK_TRUE; // hiz.comp picks pyramid levels in a loop
+		}
+		else if (this->gpuDrivenEnabled && this->settings.occlusionCulling)
+		{
+			Log::write(LogSeverity::Warning, "Hi-Z occlusion culling is not supported; culling against the frustum only.");
+		}
+
+		std::vector<const char*> enabledExtensions = this->getRequiredDeviceExtensions();
+
+		VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+		presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+		presentIdFeatures.presentId = VK_TRUE;
+
+		VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+		presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+		presentWaitFeatures.presentWait = VK_TRUE;
+
+		this->presentWaitSupported = !this->settings.headless && this->checkPresentWaitSupport(this->physicalDevice);
+		if (this->presentWaitSupported)
+		{
+			enabledExtensions.insert(enabledExtensions.end(), presentWaitExtensions.begin(), presentWaitExtensions.end());
+			presentIdFeatures.pNext = &presentWaitFeatures;
+			vulkan12Features.pNext = &presentIdFeatures;
+		}
+
+		VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+		dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+		dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+
+		this->dynamicRenderingEnabled = this->settings.dynamicRendering && this->checkDynamicRenderingSupport(this->physicalDevice);
+		if (this->dynamicRenderingEnabled)
+		{
+			enabledExtensions.insert(enabledExtensions.end(), dynamicRenderingExtensions.begin(), dynamicRenderingExtensions.end());
+			dynamicRenderingFeatures.pNext = vulkan12Features.pNext;
+			vulkan12Features.pNext = &dynamicRenderingFeatures;
+		}
+		else if (this->settings.dynamicRendering)
+		{
+			Log::write(LogSeverity::Warning, "VK_KHR_dynamic_rendering is not supported; using render passes.");
+		}
+
+		VkDeviceCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		createInfo.pNext = &vulkan12Features;
+		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+		createInfo.pQueueCreateInfos = queueCreateInfos.data();
+		createInfo.pEnabledFeatures = &deviceFeatures;
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+		createInfo.ppEnabledExtensionNames = enabledExtensions.data();
+
+		if (enableValidationLayers)
 		{
 			createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
 			createInfo.ppEnabledLayerNames = validationLayers.data();
@@ -420,84 +1234,133 @@ private:
 			createInfo.enabledLayerCount = 0;
 		}
 		
-		if (vkCreateDevice(this->physicalDevice, &createInfo, nullptr, &this->logicalDevice) != VK_SUCCESS)
+		if (vkCreateDevice(this->physicalDevice, &createInfo, this->allocationCallbacks, &this->logicalDevice) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to create logical device!");
 		}
 
+		if (this->presentWaitSupported)
+		{
+			this->waitForPresent = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(this->logicalDevice, "vkWaitForPresentKHR");
+			this->presentWaitSupported = this->waitForPresent != nullptr;
+		}
+
+		if (this->dynamicRenderingEnabled)
+		{
+			this->cmdBeginRendering = (PFN_vkCmdBeginRenderingKHR)vkGetDeviceProcAddr(this->logicalDevice, "vkCmdBeginRenderingKHR");
+			this->cmdEndRendering = (PFN_vkCmdEndRenderingKHR)vkGetDeviceProcAddr(this->logicalDevice, "vkCmdEndRenderingKHR");
+		}
+
 		vkGetDeviceQueue(this->logicalDevice, indicies.graphicsFamily.value(), 0, &graphicsQueue);
 		vkGetDeviceQueue(this->logicalDevice, indicies.presentFamily.value(), 0, &presentQueue);
 	}
 
 	void cleanup()
 	{
-		vkDestroyImageView(this->logicalDevice, this->colorImageView, nullptr);
-
-		vkDestroyImage(this->logicalDevice, this->colorImage, nullptr);
-
-		vkFreeMemory(this->logicalDevice, this->colorImageMemory, nullptr);
+		// Retired swapchains and attachments are still queued for destruction; release them first.
+		this->frameScheduler.waitIdle();
 
 		this->cleanupSwapChain();
 
-		vkDestroySampler(this->logicalDevice, textureSampler, nullptr);
+		vkDestroySampler(this->logicalDevice, textureSampler, this->allocationCallbacks);
 
-		vkDestroyImageView(this->logicalDevice, this->textureImageView, nullptr);
+		vkDestroyImageView(this->logicalDevice, this->textureImageView, this->allocationCallbacks);
 
-		vkDestroyImage(this->logicalDevice, textureImage, nullptr);
+		vkDestroyImage(this->logicalDevice, textureImage, this->allocationCallbacks);
 
-		vkFreeMemory(this->logicalDevice, textureImageMemory, nullptr);
+		this->freeDeviceMemory(textureImageMemory);
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) 
+		for (size_t i = 0; i < this->settings.framesInFlight; i++) 
 		{
-			vkDestroyBuffer(this->logicalDevice, this->uniformBuffers[i], nullptr);
-			vkFreeMemory(this->logicalDevice, this->uniformBuffersMemory[i], nullptr);
+			vkDestroyBuffer(this->logicalDevice, this->uniformBuffers[i], this->allocationCallbacks);
+			this->freeDeviceMemory(this->uniformBuffersMemory[i]);
+			vkDestroyBuffer(this->logicalDevice, this->objectTransformBuffers[i], this->allocationCallbacks);
+			this->freeDeviceMemory(this->objectTransformBuffersMemory[i]);
 		}
 
-		vkDestroyDescriptorPool(this->logicalDevice, this->descriptorPool, nullptr);
+		this->destroyCullingResources();
+
+		vkDestroyDescriptorPool(this->logicalDevice, this->descriptorPool, this->allocationCallbacks);
+
+		vkDestroyDescriptorSetLayout(this->logicalDevice, this->descriptorSetLayout, this->allocationCallbacks);
+
+		vkDestroyBuffer(this->logicalDevice, this->indexBuffer, this->allocationCallbacks);
+
+		this->freeDeviceMemory(this->indexBufferMemory);
+
+		vkDestroyBuffer(this->logicalDevice, this->vertexBuffer, this->allocationCallbacks);
 
-		vkDestroyDescriptorSetLayout(this->logicalDevice, this->descriptorSetLayout, nullptr);
+		this->freeDeviceMemory(this->vertexBufferMemory);
 
-		vkDestroyBuffer(this->logicalDevice, this->indexBuffer, nullptr);
+		vkDestroyBuffer(this->logicalDevice, this->quantizedPositionBuffer, this->allocationCallbacks);
 
-		vkFreeMemory(this->logicalDevice, this->indexBufferMemory, nullptr);
+		this->freeDeviceMemory(this->quantizedPositionBufferMemory);
 
-		vkDestroyBuffer(this->logicalDevice, this->vertexBuffer, nullptr);
+		this->pipelineRegistry.destroy();
 
-		vkFreeMemory(this->logicalDevice, this->vertexBufferMemory, nullptr);
+		vkDestroyShaderModule(this->logicalDevice, this->vertShaderModule, this->allocationCallbacks);
+		vkDestroyShaderModule(this->logicalDevice, this->fragShaderModule, this->allocationCallbacks);
 
-		vkDestroyPipeline(this->logicalDevice, this->graphicsPipeline, nullptr);
+		if (!this->settings.pipelineCachePath.empty() && !this->pipelineCache.save())
+		{
+			Log::write(LogSeverity::Error, "Failed to write pipeline cache %s", this->pipelineCache.getPath().c_str());
+		}
+
+		this->pipelineCache.destroy();
+
+		vkDestroyPipelineLayout(this->logicalDevice, this->pipelineLayout, this->allocationCallbacks);
 
-		vkDestroyPipelineLayout(this->logicalDevice, this->pipelineLayout, nullptr);
+		vkDestroyRenderPass(this->logicalDevice, this->renderPass, this->allocationCallbacks);
 
-		vkDestroyRenderPass(this->logicalDevice, this->renderPass, nullptr);
+		vkDestroyRenderPass(this->logicalDevice, this->resumeRenderPass, this->allocationCallbacks);
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		for (size_t i = 0; i < this->imageAvailableSemaphores.size(); i++)
 		{
-			vkDestroySemaphore(this->logicalDevice, this->imageAvailableSemaphores[i], nullptr);
-			vkDestroySemaphore(this->logicalDevice, this->renderFinishedSemaphores[i], nullptr);
-			vkDestroyFence(this->logicalDevice, this->inFlightFences[i], nullptr);
+			vkDestroySemaphore(this->logicalDevice, this->imageAvailableSemaphores[i], this->allocationCallbacks);
+			vkDestroySemaphore(this->logicalDevice, this->renderFinishedSemaphores[i], this->allocationCallbacks);
 		}
+
+		this->frameScheduler.destroy();
+
+		this->gpuProfiler.destroy();
 		
-		vkDestroyCommandPool(this->logicalDevice, this->commandPool, nullptr);
+		vkDestroyCommandPool(this->logicalDevice, this->commandPool, this->allocationCallbacks);
+
+		for (auto pool : this->recordingCommandPools)
+		{
+			vkDestroyCommandPool(this->logicalDevice, pool, this->allocationCallbacks);
+		}
 
-		vkDestroyDevice(this->logicalDevice, nullptr);
+		vkDestroyDevice(this->logicalDevice, this->allocationCallbacks);
 
 		if (enableValidationLayers)
 		{
-			DestroyDebugUtilsMessengerEXT(this->instance, this->debugMessenger, nullptr);
+			DestroyDebugUtilsMessengerEXT(this->instance, this->debugMessenger, this->allocationCallbacks);
+		}
+
+		if (this->surface != nullptr)
+		{
+			vkDestroySurfaceKHR(this->instance, this->surface, this->allocationCallbacks);
 		}
 
-		vkDestroySurfaceKHR(this->instance, this->surface, nullptr);
+		vkDestroyInstance(this->instance, this->allocationCallbacks);
 
-		vkDestroyInstance(this->instance, nullptr);
+		this->hostAllocator.destroy();
 
-		glfwDestroyWindow(this->window);
+		if (this->window != nullptr)
+		{
+			glfwDestroyWindow(this->window);
+
+			glfwTerminate();
+		}
 
-		glfwTerminate();
+		this->jobSystem.stop();
 	}
 
 	void createInstance()
 	{
+		TRACE_FUNCTION();
+
 		if (enableValidationLayers && !this->checkValidationLayerSupport()) 
 		{
 			throw std::runtime_error("validation layers requested, but not available!");
@@ -509,7 +1372,7 @@ private:
 		appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.pEngineName = "No Engine";
 		appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+		appInfo.apiVersion = VK_API_VERSION_1_2;
 
 		VkInstanceCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -534,7 +1397,7 @@ private:
 			createInfo.pNext = nullptr;
 		}
 
-		if (vkCreateInstance(&createInfo, nullptr, &this->instance) != VK_SUCCESS)
+		if (vkCreateInstance(&createInfo, this->allocationCallbacks, &this->instance) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to create Vulkan instance!");
 		}
@@ -551,6 +1414,8 @@ private:
 
 	void setupDebugMessenger()
 	{
+		TRACE_FUNCTION();
+
 		if (!enableValidationLayers)
 		{
 			return;
@@ -559,7 +1424,7 @@ private:
 		VkDebugUtilsMessengerCreateInfoEXT createInfo;
 		this->populateDebugMessengerCreateInfo(createInfo);
 
-		if (CreateDebugUtilsMessengerEXT(this->instance, &createInfo, nullptr, &this->debugMessenger) != VK_SUCCESS) 
+		if (CreateDebugUtilsMessengerEXT(this->instance, &createInfo, this->allocationCallbacks, &this->debugMessenger) != VK_SUCCESS) 
 		{
 			throw std::runtime_error("failed to set up debug messenger!");
 		}
@@ -567,11 +1432,16 @@ private:
 
 	std::vector<const char*> getRequiredExtensions() 
 	{
-		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		std::vector<const char*> extensions;
+
+		if (!this->settings.headless)
+		{
+			uint32_t glfwExtensionCount = 0;
+			const char** glfwExtensions;
+			glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-		std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+			extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		}
 
 		if (enableValidationLayers) 
 		{
@@ -613,6 +1483,8 @@ private:
 
 	void pickPhysicalDevice()
 	{
+		TRACE_FUNCTION();
+
 		uint32_t deviceCount = 0;
 		vkEnumeratePhysicalDevices(this->instance, &deviceCount, nullptr);
 		if (deviceCount == 0)
@@ -623,54 +1495,65 @@ private:
 		std::vector<VkPhysicalDevice> devices(deviceCount);
 		vkEnumeratePhysicalDevices(this->instance, &deviceCount, devices.data());
 
-		// Use an ordered map to automatically sort candidates by increasing score.
-		std::multimap<int, VkPhysicalDevice> candidates;
+		// The formats the renderer creates images in, with what it uses them for.
+		std::vector<DeviceFormatRequirement> formats =
+		{
+			{ VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT },
+			{ VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT },
+			{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT }
+		};
+
+		DeviceSelector selector{};
+		selector.configure(this->allocationCallbacks, formats, this->settings.probeDevices, this->settings.deviceProbeCachePath);
+
+		std::vector<DeviceRanking> rankings = selector.rank(devices, [this](VkPhysicalDevice device) { return this->isDeviceSuitable(device); });
 
-		for (const auto& device : devices)
+		const DeviceRanking* selected = &rankings.front();
+
+		if (!this->settings.deviceOverride.empty())
 		{
-			if (isDeviceSuitable(device)) 
+			selected = DeviceSelector::findOverride(rankings, this->settings.deviceOverride);
+			if (selected == nullptr)
 			{
-				this->physicalDevice = device;
-				this->msaaSamples = getMaxUsableSampleCount();
-				break;
+				throw std::runtime_error("No GPU matches --device " + this->settings.deviceOverride + "!");
 			}
 		}
 
-		if (this->physicalDevice == VK_NULL_HANDLE) 
+		if (!selected->suitable)
 		{
-			throw std::runtime_error("Failed to find a suitable GPU!");
+			throw std::runtime_error(this->settings.deviceOverride.empty() ? "Failed to find a suitable GPU!" : "GPU " + selected->name + " does not meet the renderer's requirements!");
 		}
-	}
 
-	int rateDeviceSuitability(VkPhysicalDevice device)
-	{
-		if (device == VK_NULL_HANDLE)
+		if (rankings.size() > 1)
 		{
-			return 0;
-		}
+			for (const DeviceRanking& ranking : rankings)
+			{
+				std::ostringstream line;
+				line << (ranking.device == selected->device ? "* " : "  ") << ranking.index << ": " << ranking.name;
 
-		VkPhysicalDeviceProperties deviceProperties = {};
-		VkPhysicalDeviceFeatures deviceFeatures = {};
-		vkGetPhysicalDeviceProperties(device, &deviceProperties);
-		vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-		int score = 0;
+				if (!ranking.suitable)
+				{
+					line << " (unsuitable)";
+					Log::write(LogSeverity::Info, "%s", line.str().c_str());
+					continue;
+				}
 
-		// Discrete GPUs have a significant performance advantage.
-		if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
-		{
-			score += 1000;
-		}
+				line << ", score " << ranking.score << " (" << ranking.deviceLocalBytes / (1024 * 1024) << " MiB device local, "
+					<< ranking.supportedFormatCount << "/" << formats.size() << " formats"
+					<< (ranking.dedicatedTransferQueue ? ", transfer queue" : "") << (ranking.asyncComputeQueue ? ", async compute" : "");
 
-		// Maximum possible size of textures affects graphics quality.
-		score += deviceProperties.limits.maxImageDimension2D;
+				if (this->settings.probeDevices)
+				{
+					line << ", " << ranking.probeGigabytesPerSecond << " GB/s copy" << (ranking.probeCached ? " cached" : "");
+				}
 
-		// Application can't function without geometry shaders.
-		if (!deviceFeatures.geometryShader)
-		{
-			score = 0;
+				line << ")";
+				Log::write(LogSeverity::Info, "%s", line.str().c_str());
+			}
 		}
 
-		return score;
+		this->physicalDevice = selected->device;
+		this->msaaSamples = getMaxUsableSampleCount();
 	}
 
 	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device)
@@ -696,8 +1579,17 @@ private:
 				indicies.graphicsFamily = i;
 			}
 
+			// Headless, nothing is presented: the graphics family stands in for the present family.
 			VkBool32 presentSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, this->surface, &presentSupport);
+			if (this->surface == nullptr)
+			{
+				presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+			}
+			else
+			{
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, this->surface, &presentSupport);
+			}
+
 			if (presentSupport)
 			{
 				indicies.presentFamily = i;
@@ -719,8 +1611,8 @@ private:
 		QueueFamilyIndices indices = this->findQueueFamilies(device);
 
 		bool extensionsSupported = checkDeviceExtensionSupport(device);
-		bool swapChainAdequate = false;
-		if (extensionsSupported)
+		bool swapChainAdequate = this->settings.headless;
+		if (extensionsSupported && !this->settings.headless)
 		{
 			SwapChainSupportDetails swapChainSupport = querySwapChainSupportDetails(device);
 			swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
@@ -729,7 +1621,22 @@ private:
 		VkPhysicalDeviceFeatures supportedFeatures;
 		vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
-		return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(device, &properties);
+		if (properties.apiVersion < VK_API_VERSION_1_2)
+		{
+			return false;
+		}
+
+		VkPhysicalDeviceVulkan12Features vulkan12Features{};
+		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &vulkan12Features;
+		vkGetPhysicalDeviceFeatures2(device, &features2);
+
+		return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy && vulkan12Features.timelineSemaphore;
 	}
 
 	bool checkDeviceExtensionSupport(VkPhysicalDevice device)
@@ -740,7 +1647,8 @@ private:
 		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-		std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+		std::vector<const char*> extensions = this->getRequiredDeviceExtensions();
+		std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
 		for (const auto& extension : availableExtensions)
 		{
@@ -750,6 +1658,114 @@ private:
 		return requiredExtensions.empty();
 	}
 
+	std::vector<const char*> getRequiredDeviceExtensions() const
+	{
+		return this->settings.headless ? std::vector<const char*>{} : deviceExtensions;
+	}
+
+	bool checkPresentWaitSupport(VkPhysicalDevice device)
+	{
+		uint32_t extensionCount;
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+		std::set<std::string> requiredExtensions(presentWaitExtensions.begin(), presentWaitExtensions.end());
+
+		for (const auto& extension : availableExtensions)
+		{
+			requiredExtensions.erase(extension.extensionName);
+		}
+
+		if (!requiredExtensions.empty())
+		{
+			return false;
+		}
+
+		VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+		presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+
+		VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+		presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+		presentIdFeatures.pNext = &presentWaitFeatures;
+
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &presentIdFeatures;
+		vkGetPhysicalDeviceFeatures2(device, &features2);
+
+		return presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+	}
+
+	bool checkGpuDrivenSupport(VkPhysicalDevice device)
+	{
+		VkPhysicalDeviceVulkan12Features vulkan12Features{};
+		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &vulkan12Features;
+		vkGetPhysicalDeviceFeatures2(device, &features2);
+
+		// drawIndirectFirstInstance: each generated draw passes its object index as firstInstance.
+		return features2.features.multiDrawIndirect && features2.features.drawIndirectFirstInstance && vulkan12Features.drawIndirectCount;
+	}
+
+	// The pyramid is built by reading the (possibly multisampled) depth buffer in a compute shader and written
+	// as an array of R32_SFLOAT storage images, one per level.
+	bool checkOcclusionCullingSupport(VkPhysicalDevice device)
+	{
+		VkPhysicalDeviceFeatures features;
+		vkGetPhysicalDeviceFeatures(device, &features);
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(device, &properties);
+
+		VkFormatProperties depthProperties;
+		vkGetPhysicalDeviceFormatProperties(device, this->findDepthFormat(), &depthProperties);
+
+		VkFormatProperties pyramidProperties;
+		vkGetPhysicalDeviceFormatProperties(device, VK_FORMAT_R32_SFLOAT, &pyramidProperties);
+
+		return features.shaderStorageImageArrayDynamicIndexing
+			&& (properties.limits.sampledImageDepthSampleCounts & this->msaaSamples)
+			&& (depthProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)
+			&& (pyramidProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)
+			&& (pyramidProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+	}
+
+	bool checkDynamicRenderingSupport(VkPhysicalDevice device)
+	{
+		uint32_t extensionCount;
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+		std::set<std::string> requiredExtensions(dynamicRenderingExtensions.begin(), dynamicRenderingExtensions.end());
+
+		for (const auto& extension : availableExtensions)
+		{
+			requiredExtensions.erase(extension.extensionName);
+		}
+
+		if (!requiredExtensions.empty())
+		{
+			return false;
+		}
+
+		VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+		dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &dynamicRenderingFeatures;
+		vkGetPhysicalDeviceFeatures2(device, &features2);
+
+		return dynamicRenderingFeatures.dynamicRendering;
+	}
+
 	SwapChainSupportDetails querySwapChainSupportDetails(VkPhysicalDevice device)
 	{
 		SwapChainSupportDetails details{};
@@ -791,11 +1807,21 @@ private:
 
 	VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
 	{
-		for (const auto& availablePresentMode : availablePresentModes)
+		// Vsync and low-latency both need FIFO, which is always available; low-latency pacing then keeps
+		// the FIFO queue empty instead of letting frames wait in it.
+		if (this->settings.latencyMode != LatencyMode::Uncapped)
+		{
+			return VK_PRESENT_MODE_FIFO_KHR;
+		}
+
+		for (VkPresentModeKHR preferredMode : { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR })
 		{
-			if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+			for (const auto& availablePresentMode : availablePresentModes)
 			{
-				return availablePresentMode;
+				if (availablePresentMode == preferredMode)
+				{
+					return availablePresentMode;
+				}
 			}
 		}
 
@@ -823,8 +1849,13 @@ private:
 		}
 	}
 
+	// Builds the new swapchain from the old one without idling the device. The retired swapchain, its image
+	// views, framebuffers and attachments, and any command buffers recorded against them are handed to the
+	// frame scheduler and destroyed once every frame that could still reference them has completed.
 	void recreateSwapChain()
 	{
+		TRACE_FUNCTION();
+
 		int width = 0;
 		int height = 0;
 
@@ -836,38 +1867,143 @@ private:
 			glfwWaitEvents();
 		}
 
-		vkDeviceWaitIdle(this->logicalDevice);
+		auto recreateStart = std::chrono::high_resolution_clock::now();
 
-		this->cleanupSwapChain();
+		SwapChainResources retired = this->takeSwapChainResources();
 
-		this->createSwapChain();
+		this->createSwapChain(retired.swapChain);
 		this->createImageViews();
 		this->createColorResources();
 		this->createDepthResources();
+		this->createDepthPyramid();
+
+		auto framebufferStart = std::chrono::high_resolution_clock::now();
 		this->createFrameBuffers();
-	}
+		auto framebufferEnd = std::chrono::high_resolution_clock::now();
 
-	void cleanupSwapChain()
-	{
-		vkDestroyImageView(this->logicalDevice, this->depthImageView, nullptr);
-		vkDestroyImage(this->logicalDevice, this->depthImage, nullptr);
-		vkFreeMemory(this->logicalDevice, this->depthImageMemory, nullptr);
+		this->frameScheduler.deferDestroy([this, retired]()
+		{
+			this->destroySwapChainResources(retired);
+		});
+
+		// Every cached command buffer references the old framebuffers and extent.
+		if (this->commandBufferCache.size() != static_cast<size_t>(this->settings.framesInFlight) * this->swapChainImages.size())
+		{
+			this->retireCommandBuffers();
+			this->createCommandBuffers();
+		}
+		else
+		{
+			this->invalidateCommandBuffers();
+		}
+
+		auto recreateEnd = std::chrono::high_resolution_clock::now();
+
+		this->swapChainRecreateCount++;
+		this->swapChainRecreateMilliseconds += std::chrono::duration<double, std::milli>(recreateEnd - recreateStart).count();
+		this->framebufferRebuildMilliseconds += std::chrono::duration<double, std::milli>(framebufferEnd - framebufferStart).count();
+	}
+
+	// Moves the current swapchain and everything sized to it out of the application, leaving the members empty.
+	SwapChainResources takeSwapChainResources()
+	{
+		SwapChainResources resources{};
+		resources.swapChain = this->swapChain;
+		resources.imageViews = std::move(this->swapChainImageViews);
+
+		if (!this->offscreenImagesMemory.empty())
+		{
+			resources.offscreenImages = std::move(this->swapChainImages);
+			resources.offscreenImagesMemory = std::move(this->offscreenImagesMemory);
+			this->swapChainImages.clear();
+			this->offscreenImagesMemory.clear();
+		}
+
+		resources.framebuffers = std::move(this->swapChainFramebuffers);
+		resources.colorImage = this->colorImage;
+		resources.colorImageMemory = this->colorImageMemory;
+		resources.colorImageView = this->colorImageView;
+		resources.depthImage = this->depthImage;
+		resources.depthImageMemory = this->depthImageMemory;
+		resources.depthImageView = this->depthImageView;
+		resources.sceneImage = this->sceneImage;
+		resources.sceneImageMemory = this->sceneImageMemory;
+		resources.sceneImageView = this->sceneImageView;
+		resources.depthPyramid = std::move(this->depthPyramid);
+
+		this->swapChain = nullptr;
+		this->swapChainImageViews.clear();
+		this->swapChainFramebuffers.clear();
+		this->colorImage = nullptr;
+		this->colorImageMemory = nullptr;
+		this->colorImageView = nullptr;
+		this->depthImage = nullptr;
+		this->depthImageMemory = nullptr;
+		this->depthImageView = nullptr;
+		this->sceneImage = nullptr;
+		this->sceneImageMemory = nullptr;
+		this->sceneImageView = nullptr;
+		this->depthPyramid = DepthPyramid{};
+
+		return resources;
+	}
+
+	void destroySwapChainResources(const SwapChainResources& resources)
+	{
+		vkDestroyImageView(this->logicalDevice, resources.depthImageView, this->allocationCallbacks);
+		vkDestroyImage(this->logicalDevice, resources.depthImage, this->allocationCallbacks);
+		this->freeDeviceMemory(resources.depthImageMemory);
+
+		vkDestroyImageView(this->logicalDevice, resources.colorImageView, this->allocationCallbacks);
+		vkDestroyImage(this->logicalDevice, resources.colorImage, this->allocationCallbacks);
+		this->freeDeviceMemory(resources.colorImageMemory);
+
+		if (resources.sceneImage != nullptr)
+		{
+			vkDestroyImageView(this->logicalDevice, resources.sceneImageView, this->allocationCallbacks);
+			vkDestroyImage(this->logicalDevice, resources.sceneImage, this->allocationCallbacks);
+			this->freeDeviceMemory(resources.sceneImageMemory);
+		}
+
+		this->destroyDepthPyramid(resources.depthPyramid);
 
-		for (auto framebuffer : this->swapChainFramebuffers)
+		for (auto framebuffer : resources.framebuffers)
 		{
-			vkDestroyFramebuffer(this->logicalDevice, framebuffer, nullptr);
+			vkDestroyFramebuffer(this->logicalDevice, framebuffer, this->allocationCallbacks);
 		}
 
-		for (auto imageView : this->swapChainImageViews)
+		for (auto imageView : resources.imageViews)
 		{
-			vkDestroyImageView(this->logicalDevice, imageView, nullptr);
+			vkDestroyImageView(this->logicalDevice, imageView, this->allocationCallbacks);
 		}
 
-		vkDestroySwapchainKHR(this->logicalDevice, this->swapChain, nullptr);
+		for (size_t i = 0; i < resources.offscreenImages.size(); i++)
+		{
+			vkDestroyImage(this->logicalDevice, resources.offscreenImages[i], this->allocationCallbacks);
+			this->freeDeviceMemory(resources.offscreenImagesMemory[i]);
+		}
+
+		if (resources.swapChain != nullptr)
+		{
+			vkDestroySwapchainKHR(this->logicalDevice, resources.swapChain, this->allocationCallbacks);
+		}
+	}
+
+	void cleanupSwapChain()
+	{
+		this->destroySwapChainResources(this->takeSwapChainResources());
 	}
 
-	void createSwapChain()
+	void createSwapChain(VkSwapchainKHR oldSwapChain = nullptr)
 	{
+		TRACE_FUNCTION();
+
+		if (this->settings.headless)
+		{
+			this->createOffscreenImages();
+			return;
+		}
+
 		SwapChainSupportDetails swapChainSupport = querySwapChainSupportDetails(this->physicalDevice);
 
 		VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
@@ -891,6 +2027,11 @@ private:
 		createInfo.imageArrayLayers = 1;
 		createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
+		if (this->dynamicResolutionEnabled)
+		{
+			createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT; // The upscale blit writes the swapchain image.
+		}
+
 		QueueFamilyIndices indices = findQueueFamilies(this->physicalDevice);
 		uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
 
@@ -911,9 +2052,9 @@ private:
 		createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 		createInfo.presentMode = presentMode;
 		createInfo.clipped = VK_TRUE;
-		createInfo.oldSwapchain = VK_NULL_HANDLE;
+		createInfo.oldSwapchain = oldSwapChain; // Lets the presentation engine reuse the old images' memory.
 
-		if (vkCreateSwapchainKHR(this->logicalDevice, &createInfo, nullptr, &this->swapChain) != VK_SUCCESS)
+		if (vkCreateSwapchainKHR(this->logicalDevice, &createInfo, this->allocationCallbacks, &this->swapChain) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to create swap chain!");
 		}
@@ -923,6 +2064,40 @@ private:
 		vkGetSwapchainImagesKHR(this->logicalDevice, this->swapChain, &imageCount, this->swapChainImages.data());
 		this->swapChainImageFormat = surfaceFormat.format;
 		this->swapChainExtent = extent;
+		this->updateRenderExtent();
+		this->firstPresentOnSwapChain = this->frameScheduler.getFrameValue();
+	}
+
+	// Headless stand-in for the swapchain: one color image per frame slot, so a frame never writes an image
+	// a frame still in flight is using and drawFrame() needs no acquire. The images end each frame in
+	// getFinalColorLayout(), ready to be copied out.
+	void createOffscreenImages()
+	{
+		this->swapChainImageFormat = HEADLESS_COLOR_FORMAT;
+		this->swapChainExtent = { WIDTH, HEIGHT };
+		this->swapChainImages.resize(this->settings.framesInFlight);
+		this->offscreenImagesMemory.resize(this->settings.framesInFlight);
+
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		if (this->dynamicResolutionEnabled)
+		{
+			usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT; // The upscale blit writes the image.
+		}
+
+		for (size_t i = 0; i < this->swapChainImages.size(); i++)
+		{
+			this->createImage(WIDTH, HEIGHT, 1, VK_SAMPLE_COUNT_1_BIT, HEADLESS_COLOR_FORMAT, VK_IMAGE_TILING_OPTIMAL, usage,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->swapChainImages[i], this->offscreenImagesMemory[i]);
+		}
+
+		this->updateRenderExtent();
+	}
+
+	// Where the render pass or final barrier leaves the frame's color image: ready to present, or with
+	// --headless, where there is no presentation engine, ready to be read back.
+	VkImageLayout getFinalColorLayout() const
+	{
+		return this->settings.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 	}
 
 	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels)
@@ -939,7 +2114,7 @@ private:
 		viewInfo.subresourceRange.layerCount = 1;
 
 		VkImageView imageView;
-		if (vkCreateImageView(this->logicalDevice, &viewInfo, nullptr, &imageView) != VK_SUCCESS) 
+		if (vkCreateImageView(this->logicalDevice, &viewInfo, this->allocationCallbacks, &imageView) != VK_SUCCESS) 
 		{
 			throw std::runtime_error("Failed to create texture image view!");
 		}
@@ -949,6 +2124,8 @@ private:
 
 	void createImageViews() 
 	{
+		TRACE_FUNCTION();
+
 		this->swapChainImageViews.resize(this->swapChainImages.size());
 
 		for (uint32_t i = 0; i < this->swapChainImages.size(); i++) 
@@ -959,110 +2136,28 @@ private:
 
 	void createGraphicsPipeline()
 	{
-		auto vertShaderCode = this->readFile("src/shaders/vert.spv");
-		auto fragShaderCode = this->readFile("src/shaders/frag.spv");
+		TRACE_FUNCTION();
+
+		ShaderLibrary shaderLibrary(this->settings.shaderOverrideDirectory);
+		ShaderBinary vertShaderCode = shaderLibrary.loadShader(ShaderId::Vertex);
+		ShaderBinary fragShaderCode = shaderLibrary.loadShader(ShaderId::Fragment);
 
-		VkShaderModule vertShaderModule = this->createShaderModule(vertShaderCode);
-		VkShaderModule fragShaderModule = this->createShaderModule(fragShaderCode);
+		// Kept alive for the lifetime of the registry, which compiles permutations on demand.
+		this->vertShaderModule = this->createShaderModule(vertShaderCode);
+		this->fragShaderModule = this->createShaderModule(fragShaderCode);
 
 		VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
 		vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-		vertShaderStageInfo.module = vertShaderModule;
+		vertShaderStageInfo.module = this->vertShaderModule;
 		vertShaderStageInfo.pName = "main";
 
 		VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
 		fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		fragShaderStageInfo.module = fragShaderModule;
+		fragShaderStageInfo.module = this->fragShaderModule;
 		fragShaderStageInfo.pName = "main";
 
-		VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-		auto bindingDescription = Vertex::getBindingDescription();
-		auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputInfo.vertexBindingDescriptionCount = 1;
-		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = (float)this->swapChainExtent.width;
-		viewport.height = (float)this->swapChainExtent.height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		VkRect2D scissor{};
-		scissor.offset = { 0, 0 };
-		scissor.extent = swapChainExtent;
-
-		std::vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-		VkPipelineDynamicStateCreateInfo dynamicState{};
-		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-		dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-		dynamicState.pDynamicStates = dynamicStates.data();
-
-		VkPipelineViewportStateCreateInfo viewportState{};
-		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportState.viewportCount = 1;
-		viewportState.pViewports = &viewport;
-		viewportState.scissorCount = 1;
-		viewportState.pScissors = &scissor;
-
-		VkPipelineRasterizationStateCreateInfo rasterizer{};
-		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterizer.depthClampEnable = VK_FALSE;
-		rasterizer.rasterizerDiscardEnable = VK_FALSE;
-		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterizer.lineWidth = 1.0f;
-		rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-		rasterizer.depthBiasEnable = VK_FALSE;
-		rasterizer.depthBiasConstantFactor = 0.0f; // Optional
-		rasterizer.depthBiasClamp = 0.0f; // Optional
-		rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
-
-		VkPipelineMultisampleStateCreateInfo multisampling{};
-		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisampling.sampleShadingEnable = VK_TRUE;
-		multisampling.minSampleShading = 0.2f; // min fraction for sample shading; closer to one is smoother
-		multisampling.rasterizationSamples = this->msaaSamples;
-		multisampling.minSampleShading = 1.0f; // Optional
-		multisampling.pSampleMask = nullptr; // Optional
-		multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
-		multisampling.alphaToOneEnable = VK_FALSE; // Optional
-
-		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachment.blendEnable = VK_TRUE;
-		colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-		colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-		colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-		colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-		colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-		colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-		VkPipelineColorBlendStateCreateInfo colorBlending{};
-		colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		colorBlending.logicOpEnable = VK_FALSE;
-		colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-		colorBlending.attachmentCount = 1;
-		colorBlending.pAttachments = &colorBlendAttachment;
-		colorBlending.blendConstants[0] = 0.0f; // Optional
-		colorBlending.blendConstants[1] = 0.0f; // Optional
-		colorBlending.blendConstants[2] = 0.0f; // Optional
-		colorBlending.blendConstants[3] = 0.0f; // Optional
-
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		pipelineLayoutInfo.setLayoutCount = 1;
@@ -1070,57 +2165,195 @@ private:
 		pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
 		pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
 
-		if (vkCreatePipelineLayout(this->logicalDevice, &pipelineLayoutInfo, nullptr, &this->pipelineLayout) != VK_SUCCESS) 
+		if (vkCreatePipelineLayout(this->logicalDevice, &pipelineLayoutInfo, this->allocationCallbacks, &this->pipelineLayout) != VK_SUCCESS) 
 		{
 			throw std::runtime_error("Failed to create pipeline layout!");
 		}
 
-		VkPipelineDepthStencilStateCreateInfo depthStencil{};
-		depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		depthStencil.depthTestEnable = VK_TRUE;
-		depthStencil.depthWriteEnable = VK_TRUE;
-		depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-		depthStencil.depthBoundsTestEnable = VK_FALSE;
-		depthStencil.minDepthBounds = 0.0f; // Optional
-		depthStencil.maxDepthBounds = 1.0f; // Optional
-		depthStencil.stencilTestEnable = VK_FALSE;
-		depthStencil.front = {}; // Optional
-		depthStencil.back = {}; // Optional
-
-		VkGraphicsPipelineCreateInfo pipelineInfo{};
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;
-		pipelineInfo.pStages = shaderStages;
-		pipelineInfo.pVertexInputState = &vertexInputInfo;
-		pipelineInfo.pInputAssemblyState = &inputAssembly;
-		pipelineInfo.pViewportState = &viewportState;
-		pipelineInfo.pRasterizationState = &rasterizer;
-		pipelineInfo.pMultisampleState = &multisampling;
-		pipelineInfo.pDepthStencilState = &depthStencil;
-		pipelineInfo.pColorBlendState = &colorBlending;
-		pipelineInfo.pDynamicState = &dynamicState;
-		pipelineInfo.layout = this->pipelineLayout;
-		pipelineInfo.renderPass = this->renderPass;
-		pipelineInfo.subpass = 0;
-		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-		pipelineInfo.basePipelineIndex = -1; // Optional
-
-		if (vkCreateGraphicsPipelines(this->logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &this->graphicsPipeline) != VK_SUCCESS) 
-		{
-			throw std::runtime_error("Failed to create graphics pipeline!");
-		}
-
-		vkDestroyShaderModule(this->logicalDevice, vertShaderModule, nullptr);
-		vkDestroyShaderModule(this->logicalDevice, fragShaderModule, nullptr);
+		auto attributeDescriptions = Vertex::getAttributeDescriptions();
+
+		PipelineRegistryContext context{};
+		context.device = this->logicalDevice;
+		context.allocationCallbacks = this->allocationCallbacks;
+		context.pipelineCache = this->pipelineCache.get();
+		context.pipelineLayout = this->pipelineLayout;
+		context.renderPass = this->renderPass;
+		context.colorFormat = this->swapChainImageFormat;
+		context.depthFormat = this->findDepthFormat();
+		context.samples = this->msaaSamples;
+		context.fillModeNonSolid = this->fillModeNonSolidSupported;
+		context.shaderStages = { vertShaderStageInfo, fragShaderStageInfo };
+		context.vertexBinding = Vertex::getBindingDescription();
+		context.vertexAttributes.assign(attributeDescriptions.begin(), attributeDescriptions.end());
+		context.quantizedPositionBinding = QuantizedPosition::getBindingDescription();
+		context.quantizedPositionAttribute = QuantizedPosition::getAttributeDescription();
+		context.positionScale = this->positionScale;
+
+		this->activePipelineDesc.shaderFeatures = this->settings.shaderFeatures;
+
+		// The default state doubles as the fallback, so the first frame never waits on a compile.
+		this->pipelineRegistry.create(context, this->jobSystem, this->activePipelineDesc);
+
+		if (!this->settings.pipelineManifestPath.empty())
+		{
+			size_t count = this->pipelineRegistry.loadManifest(this->settings.pipelineManifestPath);
+			Log::write(LogSeverity::Info, "Precompiling %zu pipeline permutation(s) from %s", count, this->settings.pipelineManifestPath.c_str());
+		}
+	}
+
+	// Position-only permutation of the active pipeline: no fragment shader, no color writes.
+	PipelineStateDesc getDepthPrepassDesc() const
+	{
+		PipelineStateDesc desc = this->activePipelineDesc;
+		desc.shaderFeatures &= SHADER_FEATURE_QUANTIZED_POSITIONS; // Only the vertex stage runs.
+		desc.blendMode = BlendMode::Opaque;
+		desc.depthWrite = true;
+		desc.depthCompareOp = VK_COMPARE_OP_LESS;
+		desc.depthOnly = true;
+		return desc;
+	}
+
+	// The active pipeline after a depth prepass: depth is already final, so test for equality and don't write.
+	PipelineStateDesc getDepthEqualDesc() const
+	{
+		PipelineStateDesc desc = this->activePipelineDesc;
+		desc.depthWrite = false;
+		desc.depthCompareOp = VK_COMPARE_OP_EQUAL;
+		return desc;
+	}
+
+	// The prepass only pays off for opaque-style permutations that write depth.
+	bool isDepthPrepassApplicable() const
+	{
+		return this->activePipelineDesc.depthTest && this->activePipelineDesc.depthWrite && this->activePipelineDesc.blendMode != BlendMode::Additive;
+	}
+
+	// The prepass is only used once both of its pipelines are ready; with the fallback bound, an equal-depth
+	// pass would reject everything.
+	bool shouldUseDepthPrepass()
+	{
+		if (!this->depthPrepassEnabled || !this->isDepthPrepassApplicable())
+		{
+			return false;
+		}
+
+		PipelineStateDesc prepassDesc = this->getDepthPrepassDesc();
+		PipelineStateDesc equalDesc = this->getDepthEqualDesc();
+		this->pipelineRegistry.request(prepassDesc);
+		this->pipelineRegistry.request(equalDesc);
+
+		return this->pipelineRegistry.isReady(prepassDesc) && this->pipelineRegistry.isReady(equalDesc);
+	}
+
+	void configureDepthPrepass()
+	{
+		TRACE_FUNCTION();
+
+		this->depthPrepassEnabled = this->settings.depthPrepass == DepthPrepassMode::On;
+
+		if (this->settings.depthPrepass == DepthPrepassMode::Auto && !this->gpuProfiler.hasTimestamps())
+		{
+			Log::write(LogSeverity::Warning, "Depth prepass: timestamps are unsupported, so auto mode can't measure; leaving it off.");
+			this->depthPrepassTrial.decided = true;
+		}
+	}
+
+	// Auto mode: averages the GPU time of MEASURED_FRAMES frames without the prepass, then with it, and keeps
+	// the prepass only if it is at least 5% faster. Frames recorded before a switch are skipped.
+	void updateDepthPrepassTrial(uint64_t frame, double gpuMilliseconds, uint64_t currentFrame)
+	{
+		DepthPrepassTrial& trial = this->depthPrepassTrial;
+
+		if (this->settings.depthPrepass != DepthPrepassMode::Auto || trial.decided || gpuMilliseconds < 0.0)
+		{
+			return;
+		}
+
+		if (trial.phase == 1 && !this->shouldUseDepthPrepass())
+		{
+			// The active permutation doesn't write depth, e.g. after cycling to the additive one, so the
+			// prepass is never recorded and phase 1 could never be measured.
+			if (!this->isDepthPrepassApplicable())
+			{
+				trial.decided = true;
+				this->depthPrepassEnabled = false;
+				this->invalidateCommandBuffers();
+
+				Log::write(LogSeverity::Warning, "Depth prepass: the active pipeline doesn't write depth, so auto mode can't measure; leaving it off.");
+				return;
+			}
+
+			// Phase 1 starts counting once the prepass pipelines have compiled and are actually recorded.
+			trial.phaseStartFrame = currentFrame;
+			return;
+		}
+
+		if (frame < trial.phaseStartFrame + DepthPrepassTrial::WARMUP_FRAMES)
+		{
+			return;
+		}
+
+		trial.gpuMilliseconds[trial.phase] += gpuMilliseconds;
+		if (++trial.samples[trial.phase] < DepthPrepassTrial::MEASURED_FRAMES)
+		{
+			return;
+		}
+
+		if (trial.phase == 0)
+		{
+			trial.phase = 1;
+			trial.phaseStartFrame = currentFrame;
+			this->depthPrepassEnabled = true;
+			this->invalidateCommandBuffers();
+			return;
+		}
+
+		double withoutPrepass = trial.gpuMilliseconds[0] / trial.samples[0];
+		double withPrepass = trial.gpuMilliseconds[1] / trial.samples[1];
+
+		trial.decided = true;
+		this->depthPrepassEnabled = withPrepass < withoutPrepass * 0.95;
+		this->invalidateCommandBuffers();
+
+		Log::write(LogSeverity::Info, "Depth prepass: %.3f ms GPU without, %.3f ms with; %s", withoutPrepass, withPrepass, this->depthPrepassEnabled ? "enabled" : "disabled");
+	}
+
+	// Switches the scene to the next pipeline permutation. Until the permutation finishes compiling in the
+	// background, draws keep using the fallback pipeline.
+	void cyclePipelineVariant()
+	{
+		std::vector<PipelineStateDesc> variants(3);
+		for (auto& variant : variants)
+		{
+			variant.shaderFeatures = this->settings.shaderFeatures;
+		}
+
+		variants[1].blendMode = BlendMode::Opaque;
+		variants[1].cullMode = VK_CULL_MODE_NONE;
+		variants[2].polygonMode = this->fillModeNonSolidSupported ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
+		variants[2].blendMode = BlendMode::Additive;
+
+		this->pipelineVariantIndex = (this->pipelineVariantIndex + 1) % variants.size();
+		this->activePipelineDesc = variants[this->pipelineVariantIndex];
+		this->invalidateCommandBuffers();
+
+		Log::write(LogSeverity::Info, "Pipeline: %s%s", this->activePipelineDesc.toString().c_str(), this->pipelineRegistry.isReady(this->activePipelineDesc) ? "" : " (compiling)");
 	}
 
 	void createRenderPass()
 	{
+		TRACE_FUNCTION();
+
+		if (this->dynamicRenderingEnabled)
+		{
+			return; // Attachments are described at record time instead.
+		}
+
 		VkAttachmentDescription depthAttachment{};
 		depthAttachment.format = this->findDepthFormat();
 		depthAttachment.samples = this->msaaSamples;
 		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.storeOp = this->occlusionCullingEnabled ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE; // The depth pyramid is built from it.
 		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -1134,7 +2367,12 @@ private:
 		colorAttachment.format = this->swapChainImageFormat;
 		colorAttachment.samples = this->msaaSamples;
 		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE; // Resolved into attachment 2 at the end of the subpass.
+
+		if (this->occlusionCullingEnabled)
+		{
+			colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE; // Rendering resumes on top of it after the pyramid build.
+		}
 		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -1152,18 +2390,27 @@ private:
 		colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		colorAttachmentResolve.finalLayout = this->dynamicResolutionEnabled ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : this->getFinalColorLayout();
 
 		VkAttachmentReference colorAttachmentResolveRef{};
 		colorAttachmentResolveRef.attachment = 2;
 		colorAttachmentResolveRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+		// Single-sampled, there is nothing to resolve: render straight into the target, as the dynamic
+		// rendering path does, with the resolve attachment's store op and final layout.
+		bool multisampled = this->msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+		if (!multisampled)
+		{
+			colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			colorAttachment.finalLayout = this->occlusionCullingEnabled ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : colorAttachmentResolve.finalLayout;
+		}
+
 		VkSubpassDescription subpass{};
 		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 		subpass.colorAttachmentCount = 1;
 		subpass.pColorAttachments = &colorAttachmentRef;
 		subpass.pDepthStencilAttachment = &depthAttachmentRef;
-		subpass.pResolveAttachments = &colorAttachmentResolveRef;
+		subpass.pResolveAttachments = multisampled ? &colorAttachmentResolveRef : nullptr;
 
 		VkSubpassDependency dependency{};
 		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
@@ -1176,14 +2423,40 @@ private:
 		std::array<VkAttachmentDescription, 3> attachments = { colorAttachment, depthAttachment, colorAttachmentResolve };
 		VkRenderPassCreateInfo renderPassInfo{};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassInfo.attachmentCount = multisampled ? 3 : 2;
 		renderPassInfo.pAttachments = attachments.data();
 		renderPassInfo.subpassCount = 1;
 		renderPassInfo.pSubpasses = &subpass;
 		renderPassInfo.dependencyCount = 1;
 		renderPassInfo.pDependencies = &dependency;
 
-		if (vkCreateRenderPass(this->logicalDevice, &renderPassInfo, nullptr, &this->renderPass) != VK_SUCCESS) 
+		if (vkCreateRenderPass(this->logicalDevice, &renderPassInfo, this->allocationCallbacks, &this->renderPass) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("Failed to create render pass!");
+		}
+
+		if (!this->occlusionCullingEnabled)
+		{
+			return;
+		}
+
+		// Draws the objects the rebuilt pyramid revealed on top of what the first render pass left. Only load
+		// and store ops and layouts differ, so it stays compatible with the pipelines and framebuffers. The
+		// resolve target is written again in full, so its earlier contents are discarded. Single-sampled, the
+		// color attachment is the target itself and is stored again.
+		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[0].storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		attachments[0].finalLayout = multisampled ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : colorAttachmentResolve.finalLayout;
+		attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependency.dstStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependency.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+
+		if (vkCreateRenderPass(this->logicalDevice, &renderPassInfo, this->allocationCallbacks, &this->resumeRenderPass) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to create render pass!");
 		}
@@ -1191,22 +2464,35 @@ private:
 
 	void createFrameBuffers()
 	{
+		TRACE_FUNCTION();
+
+		if (this->dynamicRenderingEnabled)
+		{
+			return; // Image views are bound directly by vkCmdBeginRenderingKHR.
+		}
+
 		this->swapChainFramebuffers.resize(this->swapChainImageViews.size());
 
 		for (size_t i = 0; i < this->swapChainImageViews.size(); i++) 
 		{
-			std::array<VkImageView, 3> attachments = { this->colorImageView, depthImageView, swapChainImageViews[i]};
+			// Single-sampled, the render pass draws into the target directly and has no resolve attachment.
+			std::array<VkImageView, 3> attachments = { this->colorImageView, depthImageView, this->getSceneTargetView(static_cast<uint32_t>(i)) };
+			bool multisampled = this->msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+			if (!multisampled)
+			{
+				attachments[0] = attachments[2];
+			}
 
 			VkFramebufferCreateInfo framebufferInfo{};
 			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 			framebufferInfo.renderPass = this->renderPass;
-			framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+			framebufferInfo.attachmentCount = multisampled ? 3 : 2;
 			framebufferInfo.pAttachments = attachments.data();
 			framebufferInfo.width = this->swapChainExtent.width;
 			framebufferInfo.height = this->swapChainExtent.height;
 			framebufferInfo.layers = 1;
 
-			if (vkCreateFramebuffer(this->logicalDevice, &framebufferInfo, nullptr, &this->swapChainFramebuffers[i]) != VK_SUCCESS) 
+			if (vkCreateFramebuffer(this->logicalDevice, &framebufferInfo, this->allocationCallbacks, &this->swapChainFramebuffers[i]) != VK_SUCCESS) 
 			{
 				throw std::runtime_error("Failed to create framebuffer!");
 			}
@@ -1215,6 +2501,8 @@ private:
 
 	void createCommandPool()
 	{
+		TRACE_FUNCTION();
+
 		QueueFamilyIndices queueFamilyIndices = findQueueFamilies(this->physicalDevice);
 
 		VkCommandPoolCreateInfo poolInfo{};
@@ -1222,373 +2510,2473 @@ private:
 		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
 
-		if (vkCreateCommandPool(this->logicalDevice, &poolInfo, nullptr, &this->commandPool) != VK_SUCCESS) 
+		if (vkCreateCommandPool(this->logicalDevice, &poolInfo, this->allocationCallbacks, &this->commandPool) != VK_SUCCESS) 
 		{
 			throw std::runtime_error("Failed to create command pool!");
 		}
 	}
 
-	void createCommandBuffers()
+	void createRecordingCommandPools()
 	{
-		this->commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+		TRACE_FUNCTION();
 
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.commandPool = commandPool;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandBufferCount = (uint32_t)this->commandBuffers.size();
+		this->recordingThreadCount = this->settings.recordingThreadCount;
+		if (this->recordingThreadCount == 0)
+		{
+			this->recordingThreadCount = this->jobSystem.getWorkerCount();
+		}
+
+		if (!this->settings.parallelRecording && !this->settings.benchmarkRecording)
+		{
+			this->recordingThreadCount = 0;
+			return;
+		}
+
+		QueueFamilyIndices queueFamilyIndices = findQueueFamilies(this->physicalDevice);
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		// A pool per draw range rather than per thread: jobs may run on any worker, but each range is
+		// recorded by exactly one job at a time, which is all the pool's external synchronization needs.
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // Cached secondaries are re-recorded individually.
+		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
 
-		if (vkAllocateCommandBuffers(this->logicalDevice, &allocInfo, this->commandBuffers.data()) != VK_SUCCESS) 
+		this->recordingCommandPools.resize(static_cast<size_t>(this->settings.framesInFlight) * this->recordingThreadCount);
+
+		for (auto& pool : this->recordingCommandPools)
 		{
-			throw std::runtime_error("Failed to allocate command buffers!");
+			if (vkCreateCommandPool(this->logicalDevice, &poolInfo, this->allocationCallbacks, &pool) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create recording command pool!");
+			}
 		}
 	}
 
-	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+	void createCommandBuffers()
 	{
-		std::array<VkClearValue, 2> clearValues{};
-		clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
-		clearValues[1].depthStencil = { 1.0f, 0 };
+		TRACE_FUNCTION();
 
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		size_t imageCount = this->swapChainImages.size();
+		this->commandBufferCache.resize(static_cast<size_t>(this->settings.framesInFlight) * imageCount);
 
-		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) 
+		for (size_t frame = 0; frame < this->settings.framesInFlight; frame++)
 		{
-			throw std::runtime_error("Failed to begin recording command buffer!");
+			for (size_t image = 0; image < imageCount; image++)
+			{
+				CachedCommandBuffer& cached = this->commandBufferCache[frame * imageCount + image];
+
+				VkCommandBufferAllocateInfo allocInfo{};
+				allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+				allocInfo.commandPool = commandPool;
+				allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+				allocInfo.commandBufferCount = 1;
+
+				if (vkAllocateCommandBuffers(this->logicalDevice, &allocInfo, &cached.primary) != VK_SUCCESS) 
+				{
+					throw std::runtime_error("Failed to allocate command buffers!");
+				}
+
+				// A secondary per recording thread, allocated from that thread's pool for this frame slot.
+				cached.secondaries.resize(this->recordingThreadCount);
+				for (uint32_t thread = 0; thread < this->recordingThreadCount; thread++)
+				{
+					allocInfo.commandPool = this->recordingCommandPools[frame * this->recordingThreadCount + thread];
+					allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+					if (vkAllocateCommandBuffers(this->logicalDevice, &allocInfo, &cached.secondaries[thread]) != VK_SUCCESS)
+					{
+						throw std::runtime_error("Failed to allocate secondary command buffers!");
+					}
+				}
+
+				cached.valid = false;
+			}
 		}
+	}
+
+	// Hands the cached command buffers to the frame scheduler, which frees them once their frames complete.
+	void retireCommandBuffers()
+	{
+		this->frameScheduler.deferDestroy([this, retired = std::move(this->commandBufferCache)]()
+		{
+			size_t imageCount = retired.size() / this->settings.framesInFlight;
+
+			for (size_t i = 0; i < retired.size(); i++)
+			{
+				const CachedCommandBuffer& cached = retired[i];
+				vkFreeCommandBuffers(this->logicalDevice, this->commandPool, 1, &cached.primary);
+
+				size_t frame = i / imageCount;
+				for (uint32_t thread = 0; thread < cached.secondaries.size(); thread++)
+				{
+					vkFreeCommandBuffers(this->logicalDevice, this->recordingCommandPools[frame * this->recordingThreadCount + thread], 1, &cached.secondaries[thread]);
+				}
+			}
+		});
 
-		VkRenderPassBeginInfo renderPassInfo{};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = this->renderPass;
-		renderPassInfo.framebuffer = this->swapChainFramebuffers[imageIndex];
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = this->swapChainExtent;
+		this->commandBufferCache.clear();
+	}
 
-		VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-		renderPassInfo.pClearValues = clearValues.data();
+	// Forces every cached command buffer to be re-recorded the next time its frame slot and image come up.
+	// Call after anything baked into the recorded commands changes: framebuffers, extent, pipeline or draw stream.
+	void invalidateCommandBuffers()
+	{
+		for (auto& cached : this->commandBufferCache)
+		{
+			cached.valid = false;
+		}
+	}
 
-		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	CachedCommandBuffer& getCachedCommandBuffer(uint32_t frame, uint32_t imageIndex)
+	{
+		return this->commandBufferCache[frame * this->swapChainImages.size() + imageIndex];
+	}
 
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->graphicsPipeline);
+	void recordDrawState(VkCommandBuffer commandBuffer)
+	{
+		PipelineStateDesc desc = this->recordingDepthPrepass ? this->getDepthPrepassDesc() : this->activePipelineDesc;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineRegistry.get(desc));
 
 		VkViewport viewport{};
 		viewport.x = 0.0f;
 		viewport.y = 0.0f;
-		viewport.width = (float)this->swapChainExtent.width;
-		viewport.height = (float)this->swapChainExtent.height;
+		viewport.width = (float)this->renderExtent.width;
+		viewport.height = (float)this->renderExtent.height;
 		viewport.minDepth = 0.0f;
 		viewport.maxDepth = 1.0f;
 		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
 		VkRect2D scissor{};
 		scissor.offset = { 0, 0 };
-		scissor.extent = this->swapChainExtent;
+		scissor.extent = this->renderExtent;
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		VkBuffer vertexBuffers[] = { vertexBuffer };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+		// Binding 1 is only read by quantized-position pipelines; binding it unconditionally keeps the
+		// fallback and the requested permutation interchangeable.
+		VkBuffer vertexBuffers[] = { this->vertexBuffer, this->quantizedPositionBuffer };
+		VkDeviceSize offsets[] = { 0, 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
 
 		vkCmdBindIndexBuffer(commandBuffer, this->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineLayout, 0, 1, &this->descriptorSets[this->currentFrame], 0, nullptr);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineLayout, 0, 1, &this->descriptorSets[this->frameScheduler.getFrameSlot()], 0, nullptr);
+	}
 
-		vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(this->indices.size()), 1, 0, 0, 0);
+	void recordDraws(VkCommandBuffer commandBuffer, size_t firstDraw, size_t drawCount)
+	{
+		auto drawRange = [&]()
+		{
+			if (this->gpuDrivenEnabled)
+			{
+				// The culling pass wrote the draws and their count; the CPU cost is the same for any scene.
+				// With occlusion culling, each phase has its own list and count.
+				uint32_t frameSlot = this->frameScheduler.getFrameSlot();
+				uint32_t objectCount = static_cast<uint32_t>(this->scene.size());
+				VkDeviceSize drawOffset = sizeof(VkDrawIndexedIndirectCommand) * objectCount * this->recordingCullPhase;
+				VkDeviceSize countOffset = sizeof(uint32_t) * this->recordingCullPhase;
+				vkCmdDrawIndexedIndirectCount(commandBuffer, this->indirectDrawBuffers[frameSlot], drawOffset, this->drawCountBuffers[frameSlot], countOffset,
+					objectCount, sizeof(VkDrawIndexedIndirectCommand));
+				return;
+			}
 
-		vkCmdEndRenderPass(commandBuffer);
+			const std::vector<MeshComponent>& meshes = this->scene.getMeshes();
+			const std::vector<uint8_t>& visibility = this->scene.getVisibility();
 
-		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) 
+			for (size_t i = firstDraw; i < firstDraw + drawCount; i++)
+			{
+				if (this->settings.cpuCulling && !visibility[i])
+				{
+					continue;
+				}
+
+				// The instance index selects the entity's model matrix in shader.vert.
+				vkCmdDrawIndexed(commandBuffer, meshes[i].indexCount, 1, meshes[i].firstIndex, meshes[i].vertexOffset, static_cast<uint32_t>(i));
+			}
+		};
+
+		drawRange();
+
+		if (this->recordingDepthPrepass)
 		{
-			throw std::runtime_error("Failed to record command buffer!");
+			// recordDrawState() bound the depth-only pipeline; draw the range again, shading only the
+			// fragments whose depth matches what the prepass left behind. With parallel recording each
+			// secondary does this for its own range, so overdraw between ranges is not removed.
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineRegistry.get(this->getDepthEqualDesc()));
+			drawRange();
 		}
 	}
 
-	void drawFrame()
+	// Clears the frame slot's counters, runs cull.comp over every object, and makes the generated draws
+	// visible to the indirect draw. Recorded outside the render pass. With occlusion culling this is the early
+	// phase, which tests against the pyramid left by the previous frame.
+	void recordCulling(VkCommandBuffer commandBuffer)
 	{
-		vkWaitForFences(this->logicalDevice, 1, &this->inFlightFences[this->currentFrame], VK_TRUE, UINT64_MAX);
+		uint32_t frameSlot = this->frameScheduler.getFrameSlot();
 
-		uint32_t imageIndex = 0;
-		VkResult result = vkAcquireNextImageKHR(this->logicalDevice, this->swapChain, UINT64_MAX, this->imageAvailableSemaphores[this->currentFrame], VK_NULL_HANDLE, &imageIndex);
+		// The previous use of this slot's buffers was an indirect read and the counter copy by the frame
+		// framesInFlight ago.
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 
-		if (result == VK_ERROR_OUT_OF_DATE_KHR)
-		{
-			this->recreateSwapChain();
-			return;
-		}
-		else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
-		{
-			throw std::runtime_error("Failed to acquire swap chain image!");
-		}
+		vkCmdFillBuffer(commandBuffer, this->drawCountBuffers[frameSlot], 0, sizeof(CullCounters), 0);
 
-		this->updateUniformBuffer(this->currentFrame);
+		// Also orders this frame's pyramid reads after the previous frame's pyramid build.
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 
-		// Only reset the fence if we are submitting work.
-		vkResetFences(this->logicalDevice, 1, &this->inFlightFences[this->currentFrame]);
+		this->recordCullDispatch(commandBuffer, 0);
 
-		vkResetCommandBuffer(this->commandBuffers[this->currentFrame], 0);
-		recordCommandBuffer(this->commandBuffers[this->currentFrame], imageIndex);
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
 
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	void recordCullDispatch(VkCommandBuffer commandBuffer, uint32_t phase)
+	{
+		uint32_t frameSlot = this->frameScheduler.getFrameSlot();
+		std::array<uint32_t, 2> pushConstants = { static_cast<uint32_t>(this->scene.size()), phase };
 
-		VkSemaphore waitSemaphores[] = { this->imageAvailableSemaphores[this->currentFrame]};
-		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		submitInfo.waitSemaphoreCount = 1;
-		submitInfo.pWaitSemaphores = waitSemaphores;
-		submitInfo.pWaitDstStageMask = waitStages;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &this->commandBuffers[this->currentFrame];
-		VkSemaphore signalSemaphores[] = { this->renderFinishedSemaphores[this->currentFrame]};
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = signalSemaphores;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->cullPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->cullPipelineLayout, 0, 1, &this->cullDescriptorSets[frameSlot], 0, nullptr);
 
-		if (vkQueueSubmit(this->graphicsQueue, 1, &submitInfo, this->inFlightFences[this->currentFrame]) != VK_SUCCESS)
+		if (this->occlusionCullingEnabled)
 		{
-			throw std::runtime_error("Failed to submit draw command buffer!");
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->cullPipelineLayout, 1, 1, &this->depthPyramid.cullDescriptorSet, 0, nullptr);
 		}
 
-		VkPresentInfoKHR presentInfo{};
-		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-		presentInfo.waitSemaphoreCount = 1;
-		presentInfo.pWaitSemaphores = signalSemaphores;
+		vkCmdPushConstants(commandBuffer, this->cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), pushConstants.data());
+		vkCmdDispatch(commandBuffer, (pushConstants[0] + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+	}
 
-		VkSwapchainKHR swapChains[] = { this->swapChain };
-		presentInfo.swapchainCount = 1;
+	// The late phase of occlusion culling, recorded between the two halves of the frame's rendering: builds
+	// the depth pyramid from what the early phase drew, then retests the objects the early phase rejected.
+	// Leaves the depth buffer ready for the render pass to resume.
+	void recordLateCulling(VkCommandBuffer commandBuffer)
+	{
+		VkFormat depthFormat = this->findDepthFormat();
+
+		VkImageMemoryBarrier depthBarrier{};
+		depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		depthBarrier.image = this->depthImage;
+		depthBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | (this->hasStencilComponent(depthFormat) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+		depthBarrier.subresourceRange.levelCount = 1;
+		depthBarrier.subresourceRange.layerCount = 1;
+		depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		// The pyramid was last read by this frame's early phase.
+		VkMemoryBarrier memoryBarrier{};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = 0;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 1, &depthBarrier);
+
+		// Only the rendered region of the depth buffer is reduced, so dynamic resolution gets a pyramid of its own size.
+		uint32_t levelZeroWidth = (this->renderExtent.width + 1) / 2;
+		uint32_t levelZeroHeight = (this->renderExtent.height + 1) / 2;
+		uint32_t groupCountX = (levelZeroWidth + HIZ_TILE_SIZE - 1) / HIZ_TILE_SIZE;
+		uint32_t groupCountY = (levelZeroHeight + HIZ_TILE_SIZE - 1) / HIZ_TILE_SIZE;
+
+		std::array<uint32_t, 4> pushConstants =
+		{
+			this->renderExtent.width,
+			this->renderExtent.height,
+			std::min(getDepthPyramidLevelCount(this->renderExtent), this->depthPyramid.levelCount),
+			groupCountX * groupCountY
+		};
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->depthPyramidPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->depthPyramidPipelineLayout, 0, 1, &this->depthPyramid.buildDescriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, this->depthPyramidPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), pushConstants.data());
+		vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		this->recordCullDispatch(commandBuffer, 1);
+
+		depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthBarrier.srcAccessMask = 0;
+		depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			0, 1, &memoryBarrier, 0, nullptr, 1, &depthBarrier);
+	}
+
+	// Copies the frame slot's culling counters where collectFrameTimings() can read them once the frame completes.
+	void recordCullCounterReadback(VkCommandBuffer commandBuffer)
+	{
+		uint32_t frameSlot = this->frameScheduler.getFrameSlot();
+
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		VkBufferCopy copyRegion{};
+		copyRegion.size = sizeof(CullCounters);
+		vkCmdCopyBuffer(commandBuffer, this->drawCountBuffers[frameSlot], this->cullCounterReadbackBuffers[frameSlot], 1, &copyRegion);
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	void recordSecondaryCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, size_t firstDraw, size_t drawCount)
+	{
+		VkFormat colorFormat = this->swapChainImageFormat;
+
+		VkCommandBufferInheritanceRenderingInfoKHR inheritanceRenderingInfo{};
+		inheritanceRenderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO_KHR;
+		inheritanceRenderingInfo.colorAttachmentCount = 1;
+		inheritanceRenderingInfo.pColorAttachmentFormats = &colorFormat;
+		inheritanceRenderingInfo.depthAttachmentFormat = this->findDepthFormat();
+		inheritanceRenderingInfo.rasterizationSamples = this->msaaSamples;
+
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.pipelineStatistics = this->gpuProfiler.getPipelineStatistics();
+
+		if (this->dynamicRenderingEnabled)
+		{
+			inheritanceInfo.pNext = &inheritanceRenderingInfo;
+		}
+		else
+		{
+			inheritanceInfo.renderPass = this->renderPass;
+			inheritanceInfo.subpass = 0;
+			inheritanceInfo.framebuffer = this->swapChainFramebuffers[imageIndex];
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to begin recording secondary command buffer!");
+		}
+
+		this->recordDrawState(commandBuffer);
+		this->recordDraws(commandBuffer, firstDraw, drawCount);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to record secondary command buffer!");
+		}
+	}
+
+	// Splits the draw stream into contiguous ranges and records each range into its own secondary command
+	// buffer as a job-system task. Returns the number of secondary buffers that were recorded.
+	uint32_t recordSecondaryCommandBuffers(CachedCommandBuffer& cached, uint32_t imageIndex, uint32_t threadCount)
+	{
+		size_t drawTotal = this->scene.size();
+		uint32_t taskCount = static_cast<uint32_t>(std::min<size_t>({ threadCount, drawTotal, cached.secondaries.size() }));
+
+		this->jobSystem.parallelFor(taskCount, 1, [&](size_t range, size_t, uint32_t)
+		{
+			size_t firstDraw = drawTotal * range / taskCount;
+			size_t lastDraw = drawTotal * (range + 1) / taskCount;
+
+			TRACE_SCOPE("Record secondary");
+			vkResetCommandBuffer(cached.secondaries[range], 0);
+			this->recordSecondaryCommandBuffer(cached.secondaries[range], imageIndex, firstDraw, lastDraw - firstDraw);
+		});
+
+		return taskCount;
+	}
+
+	// Begins the render pass, or dynamic rendering, on the current targets. resume continues on top of the
+	// color and depth a suspended endRendering() left behind, for the late phase of occlusion culling.
+	void beginRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, const std::array<VkClearValue, 2>& clearValues, bool secondaryContents, bool resume = false)
+	{
+		if (this->dynamicResolutionEnabled && !resume)
+		{
+			// The scene target is shared by every frame; don't overwrite it while the previous frame's upscale
+			// blit may still be reading it.
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+		}
+
+		if (!this->dynamicRenderingEnabled)
+		{
+			VkRenderPassBeginInfo renderPassInfo{};
+			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			renderPassInfo.renderPass = resume ? this->resumeRenderPass : this->renderPass;
+			renderPassInfo.framebuffer = this->swapChainFramebuffers[imageIndex];
+			renderPassInfo.renderArea.offset = { 0, 0 };
+			renderPassInfo.renderArea.extent = this->renderExtent;
+			renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+			renderPassInfo.pClearValues = clearValues.data();
+
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, secondaryContents ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+			return;
+		}
+
+		// Without a render pass the layout transitions are ours. Previous contents are never needed: color
+		// and depth are cleared, and the swapchain image (or scene target) is fully overwritten by the resolve.
+		// When resuming, everything is still in the attachment layouts the first half left it in.
+		bool multisampled = this->msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+		VkFormat depthFormat = this->findDepthFormat();
+
+		if (!resume)
+		{
+			this->recordAttachmentBarriers(commandBuffer, imageIndex, depthFormat);
+		}
+
+		// Multisampled: render into the MSAA target and resolve into the swapchain image, as the render pass
+		// path does. Single-sampled: render into the swapchain image directly.
+		VkRenderingAttachmentInfoKHR colorAttachment{};
+		colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+		colorAttachment.imageView = multisampled ? this->colorImageView : this->getSceneTargetView(imageIndex);
+		colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colorAttachment.resolveMode = multisampled ? VK_RESOLVE_MODE_AVERAGE_BIT : VK_RESOLVE_MODE_NONE;
+		colorAttachment.resolveImageView = multisampled ? this->getSceneTargetView(imageIndex) : nullptr;
+		colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colorAttachment.loadOp = resume ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.storeOp = multisampled && (resume || !this->occlusionCullingEnabled) ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.clearValue = clearValues[0];
+
+		// With occlusion culling the depth pyramid is built from the first half's depth.
+		VkRenderingAttachmentInfoKHR depthAttachment{};
+		depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+		depthAttachment.imageView = this->depthImageView;
+		depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthAttachment.loadOp = resume ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = this->occlusionCullingEnabled && !resume ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.clearValue = clearValues[1];
+
+		VkRenderingInfoKHR renderingInfo{};
+		renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+		renderingInfo.flags = secondaryContents ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT_KHR : 0;
+		renderingInfo.renderArea.offset = { 0, 0 };
+		renderingInfo.renderArea.extent = this->renderExtent;
+		renderingInfo.layerCount = 1;
+		renderingInfo.colorAttachmentCount = 1;
+		renderingInfo.pColorAttachments = &colorAttachment;
+		renderingInfo.pDepthAttachment = &depthAttachment;
+
+		this->cmdBeginRendering(commandBuffer, &renderingInfo);
+	}
+
+	// Dynamic rendering: moves this frame's attachments into their attachment layouts.
+	void recordAttachmentBarriers(VkCommandBuffer commandBuffer, uint32_t imageIndex, VkFormat depthFormat)
+	{
+		std::array<VkImageMemoryBarrier, 3> barriers{};
+		for (auto& barrier : barriers)
+		{
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.subresourceRange.levelCount = 1;
+			barrier.subresourceRange.layerCount = 1;
+		}
+
+		barriers[0].image = this->getSceneTarget(imageIndex);
+		barriers[0].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		barriers[0].srcAccessMask = 0;
+		barriers[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+		barriers[1].image = this->colorImage;
+		barriers[1].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		barriers[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barriers[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barriers[1].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+		barriers[2].image = this->depthImage;
+		barriers[2].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		barriers[2].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barriers[2].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barriers[2].subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | (this->hasStencilComponent(depthFormat) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+			0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+	}
+
+	// suspend only ends the pass, leaving the attachments for a later beginRendering(..., true).
+	void endRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool suspend = false)
+	{
+		if (!this->dynamicRenderingEnabled)
+		{
+			vkCmdEndRenderPass(commandBuffer);
+		}
+		else
+		{
+			this->cmdEndRendering(commandBuffer);
+		}
+
+		if (suspend)
+		{
+			return;
+		}
+
+		if (this->dynamicResolutionEnabled)
+		{
+			uint32_t upscaleScope = this->gpuProfiler.beginScope(commandBuffer, "Upscale");
+			this->recordUpscale(commandBuffer, imageIndex);
+			this->gpuProfiler.endScope(commandBuffer, upscaleScope);
+			return;
+		}
+
+		if (!this->dynamicRenderingEnabled)
+		{
+			return; // The render pass leaves the swapchain image in getFinalColorLayout().
+		}
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		barrier.newLayout = this->getFinalColorLayout();
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = this->swapChainImages[imageIndex];
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	// The image the frame's color ends up in before presentation: the scene target with dynamic resolution,
+	// otherwise the swapchain image itself.
+	VkImage getSceneTarget(uint32_t imageIndex) const
+	{
+		return this->dynamicResolutionEnabled ? this->sceneImage : this->swapChainImages[imageIndex];
+	}
+
+	VkImageView getSceneTargetView(uint32_t imageIndex) const
+	{
+		return this->dynamicResolutionEnabled ? this->sceneImageView : this->swapChainImageViews[imageIndex];
+	}
+
+	// Upscales the rendered region of the scene target to the whole swapchain image and leaves the image ready
+	// to present. Both render paths end with the scene target in VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL.
+	void recordUpscale(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+	{
+		std::array<VkImageMemoryBarrier, 2> barriers{};
+		for (auto& barrier : barriers)
+		{
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			barrier.subresourceRange.levelCount = 1;
+			barrier.subresourceRange.layerCount = 1;
+		}
+
+		barriers[0].image = this->sceneImage;
+		barriers[0].oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		// The source stage chains with the acquire semaphore wait, which is at color attachment output.
+		barriers[1].image = this->swapChainImages[imageIndex];
+		barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barriers[1].srcAccessMask = 0;
+		barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+		VkImageBlit blit{};
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { static_cast<int32_t>(this->renderExtent.width), static_cast<int32_t>(this->renderExtent.height), 1 };
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = 0;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = { static_cast<int32_t>(this->swapChainExtent.width), static_cast<int32_t>(this->swapChainExtent.height), 1 };
+		blit.dstSubresource = blit.srcSubresource;
+
+		vkCmdBlitImage(commandBuffer, this->sceneImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, this->swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+		VkImageMemoryBarrier presentBarrier = barriers[1];
+		presentBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		presentBarrier.newLayout = this->getFinalColorLayout();
+		presentBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		presentBarrier.dstAccessMask = 0;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &presentBarrier);
+	}
+
+	// threadCount == 0 records every draw inline into the primary command buffer.
+	void recordCommandBuffer(CachedCommandBuffer& cached, uint32_t imageIndex, uint32_t threadCount)
+	{
+		TRACE_FUNCTION();
+
+		VkCommandBuffer commandBuffer = cached.primary;
+
+		std::array<VkClearValue, 2> clearValues{};
+		clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("Failed to begin recording command buffer!");
+		}
+
+		this->gpuProfiler.beginFrame(commandBuffer, this->frameScheduler.getFrameSlot());
+
+		this->recordingDepthPrepass = this->shouldUseDepthPrepass();
+		this->recordingCullPhase = 0;
+
+		if (this->gpuDrivenEnabled)
+		{
+			uint32_t cullScope = this->gpuProfiler.beginScope(commandBuffer, "Culling");
+			this->recordCulling(commandBuffer);
+			this->gpuProfiler.endScope(commandBuffer, cullScope);
+			threadCount = 0; // A single indirect draw covers the scene; there is nothing to split.
+		}
+
+		// Scopes can't go inside the pass: with secondaries it may only execute them.
+		uint32_t sceneScope = this->gpuProfiler.beginScope(commandBuffer, "Scene");
+		this->beginRendering(commandBuffer, imageIndex, clearValues, threadCount > 0);
+
+		if (threadCount > 0)
+		{
+			uint32_t secondaryCount = this->recordSecondaryCommandBuffers(cached, imageIndex, threadCount);
+			if (secondaryCount > 0)
+			{
+				vkCmdExecuteCommands(commandBuffer, secondaryCount, cached.secondaries.data());
+			}
+		}
+		else
+		{
+			this->recordDrawState(commandBuffer);
+			this->recordDraws(commandBuffer, 0, this->scene.size());
+		}
+
+		if (this->occlusionCullingEnabled)
+		{
+			// Draw what the rebuilt pyramid reveals on top of the first half's color and depth.
+			this->endRendering(commandBuffer, imageIndex, true);
+			this->gpuProfiler.endScope(commandBuffer, sceneScope);
+
+			uint32_t lateCullScope = this->gpuProfiler.beginScope(commandBuffer, "Depth pyramid and late culling");
+			this->recordLateCulling(commandBuffer);
+			this->gpuProfiler.endScope(commandBuffer, lateCullScope);
+
+			sceneScope = this->gpuProfiler.beginScope(commandBuffer, "Late scene");
+			this->recordingCullPhase = 1;
+			this->beginRendering(commandBuffer, imageIndex, clearValues, false, true);
+			this->recordDrawState(commandBuffer);
+			this->recordDraws(commandBuffer, 0, this->scene.size());
+		}
+
+		this->endRendering(commandBuffer, imageIndex);
+		this->gpuProfiler.endScope(commandBuffer, sceneScope);
+
+		if (this->gpuDrivenEnabled)
+		{
+			this->recordCullCounterReadback(commandBuffer);
+		}
+
+		this->gpuProfiler.endFrame(commandBuffer);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("Failed to record command buffer!");
+		}
+
+		this->commandBufferRecordCount++;
+	}
+
+	// Records the frame's command buffer repeatedly (without submitting it) using the serial path and
+	// the parallel path at increasing thread counts, and prints the average CPU recording time of each.
+	void benchmarkRecording()
+	{
+		std::vector<uint32_t> threadCounts = { 0 };
+		for (uint32_t threads = 1; threads < this->recordingThreadCount; threads *= 2)
+		{
+			threadCounts.push_back(threads);
+		}
+		threadCounts.push_back(this->recordingThreadCount);
+
+		CachedCommandBuffer& cached = this->getCachedCommandBuffer(this->frameScheduler.getFrameSlot(), 0);
+		double serialMilliseconds = 0.0;
+
+		Log::write(LogSeverity::Info, "Recording benchmark: %zu draws, %u iterations", this->scene.size(), this->settings.benchmarkIterations);
+
+		for (uint32_t threads : threadCounts)
+		{
+			// Warm up the pools so the first allocation does not skew the timing.
+			vkResetCommandBuffer(cached.primary, 0);
+			this->recordCommandBuffer(cached, 0, threads);
+
+			auto startTime = std::chrono::high_resolution_clock::now();
+
+			for (uint32_t i = 0; i < this->settings.benchmarkIterations; i++)
+			{
+				vkResetCommandBuffer(cached.primary, 0);
+				this->recordCommandBuffer(cached, 0, threads);
+			}
+
+			auto endTime = std::chrono::high_resolution_clock::now();
+			double milliseconds = std::chrono::duration<double, std::milli>(endTime - startTime).count() / this->settings.benchmarkIterations;
+
+			if (threads == 0)
+			{
+				serialMilliseconds = milliseconds;
+				Log::write(LogSeverity::Info, "\tserial:     %.3f ms", milliseconds);
+			}
+			else
+			{
+				Log::write(LogSeverity::Info, "\t%u thread(s): %.3f ms (%.2fx)", threads, milliseconds, serialMilliseconds / milliseconds);
+			}
+		}
+
+		this->invalidateCommandBuffers();
+	}
+
+	// Runs a synthetic transform workload through parallelFor with 1..N workers and prints the speedup.
+	void benchmarkJobSystem()
+	{
+		const size_t itemCount = 1 << 20;
+		const size_t grainSize = 1024;
+		uint32_t maxWorkers = this->settings.workerThreadCount != 0 ? this->settings.workerThreadCount : std::max(1u, std::thread::hardware_concurrency());
+		uint32_t iterations = std::max(1u, this->settings.benchmarkIterations / 50);
+
+		std::vector<glm::mat4> results(itemCount);
+		double singleWorkerMilliseconds = 0.0;
+
+		Log::write(LogSeverity::Info, "Job system benchmark: %zu transforms, grain %zu, %u iterations", itemCount, grainSize, iterations);
+
+		for (uint32_t workers = 1; workers <= maxWorkers; workers = workers < maxWorkers ? std::min(workers * 2, maxWorkers) : workers + 1)
+		{
+			JobSystem jobs{};
+			jobs.start(workers);
+
+			auto body = [&](size_t begin, size_t end, uint32_t)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					float angle = static_cast<float>(i) * 0.001f;
+					glm::mat4 model = glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 0.0f, 1.0f));
+					results[i] = glm::translate(model, glm::vec3(angle, 0.0f, 0.0f)) * glm::inverse(model);
+				}
+			};
+
+			jobs.parallelFor(itemCount, grainSize, body); // Warm up.
+
+			auto startTime = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < iterations; i++)
+			{
+				jobs.parallelFor(itemCount, grainSize, body);
+			}
+			auto endTime = std::chrono::high_resolution_clock::now();
+
+			jobs.stop();
+
+			double milliseconds = std::chrono::duration<double, std::milli>(endTime - startTime).count() / iterations;
+			if (workers == 1)
+			{
+				singleWorkerMilliseconds = milliseconds;
+			}
+
+			Log::write(LogSeverity::Info, "\t%u worker(s): %.3f ms (%.2fx)", workers, milliseconds, singleWorkerMilliseconds / milliseconds);
+		}
+	}
+
+	// Microbenchmarks of the CPU-side asset and frame work, then end-to-end headless frames, printed and
+	// written as JSON so runs can be diffed between commits. Runs headless, so software drivers will do.
+	void runBenchmarkSuite()
+	{
+		const uint32_t warmupFrames = 60; // Lets the pipeline registry, caches and frame pacing settle.
+
+		BenchmarkSuite suite{};
+
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+
+		suite.setContext("device", properties.deviceName);
+		suite.setContext("driverVersion", std::to_string(properties.driverVersion));
+		suite.setContext("build", enableValidationLayers ? "debug" : "release");
+		suite.setContext("extent", std::to_string(this->swapChainExtent.width) + "x" + std::to_string(this->swapChainExtent.height));
+		suite.setContext("framesInFlight", std::to_string(this->settings.framesInFlight));
+		suite.setContext("msaaSamples", std::to_string(static_cast<uint32_t>(this->msaaSamples)));
+		suite.setContext("draws", std::to_string(this->scene.size()));
+
+		Log::write(LogSeverity::Info, "Benchmark suite on %s:", properties.deviceName);
+
+		suite.run("Parse OBJ", []()
+		{
+			tinyobj::attrib_t attrib;
+			std::vector<tinyobj::shape_t> shapes;
+			parseObj(MODEL_PATH, attrib, shapes);
+			BenchmarkSuite::keep(shapes.data());
+		});
+
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		parseObj(MODEL_PATH, attrib, shapes);
+
+		suite.run("Deduplicate vertices", [&]()
+		{
+			std::vector<Vertex> vertices;
+			std::vector<uint32_t> indices;
+			deduplicateVertices(attrib, shapes, vertices, indices);
+			BenchmarkSuite::keep(vertices.data());
+		});
+
+		suite.run("Decode texture", []()
+		{
+			int texWidth = 0;
+			int texHeight = 0;
+			int texChannels = 0;
+
+			stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+			if (!pixels)
+			{
+				throw std::runtime_error("Failed to load texture image");
+			}
+
+			BenchmarkSuite::keep(pixels);
+			stbi_image_free(pixels);
+		});
+
+		// A different transform every call, as the simulation produces.
+		uint32_t step = 0;
+		suite.run("Uniform matrices", [&]()
+		{
+			float angle = static_cast<float>(step++) * 0.001f;
+
+			TransformState transform{};
+			transform.position = glm::vec3(std::sin(angle), 0.0f, 0.0f);
+			transform.rotation = glm::angleAxis(angle, glm::vec3(0.0f, 0.0f, 1.0f));
+
+			UniformBufferObject ubo = computeUniforms(transform, this->swapChainExtent);
+			BenchmarkSuite::keep(&ubo, sizeof(ubo));
+		});
+
+		// The visibility system over a large scene: a grid of entities reusing the model's meshes, culled
+		// against a camera that turns a little every call so the visible set keeps changing.
+		Scene benchmarkScene;
+		const std::vector<MeshComponent>& meshes = this->scene.getMeshes();
+		const std::vector<BoundsComponent>& bounds = this->scene.getBounds();
+		const uint32_t gridSize = 320;
+
+		for (uint32_t i = 0; i < gridSize * gridSize && !meshes.empty(); i++)
+		{
+			TransformComponent transform{};
+			transform.position = glm::vec3(static_cast<float>(i % gridSize) - gridSize * 0.5f, static_cast<float>(i / gridSize) - gridSize * 0.5f, 0.0f) * 2.0f;
+			benchmarkScene.create(transform, meshes[i % meshes.size()], MaterialComponent{}, bounds[i % bounds.size()]);
+		}
+
+		suite.run("Scene visibility (" + std::to_string(benchmarkScene.size()) + " entities)", [&]()
+		{
+			float angle = static_cast<float>(step++) * 0.001f;
+
+			TransformState transform{};
+			transform.rotation = glm::angleAxis(angle, glm::vec3(0.0f, 0.0f, 1.0f));
+
+			UniformBufferObject ubo = computeUniforms(transform, this->swapChainExtent);
+			benchmarkScene.updateVisibility(ubo.proj * ubo.view * ubo.model, &this->jobSystem);
+			BenchmarkSuite::keep(&benchmarkScene);
+		});
+
+		// Frames can't be repeated in a tight loop, so each drawFrame() is one sample. Once the frame slots
+		// are full, a call includes the wait for the GPU, so the samples are the steady-state frame time.
+		this->simulation.start(this->settings.simulationRate, this->settings.simulationLoadMilliseconds);
+
+		for (uint32_t i = 0; i < warmupFrames; i++)
+		{
+			this->drawFrame();
+		}
+
+		std::vector<double> frameMilliseconds;
+		frameMilliseconds.reserve(this->settings.headlessFrameCount);
+
+		for (uint32_t i = 0; i < this->settings.headlessFrameCount; i++)
+		{
+			auto frameStart = std::chrono::high_resolution_clock::now();
+			this->drawFrame();
+			auto frameEnd = std::chrono::high_resolution_clock::now();
+
+			frameMilliseconds.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+		}
+
+		vkDeviceWaitIdle(this->logicalDevice);
+		this->simulation.stop();
+
+		suite.addSamples("Headless frame", warmupFrames, std::move(frameMilliseconds));
+		suite.print();
+
+		if (suite.writeJson(this->settings.benchmarkSuitePath))
+		{
+			Log::write(LogSeverity::Info, "Wrote benchmark results to %s", this->settings.benchmarkSuitePath.c_str());
+		}
+		else
+		{
+			Log::write(LogSeverity::Error, "Failed to write benchmark results %s", this->settings.benchmarkSuitePath.c_str());
+		}
+	}
+
+	// Resize storm: alternates the window between two sizes, forcing a swapchain recreation and a frame
+	// after each change, and reports the average cost of the recreation for the active render path.
+	void benchmarkResize()
+	{
+		const int sizes[2][2] = { { static_cast<int>(WIDTH), static_cast<int>(HEIGHT) }, { static_cast<int>(WIDTH) + 160, static_cast<int>(HEIGHT) + 120 } };
+		uint32_t iterations = this->settings.benchmarkIterations;
+
+		this->drawFrame(); // Warm up.
+		this->swapChainRecreateCount = 0;
+		this->swapChainRecreateMilliseconds = 0.0;
+		this->framebufferRebuildMilliseconds = 0.0;
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+
+		for (uint32_t i = 0; i < iterations && !glfwWindowShouldClose(this->window); i++)
+		{
+			glfwSetWindowSize(this->window, sizes[(i + 1) % 2][0], sizes[(i + 1) % 2][1]);
+			glfwPollEvents();
+
+			this->framebufferResized = false;
+			this->recreateSwapChain();
+			this->drawFrame();
+		}
+
+		vkDeviceWaitIdle(this->logicalDevice);
+		auto endTime = std::chrono::high_resolution_clock::now();
+
+		uint64_t count = std::max<uint64_t>(1, this->swapChainRecreateCount);
+
+		Log::write(LogSeverity::Info, "Resize benchmark (%s): %llu recreation(s), %.3f ms average recreation, %.3f ms of it framebuffers, %.3f ms per resize and frame",
+			this->dynamicRenderingEnabled ? "dynamic rendering" : "render pass", static_cast<unsigned long long>(this->swapChainRecreateCount),
+			this->swapChainRecreateMilliseconds / count, this->framebufferRebuildMilliseconds / count,
+			std::chrono::duration<double, std::milli>(endTime - startTime).count() / std::max(1u, iterations));
+	}
+
+	// Resize soak: alternates the window between two sizes soakResizeCount times, drawing a frame after each
+	// recreation, and fails if device memory in use differs from the baseline. Checkpoints drain the
+	// deferred destruction queue first, so only memory that was never released shows up as growth.
+	void soakResize()
+	{
+		const int sizes[2][2] = { { static_cast<int>(WIDTH), static_cast<int>(HEIGHT) }, { static_cast<int>(WIDTH) + 160, static_cast<int>(HEIGHT) + 120 } };
+		const uint32_t checkpointInterval = 1000;
+
+		// An even count ends at the starting size, where the baseline was taken.
+		uint32_t iterations = this->settings.soakResizeCount + this->settings.soakResizeCount % 2;
+
+		glfwSetWindowSize(this->window, sizes[0][0], sizes[0][1]);
+		glfwPollEvents();
+		this->recreateSwapChain();
+		this->drawFrame();
+
+		this->frameScheduler.waitIdle();
+		VkDeviceSize baseline = this->deviceMemoryInUse;
+		this->deviceMemoryPeak = baseline;
+
+		Log::write(LogSeverity::Info, "Resize soak: %u resizes, %llu KiB of device memory in use", iterations, static_cast<unsigned long long>(baseline / 1024));
+
+		for (uint32_t i = 1; i <= iterations && !glfwWindowShouldClose(this->window); i++)
+		{
+			glfwSetWindowSize(this->window, sizes[i % 2][0], sizes[i % 2][1]);
+			glfwPollEvents();
+
+			this->framebufferResized = false;
+			this->recreateSwapChain();
+			this->drawFrame();
+
+			if (i % checkpointInterval == 0 || i == iterations)
+			{
+				this->frameScheduler.waitIdle();
+
+				Log::write(LogSeverity::Info, "  %u resizes: %llu KiB in use, %llu KiB peak, %zu allocations", i, static_cast<unsigned long long>(this->deviceMemoryInUse / 1024),
+					static_cast<unsigned long long>(this->deviceMemoryPeak / 1024), this->deviceMemoryAllocations.size());
+			}
+		}
+
+		this->frameScheduler.waitIdle();
+
+		if (glfwWindowShouldClose(this->window))
+		{
+			return; // Interrupted, possibly at the other size.
+		}
+
+		if (this->deviceMemoryInUse != baseline)
+		{
+			throw std::runtime_error("Resize soak leaked device memory: " + std::to_string(baseline) + " bytes before, " + std::to_string(this->deviceMemoryInUse) + " bytes after!");
+		}
+	}
+
+	// Per-frame work as a task graph: the uniform update and command recording are independent and run
+	// concurrently; submission waits for both. Recording fans out further when parallel recording is on.
+	void createFrameTaskGraph()
+	{
+		TRACE_FUNCTION();
+
+		auto updateScene = this->frameTaskGraph.addTask("update scene", [this]()
+		{
+			TRACE_SCOPE("Update scene");
+			this->updateScene();
+		});
+
+		auto updateUniforms = this->frameTaskGraph.addTask("update uniforms", [this]()
+		{
+			TRACE_SCOPE("Update uniforms");
+			this->updateUniformBuffer(this->frameScheduler.getFrameSlot());
+		});
+
+		auto recordCommands = this->frameTaskGraph.addTask("record commands", [this]()
+		{
+			TRACE_SCOPE("Record commands");
+
+			// The draw stream is static, so a command buffer recorded for this frame slot and image can be
+			// resubmitted as-is; per-frame data reaches the GPU through the mapped uniform buffers.
+			CachedCommandBuffer& cached = this->getCachedCommandBuffer(this->frameScheduler.getFrameSlot(), this->frameImageIndex);
+			if (!cached.valid || !this->settings.commandBufferCache)
+			{
+				vkResetCommandBuffer(cached.primary, 0);
+				this->recordCommandBuffer(cached, this->frameImageIndex, this->settings.parallelRecording ? this->recordingThreadCount : 0);
+				cached.valid = true;
+			}
+		});
+
+		auto submit = this->frameTaskGraph.addTask("submit", [this]()
+		{
+			TRACE_SCOPE("Submit");
+			this->submitFrame();
+		});
+
+		this->frameTaskGraph.addDependency(updateScene, updateUniforms);
+		this->frameTaskGraph.addDependency(updateScene, recordCommands);
+		this->frameTaskGraph.addDependency(updateUniforms, submit);
+		this->frameTaskGraph.addDependency(recordCommands, submit);
+	}
+
+	void submitFrame()
+	{
+		uint32_t frameSlot = this->frameScheduler.getFrameSlot();
+		CachedCommandBuffer& cached = this->getCachedCommandBuffer(frameSlot, this->frameImageIndex);
+
+		// The swapchain semaphores stay binary; the timeline semaphore signals this frame's value on completion.
+		// Headless frames have no image to wait for and nothing to present, so they only signal the timeline.
+		uint32_t swapChainSemaphoreCount = this->settings.headless ? 0 : 1;
+		uint64_t waitValues[] = { 0 };
+		uint64_t signalValues[] = { this->frameScheduler.getFrameValue(), 0 };
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.waitSemaphoreValueCount = swapChainSemaphoreCount;
+		timelineInfo.pWaitSemaphoreValues = waitValues;
+		timelineInfo.signalSemaphoreValueCount = 1 + swapChainSemaphoreCount;
+		timelineInfo.pSignalSemaphoreValues = signalValues;
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+
+		VkSemaphore waitSemaphores[] = { nullptr };
+		VkSemaphore signalSemaphores[] = { this->frameScheduler.getTimelineSemaphore(), nullptr };
+
+		if (!this->settings.headless)
+		{
+			waitSemaphores[0] = this->imageAvailableSemaphores[frameSlot];
+			signalSemaphores[1] = this->renderFinishedSemaphores[frameSlot];
+		}
+
+		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+		submitInfo.waitSemaphoreCount = swapChainSemaphoreCount;
+		submitInfo.pWaitSemaphores = waitSemaphores;
+		submitInfo.pWaitDstStageMask = waitStages;
+
+		// A new depth pyramid is initialized by the first frame that uses it.
+		std::array<VkCommandBuffer, 2> commandBuffers = { cached.primary };
+		submitInfo.commandBufferCount = 1;
+
+		if (this->depthPyramidInitCommandBuffer != nullptr)
+		{
+			commandBuffers = { this->depthPyramidInitCommandBuffer, cached.primary };
+			submitInfo.commandBufferCount = 2;
+
+			this->frameScheduler.deferDestroy([this, commandBuffer = this->depthPyramidInitCommandBuffer]()
+			{
+				vkFreeCommandBuffers(this->logicalDevice, this->commandPool, 1, &commandBuffer);
+			});
+			this->depthPyramidInitCommandBuffer = nullptr;
+		}
+
+		submitInfo.pCommandBuffers = commandBuffers.data();
+		submitInfo.signalSemaphoreCount = 1 + swapChainSemaphoreCount;
+		submitInfo.pSignalSemaphores = signalSemaphores;
+
+		if (vkQueueSubmit(this->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to submit draw command buffer!");
+		}
+	}
+
+	void drawFrame()
+	{
+		TRACE_FUNCTION();
+
+		{
+			TRACE_SCOPE("Wait for frame slot");
+			this->frameScheduler.beginFrame();
+		}
+
+		this->hostAllocator.beginFrame();
+
+		uint32_t frameSlot = this->frameScheduler.getFrameSlot();
+		uint64_t frameValue = this->frameScheduler.getFrameValue();
+
+		this->collectFrameTimings(frameValue);
+
+		if (this->settings.latencyMode == LatencyMode::LowLatency)
+		{
+			// Keep at most one frame queued: wait for the previous frame to reach the display, then sleep
+			// until the latest start time that still makes the next vblank.
+			TRACE_SCOPE("Frame pacing");
+			this->waitForPreviousPresent();
+			this->framePacer.waitForFrameStart();
+		}
+
+		this->framePacer.beginFrame(frameValue);
+
+		// Headless, each frame slot renders into its own offscreen image.
+		uint32_t imageIndex = frameSlot;
+		VkResult result = VK_SUCCESS;
+		if (!this->settings.headless)
+		{
+			TRACE_SCOPE("Acquire");
+			result = vkAcquireNextImageKHR(this->logicalDevice, this->swapChain, UINT64_MAX, this->imageAvailableSemaphores[frameSlot], VK_NULL_HANDLE, &imageIndex);
+		}
+
+		if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			this->recreateSwapChain();
+			return;
+		}
+		else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+		{
+			throw std::runtime_error("Failed to acquire swap chain image!");
+		}
+
+		// A permutation finished compiling; re-record so cached command buffers stop binding the fallback.
+		uint64_t pipelineGeneration = this->pipelineRegistry.getReadyGeneration();
+		if (pipelineGeneration != this->pipelineReadyGeneration)
+		{
+			this->pipelineReadyGeneration = pipelineGeneration;
+			this->invalidateCommandBuffers();
+		}
+
+		this->frameImageIndex = imageIndex;
+		this->jobSystem.run(this->frameTaskGraph);
+
+		if (this->settings.logTaskGraph && this->frameCount % 120 == 0)
+		{
+			// One message, so the report's lines stay together.
+			std::ostringstream timings;
+			this->frameTaskGraph.printTimings(timings);
+			std::string text = timings.str();
+			Log::write(LogSeverity::Info, "%.*s", static_cast<int>(text.size() - 1), text.c_str()); // Without the final newline.
+		}
+
+		this->frameScheduler.endFrame();
+		this->framePacer.frameSubmitted(frameValue);
+		this->pendingPresents.push_back(frameValue);
+
+		if (this->settings.headless)
+		{
+			this->frameCount++;
+			return; // The frame stays in its offscreen image.
+		}
+
+		VkPresentInfoKHR presentInfo{};
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		presentInfo.waitSemaphoreCount = 1;
+		presentInfo.pWaitSemaphores = &this->renderFinishedSemaphores[frameSlot];
+
+		VkSwapchainKHR swapChains[] = { this->swapChain };
+		presentInfo.swapchainCount = 1;
 		presentInfo.pSwapchains = swapChains;
 		presentInfo.pImageIndices = &imageIndex;
 		presentInfo.pResults = nullptr; // Optional
 
-		result = vkQueuePresentKHR(this->presentQueue, &presentInfo);
+		VkPresentIdKHR presentId{};
+		presentId.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+		presentId.swapchainCount = 1;
+		presentId.pPresentIds = &frameValue;
+
+		if (this->presentWaitSupported)
+		{
+			presentInfo.pNext = &presentId;
+		}
+
+		{
+			TRACE_SCOPE("Present");
+			result = vkQueuePresentKHR(this->presentQueue, &presentInfo);
+		}
+
+		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || this->framebufferResized) 
+		{
+			this->framebufferResized = false;
+			this->recreateSwapChain();
+		}
+		else if (result != VK_SUCCESS) 
+		{
+			throw std::runtime_error("Failed to present swap chain image!");
+		}
+
+		this->frameCount++;
+	}
+
+	void createGpuProfiler()
+	{
+		TRACE_FUNCTION();
+
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(this->physicalDevice, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(this->physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+		QueueFamilyIndices indices = this->findQueueFamilies(this->physicalDevice);
+		uint32_t timestampValidBits = queueFamilies[indices.graphicsFamily.value()].timestampValidBits;
+
+		if (!this->pipelineStatisticsSupported && this->settings.pipelineStatistics)
+		{
+			Log::write(LogSeverity::Warning, "Pipeline statistics queries are not supported; shader invocations won't be reported.");
+		}
+
+		if (this->pipelineStatisticsSupported && this->recordingThreadCount > 0 && !this->inheritedQueriesSupported)
+		{
+			Log::write(LogSeverity::Warning, "Secondary command buffers can't inherit queries on this device; shader invocations won't be reported.");
+			this->pipelineStatisticsSupported = false;
+		}
+
+		VkQueryPipelineStatisticFlags statistics = 0;
+		if (this->pipelineStatisticsSupported)
+		{
+			statistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+				| VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT
+				| VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+		}
+
+		this->gpuProfiler.create(this->logicalDevice, this->allocationCallbacks, this->settings.framesInFlight, properties.limits.timestampPeriod, timestampValidBits, statistics);
+	}
+
+	void printGpuProfile()
+	{
+		std::vector<GpuProfiler::Summary> summaries = this->gpuProfiler.getSummaries();
+		if (summaries.empty())
+		{
+			return;
+		}
+
+		Log::write(LogSeverity::Info, "GPU profile over the last %u frames (min / avg / p99):", GpuProfiler::HISTORY_LENGTH);
+		for (const GpuProfiler::Summary& summary : summaries)
+		{
+			Log::write(LogSeverity::Info, "  %s: %g / %g / %g %s", summary.name.c_str(), summary.minimum, summary.average, summary.p99, summary.unit);
+		}
+
+		if (this->settings.gpuProfilePath.empty())
+		{
+			return;
+		}
+
+		if (this->gpuProfiler.writeCsv(this->settings.gpuProfilePath))
+		{
+			Log::write(LogSeverity::Info, "Wrote GPU profile to %s", this->settings.gpuProfilePath.c_str());
+		}
+		else
+		{
+			Log::write(LogSeverity::Error, "Failed to write GPU profile %s", this->settings.gpuProfilePath.c_str());
+		}
+	}
+
+	void configureFramePacing()
+	{
+		TRACE_FUNCTION();
+
+		// The monitor refresh rate seeds the vblank estimate until measured present times refine it.
+		double refreshIntervalMilliseconds = 0.0;
+		const GLFWvidmode* videoMode = this->window != nullptr ? glfwGetVideoMode(glfwGetPrimaryMonitor()) : nullptr;
+		if (videoMode != nullptr && videoMode->refreshRate > 0)
+		{
+			refreshIntervalMilliseconds = 1000.0 / videoMode->refreshRate;
+		}
+
+		this->framePacer.configure(this->settings.latencyMode, refreshIntervalMilliseconds, this->settings.logFrameTiming);
+
+		// Only low-latency mode blocks on present wait; polled present times are estimates.
+		bool presentMeasured = this->presentWaitSupported && this->settings.latencyMode == LatencyMode::LowLatency;
+		Log::write(LogSeverity::Info, "Latency mode: %s, present timing %s", getLatencyModeName(this->settings.latencyMode), presentMeasured ? "measured with VK_KHR_present_wait" : "estimated");
+	}
+
+	// Dynamic resolution needs the swapchain image to be a blit destination and its format to support a
+	// filtered blit; decided before the swapchain and render pass are created.
+	void checkDynamicResolutionSupport()
+	{
+		TRACE_FUNCTION();
+
+		if (!this->settings.dynamicResolution)
+		{
+			return;
+		}
+
+		// Headless, the offscreen images are created with whatever usage they need.
+		VkFormat format = HEADLESS_COLOR_FORMAT;
+		bool transferDstSupported = true;
+
+		if (!this->settings.headless)
+		{
+			SwapChainSupportDetails swapChainSupport = querySwapChainSupportDetails(this->physicalDevice);
+			format = chooseSwapSurfaceFormat(swapChainSupport.formats).format;
+			transferDstSupported = (swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0;
+		}
+
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(this->physicalDevice, format, &formatProperties);
+
+		VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+		this->dynamicResolutionEnabled = transferDstSupported && (formatProperties.optimalTilingFeatures & requiredFeatures) == requiredFeatures;
+
+		if (!this->dynamicResolutionEnabled)
+		{
+			Log::write(LogSeverity::Warning, "The swapchain can't be a filtered blit destination; dynamic resolution is disabled.");
+		}
+	}
+
+	void configureDynamicResolution()
+	{
+		TRACE_FUNCTION();
+
+		if (!this->dynamicResolutionEnabled)
+		{
+			return;
+		}
+
+		double budget = this->settings.gpuBudgetMilliseconds > 0.0 ? this->settings.gpuBudgetMilliseconds : this->framePacer.getRefreshIntervalMilliseconds();
+		this->resolutionController.configure(budget, this->settings.minResolutionScale);
+		this->updateRenderExtent();
+
+		Log::write(LogSeverity::Info, "Dynamic resolution: %.2f ms GPU budget, scale %g to 1%s", budget, this->settings.minResolutionScale,
+			this->gpuProfiler.hasTimestamps() ? "" : "; timestamps are unsupported, so the scale stays at 1");
+	}
+
+	void updateRenderExtent()
+	{
+		if (!this->dynamicResolutionEnabled)
+		{
+			this->renderExtent = this->swapChainExtent;
+			return;
+		}
+
+		double scale = this->resolutionController.getScale();
+		this->renderExtent.width = std::clamp(static_cast<uint32_t>(std::lround(this->swapChainExtent.width * scale)), 1u, this->swapChainExtent.width);
+		this->renderExtent.height = std::clamp(static_cast<uint32_t>(std::lround(this->swapChainExtent.height * scale)), 1u, this->swapChainExtent.height);
+	}
+
+	// Called once the frame slot has been retired: reads back the GPU time of the frame that last used it
+	// and reports every present that has completed since the previous frame.
+	void collectFrameTimings(uint64_t frameValue)
+	{
+		TRACE_FUNCTION();
+
+		uint32_t framesInFlight = this->frameScheduler.getFramesInFlight();
+		if (frameValue > framesInFlight)
+		{
+			uint64_t retiredFrame = frameValue - framesInFlight;
+			// The slot's frame has completed, so the profiler reads its queries without waiting.
+			this->gpuProfiler.collect(this->frameScheduler.getFrameSlot());
+			double gpuMilliseconds = this->gpuProfiler.getFrameMilliseconds();
+
+			this->framePacer.gpuTimeAvailable(retiredFrame, gpuMilliseconds);
+
+			this->updateDepthPrepassTrial(retiredFrame, gpuMilliseconds, frameValue);
+
+			uint64_t fragmentInvocations = this->gpuProfiler.getStatistic(VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT);
+			if (this->pipelineStatisticsSupported && fragmentInvocations > 0)
+			{
+				this->fragmentInvocationTotal += fragmentInvocations;
+				this->fragmentInvocationFrames++;
+
+				if (this->fragmentInvocationFrames % 120 == 0)
+				{
+					Log::write(LogSeverity::Info, "Fragment shader invocations: %llu (frame %llu, depth prepass %s)", static_cast<unsigned long long>(fragmentInvocations),
+						static_cast<unsigned long long>(retiredFrame), this->depthPrepassEnabled ? "on" : "off");
+				}
+			}
+
+			if (this->gpuDrivenEnabled)
+			{
+				memcpy(&this->cullCounters, this->cullCounterReadbackBuffersMapped[this->frameScheduler.getFrameSlot()], sizeof(CullCounters));
+				this->culledObjectTotal += this->cullCounters.frustumCulled + this->cullCounters.occlusionCulled;
+				this->cullCounterFrames++;
+
+				if (this->cullCounterFrames % 120 == 0)
+				{
+					Log::write(LogSeverity::Info, "Culling: drew %u object(s) (%u revealed late), culled %u by the frustum and %u by occlusion (frame %llu)",
+						this->cullCounters.drawCount[0] + this->cullCounters.drawCount[1], this->cullCounters.drawCount[1], this->cullCounters.frustumCulled,
+						this->cullCounters.occlusionCulled, static_cast<unsigned long long>(retiredFrame));
+				}
+			}
+
+			if (this->dynamicResolutionEnabled && this->resolutionController.update(retiredFrame, gpuMilliseconds, frameValue))
+			{
+				// Viewport, scissor and render area are baked into the cached command buffers.
+				this->updateRenderExtent();
+				this->invalidateCommandBuffers();
+			}
+		}
+
+		this->collectPresentTimings();
+	}
+
+	void collectPresentTimings()
+	{
+		uint64_t completedFrame = this->frameScheduler.getCompletedValue();
+
+		while (!this->pendingPresents.empty())
+		{
+			uint64_t presentedFrame = this->pendingPresents.front();
+
+			if (this->presentWaitSupported && presentedFrame >= this->firstPresentOnSwapChain)
+			{
+				VkResult result = this->waitForPresent(this->logicalDevice, this->swapChain, presentedFrame, 0);
+				if (result == VK_TIMEOUT)
+				{
+					break;
+				}
+
+				// A zero-timeout poll only shows that the image reached the display some time since the last
+				// check, so the poll time is an estimate; only a blocking wait measures it.
+				if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)
+				{
+					this->framePacer.presentCompleted(presentedFrame, FramePacer::Clock::now(), false);
+				}
+			}
+			else
+			{
+				if (presentedFrame > completedFrame)
+				{
+					break;
+				}
+
+				// Without present wait, assume the image reached the display on average half a refresh
+				// interval after the GPU finished it (immediately when not synced to vblank).
+				double vblankWait = this->settings.latencyMode == LatencyMode::Uncapped ? 0.0 : this->framePacer.getRefreshIntervalMilliseconds() * 0.5;
+				auto estimate = FramePacer::Clock::now() + std::chrono::duration_cast<FramePacer::Clock::duration>(std::chrono::duration<double, std::milli>(vblankWait));
+				this->framePacer.presentCompleted(presentedFrame, estimate, false);
+			}
+
+			this->pendingPresents.pop_front();
+		}
+	}
+
+	void waitForPreviousPresent()
+	{
+		if (this->pendingPresents.empty())
+		{
+			return;
+		}
+
+		uint64_t previousFrame = this->pendingPresents.back();
+
+		if (this->presentWaitSupported && previousFrame >= this->firstPresentOnSwapChain)
+		{
+			VkResult result = this->waitForPresent(this->logicalDevice, this->swapChain, previousFrame, UINT64_MAX);
+
+			if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)
+			{
+				// The wait returns as the image reaches the display, so this one is measured. Older frames
+				// were shown before it and are collected first, keeping present times in order.
+				FramePacer::Clock::time_point presentTime = FramePacer::Clock::now();
+				this->pendingPresents.pop_back();
+				this->collectPresentTimings();
+				this->framePacer.presentCompleted(previousFrame, presentTime, true);
+				return;
+			}
+		}
+		else
+		{
+			this->frameScheduler.waitForFrame(previousFrame);
+		}
+
+		this->collectPresentTimings();
+	}
+
+	void createSyncObjects()
+	{
+		TRACE_FUNCTION();
+
+		this->frameScheduler.create(this->logicalDevice, this->allocationCallbacks, this->settings.framesInFlight);
+
+		if (this->settings.headless)
+		{
+			return; // No swapchain to synchronize with.
+		}
+
+		this->imageAvailableSemaphores.resize(this->settings.framesInFlight);
+		this->renderFinishedSemaphores.resize(this->settings.framesInFlight);
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+		for (size_t i = 0; i < this->settings.framesInFlight; i++)
+		{
+			if (vkCreateSemaphore(this->logicalDevice, &semaphoreInfo, this->allocationCallbacks, &this->imageAvailableSemaphores[i]) != VK_SUCCESS ||
+				vkCreateSemaphore(this->logicalDevice, &semaphoreInfo, this->allocationCallbacks, &this->renderFinishedSemaphores[i]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create semaphores!");
+			}
+		}
+	}
+
+	void createVertexBuffer()
+	{
+		TRACE_FUNCTION();
+
+		VkDeviceSize bufferSize = sizeof(this->vertices[0]) * this->vertices.size();
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingBufferMemory;
+		this->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+		void* data;
+		vkMapMemory(this->logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
+		memcpy(data, this->vertices.data(), (size_t)bufferSize);
+		vkUnmapMemory(this->logicalDevice, stagingBufferMemory);
+
+		this->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->vertexBuffer, this->vertexBufferMemory);
+
+		this->copyBuffer(stagingBuffer, this->vertexBuffer, bufferSize);
+
+		vkDestroyBuffer(this->logicalDevice, stagingBuffer, this->allocationCallbacks);
+		this->freeDeviceMemory(stagingBufferMemory);
+	}
+
+	void createQuantizedPositionBuffer()
+	{
+		TRACE_FUNCTION();
+
+		VkDeviceSize bufferSize = sizeof(this->quantizedPositions[0]) * this->quantizedPositions.size();
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingBufferMemory;
+		this->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+		void* data;
+		vkMapMemory(this->logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
+		memcpy(data, this->quantizedPositions.data(), (size_t)bufferSize);
+		vkUnmapMemory(this->logicalDevice, stagingBufferMemory);
+
+		this->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->quantizedPositionBuffer, this->quantizedPositionBufferMemory);
+
+		this->copyBuffer(stagingBuffer, this->quantizedPositionBuffer, bufferSize);
+
+		vkDestroyBuffer(this->logicalDevice, stagingBuffer, this->allocationCallbacks);
+		this->freeDeviceMemory(stagingBufferMemory);
+	}
+
+	void createIndexBuffer()
+	{
+		TRACE_FUNCTION();
+
+		VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingBufferMemory;
+		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+		void* data;
+		vkMapMemory(this->logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
+		memcpy(data, this->indices.data(), (size_t)bufferSize);
+		vkUnmapMemory(this->logicalDevice, stagingBufferMemory);
+
+		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->indexBuffer, this->indexBufferMemory);
+
+		copyBuffer(stagingBuffer, this->indexBuffer, bufferSize);
+
+		vkDestroyBuffer(this->logicalDevice, stagingBuffer, this->allocationCallbacks);
+		this->freeDeviceMemory(stagingBufferMemory);
+	}
+
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+	{
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = size;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateBuffer(this->logicalDevice, &bufferInfo, this->allocationCallbacks, &buffer) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("Failed to create buffer!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(this->logicalDevice, buffer, &memRequirements);
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = this->findMemoryType(memRequirements.memoryTypeBits, properties);
+
+		if (this->allocateDeviceMemory(allocInfo, bufferMemory) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("Failed to allocate buffer memory!");
+		}
+
+		vkBindBufferMemory(this->logicalDevice, buffer, bufferMemory, 0);
+	}
+
+	// Every device allocation goes through these two so the resize soak test can check for leaks.
+	VkResult allocateDeviceMemory(const VkMemoryAllocateInfo& allocInfo, VkDeviceMemory& memory)
+	{
+		VkResult result = vkAllocateMemory(this->logicalDevice, &allocInfo, this->allocationCallbacks, &memory);
+
+		if (result == VK_SUCCESS)
+		{
+			this->deviceMemoryAllocations[memory] = { allocInfo.allocationSize, allocInfo.memoryTypeIndex };
+			this->deviceMemoryInUse += allocInfo.allocationSize;
+			this->deviceMemoryPeak = std::max(this->deviceMemoryPeak, this->deviceMemoryInUse);
+		}
+
+		return result;
+	}
+
+	void freeDeviceMemory(VkDeviceMemory memory)
+	{
+		auto allocation = this->deviceMemoryAllocations.find(memory);
+
+		if (allocation != this->deviceMemoryAllocations.end())
+		{
+			this->deviceMemoryInUse -= allocation->second.size;
+			this->deviceMemoryAllocations.erase(allocation);
+		}
+
+		vkFreeMemory(this->logicalDevice, memory, this->allocationCallbacks);
+	}
+
+	// Startup allocations are reported apart from the ones made while rendering, which should be close to zero.
+	void printHostAllocationReport()
+	{
+		auto toKibibytes = [](uint64_t bytes) { return bytes / 1024.0; };
+
+		Log::write(LogSeverity::Info, "Host allocations through the Vulkan allocation callbacks:");
+
+		for (uint32_t scope = 0; scope < HostAllocator::SCOPE_COUNT; scope++)
+		{
+			HostAllocator::ScopeStatistics statistics = this->hostAllocator.getStatistics(static_cast<VkSystemAllocationScope>(scope));
+			uint64_t frameAllocations = statistics.allocations - this->startupHostAllocations[scope].allocations;
+
+			std::ostringstream line;
+			line << "  " << HostAllocator::getScopeName(static_cast<VkSystemAllocationScope>(scope)) << ": "
+				<< this->startupHostAllocations[scope].allocations << " allocation(s) at startup, "
+				<< static_cast<double>(frameAllocations) / std::max<uint64_t>(1, this->frameCount) << " per frame, "
+				<< statistics.reallocations << " reallocation(s), peak " << toKibibytes(statistics.peakBytes) << " KiB, "
+				<< toKibibytes(statistics.liveBytes) << " KiB live";
+
+			if (statistics.arenaAllocations > 0)
+			{
+				line << ", " << statistics.arenaAllocations << " from the arena";
+			}
+
+			if (statistics.internalPeakBytes > 0)
+			{
+				line << ", internal peak " << toKibibytes(statistics.internalPeakBytes) << " KiB";
+			}
+
+			Log::write(LogSeverity::Info, "%s", line.str().c_str());
+		}
+
+		if (this->hostAllocator.getArenaSize() > 0)
+		{
+			Log::write(LogSeverity::Info, "  Command arena: peak %g of %g KiB, %llu overflow(s) to the heap, %llu skipped reset(s)", toKibibytes(this->hostAllocator.getArenaPeakBytes()),
+				toKibibytes(this->hostAllocator.getArenaSize()), static_cast<unsigned long long>(this->hostAllocator.getArenaOverflowCount()),
+				static_cast<unsigned long long>(this->hostAllocator.getArenaSkippedResetCount()));
+		}
+	}
+
+	// Lists the swapchain-sized attachments and totals every tracked allocation. Lazily allocated memory is
+	// reported with what the driver actually committed, so the difference is what transient attachments saved.
+	void printMemoryReport()
+	{
+		VkPhysicalDeviceMemoryProperties memProperties;
+		vkGetPhysicalDeviceMemoryProperties(this->physicalDevice, &memProperties);
+
+		auto toMebibytes = [](VkDeviceSize bytes) { return bytes / (1024.0 * 1024.0); };
+
+		auto getCommittedSize = [&](VkDeviceMemory memory, const DeviceMemoryAllocation& allocation) -> VkDeviceSize
+		{
+			if (!(memProperties.memoryTypes[allocation.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT))
+			{
+				return allocation.size;
+			}
+
+			VkDeviceSize committed = 0;
+			vkGetDeviceMemoryCommitment(this->logicalDevice, memory, &committed);
+			return committed;
+		};
+
+		Log::write(LogSeverity::Info, "Device memory (%ux%u, %ux MSAA):", this->swapChainExtent.width, this->swapChainExtent.height, static_cast<uint32_t>(this->msaaSamples));
 
-		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || this->framebufferResized) 
+		const std::pair<const char*, VkDeviceMemory> attachments[] =
 		{
-			this->framebufferResized = false;
-			this->recreateSwapChain();
+			{ "MSAA color", this->colorImageMemory },
+			{ "Depth", this->depthImageMemory },
+			{ "Scene target", this->sceneImageMemory },
+			{ "Depth pyramid", this->depthPyramid.memory }
+		};
+
+		for (const auto& attachment : attachments)
+		{
+			auto allocation = this->deviceMemoryAllocations.find(attachment.second);
+			if (allocation == this->deviceMemoryAllocations.end())
+			{
+				continue;
+			}
+
+			bool lazy = (memProperties.memoryTypes[allocation->second.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+
+			Log::write(LogSeverity::Info, "  %s: %.2f MiB, %s, %.2f MiB committed", attachment.first, toMebibytes(allocation->second.size),
+				lazy ? "lazily allocated" : "device local", toMebibytes(getCommittedSize(allocation->first, allocation->second)));
 		}
-		else if (result != VK_SUCCESS) 
+
+		VkDeviceSize requested = 0;
+		VkDeviceSize committed = 0;
+
+		for (const auto& allocation : this->deviceMemoryAllocations)
 		{
-			throw std::runtime_error("Failed to present swap chain image!");
+			requested += allocation.second.size;
+			committed += getCommittedSize(allocation.first, allocation.second);
 		}
 
-		this->currentFrame = (this->currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+		Log::write(LogSeverity::Info, "  Total: %.2f MiB in %zu allocation(s), %.2f MiB committed, %.2f MiB saved by lazy allocation", toMebibytes(requested),
+			this->deviceMemoryAllocations.size(), toMebibytes(committed), toMebibytes(requested - committed));
 	}
 
-	void createSyncObjects()
+	void createDescriptorSetLayout()
 	{
-		this->imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		this->renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		this->inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+		TRACE_FUNCTION();
 
-		VkSemaphoreCreateInfo semaphoreInfo{};
-		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		VkDescriptorSetLayoutBinding uboLayoutBinding{};
+		uboLayoutBinding.binding = 0;
+		uboLayoutBinding.descriptorCount = 1;
+		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		uboLayoutBinding.pImmutableSamplers = nullptr;
+		uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+		VkDescriptorSetLayoutBinding samplerLayoutBinding{};
+		samplerLayoutBinding.binding = 1;
+		samplerLayoutBinding.descriptorCount = 1;
+		samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		samplerLayoutBinding.pImmutableSamplers = nullptr;
+		samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorSetLayoutBinding transformLayoutBinding{};
+		transformLayoutBinding.binding = 2;
+		transformLayoutBinding.descriptorCount = 1;
+		transformLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		transformLayoutBinding.pImmutableSamplers = nullptr;
+		transformLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+		std::array<VkDescriptorSetLayoutBinding, 3> bindings = { uboLayoutBinding, samplerLayoutBinding, transformLayoutBinding };
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, this->allocationCallbacks, &this->descriptorSetLayout) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("failed to create descriptor set layout!");
+		}
+	}
+
+	void createUniformBuffers()
+	{
+		TRACE_FUNCTION();
 
-		VkFenceCreateInfo fenceInfo{};
-		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+		VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+
+		this->uniformBuffers.resize(this->settings.framesInFlight);
+		this->uniformBuffersMemory.resize(this->settings.framesInFlight);
+		this->uniformBuffersMapped.resize(this->settings.framesInFlight);
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		for (size_t i = 0; i < this->settings.framesInFlight; i++) 
 		{
-			if (vkCreateSemaphore(this->logicalDevice, &semaphoreInfo, nullptr, &this->imageAvailableSemaphores[i]) != VK_SUCCESS ||
-				vkCreateSemaphore(this->logicalDevice, &semaphoreInfo, nullptr, &this->renderFinishedSemaphores[i]) != VK_SUCCESS ||
-				vkCreateFence(this->logicalDevice, &fenceInfo, nullptr, &this->inFlightFences[i]) != VK_SUCCESS)
-			{
-				throw std::runtime_error("Failed to create semaphores!");
-			}
+			this->createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->uniformBuffers[i], this->uniformBuffersMemory[i]);
+			vkMapMemory(this->logicalDevice, this->uniformBuffersMemory[i], 0, bufferSize, 0, &this->uniformBuffersMapped[i]);
+		}
+
+		// The scene is built with the model, so its size is final here.
+		VkDeviceSize transformBufferSize = this->getObjectTransformBufferSize();
+
+		this->objectTransformBuffers.resize(this->settings.framesInFlight);
+		this->objectTransformBuffersMemory.resize(this->settings.framesInFlight);
+		this->objectTransformBuffersMapped.resize(this->settings.framesInFlight);
+		this->objectTransformVersions.assign(this->settings.framesInFlight, UINT64_MAX);
+
+		for (size_t i = 0; i < this->settings.framesInFlight; i++)
+		{
+			this->createBuffer(transformBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->objectTransformBuffers[i], this->objectTransformBuffersMemory[i]);
+			vkMapMemory(this->logicalDevice, this->objectTransformBuffersMemory[i], 0, transformBufferSize, 0, &this->objectTransformBuffersMapped[i]);
 		}
-		
 	}
 
-	void createVertexBuffer()
+	VkDeviceSize getObjectTransformBufferSize() const
 	{
-		VkDeviceSize bufferSize = sizeof(this->vertices[0]) * this->vertices.size();
+		return sizeof(glm::mat4) * std::max<size_t>(this->scene.size(), 1);
+	}
+
+	void createDescriptorPool()
+	{
+		TRACE_FUNCTION();
+
+		// Per frame slot: the graphics set (UBO + texture + transforms) and the culling set (UBO + up to five storage buffers).
+		std::array<VkDescriptorPoolSize, 3> poolSizes{};
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		poolSizes[0].descriptorCount = this->settings.framesInFlight * 2;
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSizes[1].descriptorCount = this->settings.framesInFlight;
+		poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSizes[2].descriptorCount = this->settings.framesInFlight * 6;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+		poolInfo.maxSets = this->settings.framesInFlight * 2;
+
+		if (vkCreateDescriptorPool(this->logicalDevice, &poolInfo, this->allocationCallbacks, &this->descriptorPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create descriptor pool!");
+		}
+	}
+
+	void createDescriptorSets()
+	{
+		TRACE_FUNCTION();
+
+		std::vector<VkDescriptorSetLayout> layouts(this->settings.framesInFlight, this->descriptorSetLayout);
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = this->descriptorPool;
+		allocInfo.descriptorSetCount = this->settings.framesInFlight;
+		allocInfo.pSetLayouts = layouts.data();
+
+		this->descriptorSets.resize(this->settings.framesInFlight);
+		if (vkAllocateDescriptorSets(this->logicalDevice, &allocInfo, this->descriptorSets.data()) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("Failed to allocate descriptor sets!");
+		}
+
+		for (size_t i = 0; i < this->settings.framesInFlight; i++) 
+		{
+			VkDescriptorBufferInfo bufferInfo{};
+			bufferInfo.buffer = this->uniformBuffers[i];
+			bufferInfo.offset = 0;
+			bufferInfo.range = sizeof(UniformBufferObject);
+
+			VkDescriptorImageInfo imageInfo{};
+			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			imageInfo.imageView = this->textureImageView;
+			imageInfo.sampler = this->textureSampler;
+
+			VkDescriptorBufferInfo transformBufferInfo{};
+			transformBufferInfo.buffer = this->objectTransformBuffers[i];
+			transformBufferInfo.offset = 0;
+			transformBufferInfo.range = this->getObjectTransformBufferSize();
+
+			std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+
+			descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[0].dstSet = this->descriptorSets[i];
+			descriptorWrites[0].dstBinding = 0;
+			descriptorWrites[0].dstArrayElement = 0;
+			descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			descriptorWrites[0].descriptorCount = 1;
+			descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+			descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[1].dstSet = this->descriptorSets[i];
+			descriptorWrites[1].dstBinding = 1;
+			descriptorWrites[1].dstArrayElement = 0;
+			descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptorWrites[1].descriptorCount = 1;
+			descriptorWrites[1].pImageInfo = &imageInfo;
+
+			descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[2].dstSet = this->descriptorSets[i];
+			descriptorWrites[2].dstBinding = 2;
+			descriptorWrites[2].dstArrayElement = 0;
+			descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorWrites[2].descriptorCount = 1;
+			descriptorWrites[2].pBufferInfo = &transformBufferInfo;
+
+			vkUpdateDescriptorSets(this->logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+		}
+	}
+
+	// GPU-driven mode: the object buffer, per-frame indirect draw and count buffers, and the culling compute
+	// pipeline. Falls back to CPU draws if the scene exceeds the device's indirect draw limit.
+	void createCullingResources()
+	{
+		TRACE_FUNCTION();
+
+		if (!this->gpuDrivenEnabled)
+		{
+			return;
+		}
+
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+
+		uint32_t objectCount = static_cast<uint32_t>(this->scene.size());
+
+		if (objectCount > properties.limits.maxDrawIndirectCount)
+		{
+			Log::write(LogSeverity::Warning, "%u objects exceed maxDrawIndirectCount; using CPU draws.", objectCount);
+			this->gpuDrivenEnabled = false;
+			this->occlusionCullingEnabled = false;
+			return;
+		}
+
+		// Object data: the scene's mesh ranges and bounding spheres, in dense order.
+		const std::vector<MeshComponent>& meshes = this->scene.getMeshes();
+		const std::vector<BoundsComponent>& bounds = this->scene.getBounds();
+
+		std::vector<ObjectData> objects(objectCount);
+		for (uint32_t i = 0; i < objectCount; i++)
+		{
+			objects[i] = { meshes[i].indexCount, meshes[i].firstIndex, meshes[i].vertexOffset, 0, bounds[i].sphere };
+		}
+
+		VkDeviceSize objectBufferSize = sizeof(ObjectData) * objects.size();
 		VkBuffer stagingBuffer;
 		VkDeviceMemory stagingBufferMemory;
-		this->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+		this->createBuffer(objectBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
 
 		void* data;
-		vkMapMemory(this->logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, this->vertices.data(), (size_t)bufferSize);
+		vkMapMemory(this->logicalDevice, stagingBufferMemory, 0, objectBufferSize, 0, &data);
+		memcpy(data, objects.data(), (size_t)objectBufferSize);
 		vkUnmapMemory(this->logicalDevice, stagingBufferMemory);
 
-		this->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->vertexBuffer, this->vertexBufferMemory);
+		this->createBuffer(objectBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->objectBuffer, this->objectBufferMemory);
 
-		this->copyBuffer(stagingBuffer, this->vertexBuffer, bufferSize);
+		this->copyBuffer(stagingBuffer, this->objectBuffer, objectBufferSize);
+
+		vkDestroyBuffer(this->logicalDevice, stagingBuffer, this->allocationCallbacks);
+		this->freeDeviceMemory(stagingBufferMemory);
+
+		// With occlusion culling, the draws generated after the pyramid rebuild go into a second list.
+		uint32_t phaseCount = this->occlusionCullingEnabled ? 2 : 1;
+		VkDeviceSize indirectBufferSize = sizeof(VkDrawIndexedIndirectCommand) * objectCount * phaseCount;
+		VkDeviceSize retestBufferSize = sizeof(uint32_t) * objectCount;
+
+		this->indirectDrawBuffers.resize(this->settings.framesInFlight);
+		this->indirectDrawBuffersMemory.resize(this->settings.framesInFlight);
+		this->drawCountBuffers.resize(this->settings.framesInFlight);
+		this->drawCountBuffersMemory.resize(this->settings.framesInFlight);
+		this->cullCounterReadbackBuffers.resize(this->settings.framesInFlight);
+		this->cullCounterReadbackBuffersMemory.resize(this->settings.framesInFlight);
+		this->cullCounterReadbackBuffersMapped.resize(this->settings.framesInFlight);
+
+		for (size_t i = 0; i < this->settings.framesInFlight; i++)
+		{
+			this->createBuffer(indirectBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->indirectDrawBuffers[i], this->indirectDrawBuffersMemory[i]);
+			this->createBuffer(sizeof(CullCounters), VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->drawCountBuffers[i], this->drawCountBuffersMemory[i]);
+
+			this->createBuffer(sizeof(CullCounters), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->cullCounterReadbackBuffers[i], this->cullCounterReadbackBuffersMemory[i]);
+			vkMapMemory(this->logicalDevice, this->cullCounterReadbackBuffersMemory[i], 0, sizeof(CullCounters), 0, &this->cullCounterReadbackBuffersMapped[i]);
+			memset(this->cullCounterReadbackBuffersMapped[i], 0, sizeof(CullCounters));
+		}
+
+		if (this->occlusionCullingEnabled)
+		{
+			this->retestBuffers.resize(this->settings.framesInFlight);
+			this->retestBuffersMemory.resize(this->settings.framesInFlight);
+
+			for (size_t i = 0; i < this->settings.framesInFlight; i++)
+			{
+				this->createBuffer(retestBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->retestBuffers[i], this->retestBuffersMemory[i]);
+			}
+		}
+
+		// UBO, objects, draws, counters, entity transforms, and with occlusion culling the retest flags.
+		std::vector<VkDescriptorSetLayoutBinding> bindings(this->occlusionCullingEnabled ? 6 : 5);
+		for (uint32_t binding = 0; binding < bindings.size(); binding++)
+		{
+			bindings[binding].binding = binding;
+			bindings[binding].descriptorCount = 1;
+			bindings[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[binding].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		this->cullDescriptorSetLayout = this->createComputeDescriptorSetLayout(bindings);
+
+		std::vector<VkDescriptorSetLayout> layouts(this->settings.framesInFlight, this->cullDescriptorSetLayout);
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = this->descriptorPool;
+		allocInfo.descriptorSetCount = this->settings.framesInFlight;
+		allocInfo.pSetLayouts = layouts.data();
+
+		this->cullDescriptorSets.resize(this->settings.framesInFlight);
+		if (vkAllocateDescriptorSets(this->logicalDevice, &allocInfo, this->cullDescriptorSets.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate culling descriptor sets!");
+		}
+
+		for (size_t i = 0; i < this->settings.framesInFlight; i++)
+		{
+			std::array<VkDescriptorBufferInfo, 6> bufferInfos{};
+			bufferInfos[0] = { this->uniformBuffers[i], 0, sizeof(UniformBufferObject) };
+			bufferInfos[1] = { this->objectBuffer, 0, objectBufferSize };
+			bufferInfos[2] = { this->indirectDrawBuffers[i], 0, indirectBufferSize };
+			bufferInfos[3] = { this->drawCountBuffers[i], 0, sizeof(CullCounters) };
+			bufferInfos[4] = { this->objectTransformBuffers[i], 0, this->getObjectTransformBufferSize() };
+
+			if (this->occlusionCullingEnabled)
+			{
+				bufferInfos[5] = { this->retestBuffers[i], 0, retestBufferSize };
+			}
+
+			std::vector<VkWriteDescriptorSet> descriptorWrites(bindings.size());
+			for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++)
+			{
+				descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				descriptorWrites[binding].dstSet = this->cullDescriptorSets[i];
+				descriptorWrites[binding].dstBinding = binding;
+				descriptorWrites[binding].dstArrayElement = 0;
+				descriptorWrites[binding].descriptorType = bindings[binding].descriptorType;
+				descriptorWrites[binding].descriptorCount = 1;
+				descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+			}
+
+			vkUpdateDescriptorSets(this->logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+		}
+
+		std::vector<VkDescriptorSetLayout> cullSetLayouts = { this->cullDescriptorSetLayout };
+
+		if (this->occlusionCullingEnabled)
+		{
+			this->createDepthPyramidPipeline();
+			cullSetLayouts.push_back(this->depthPyramidSetLayout);
+		}
+
+		this->cullPipelineLayout = this->createComputePipelineLayout(cullSetLayouts, 2 * sizeof(uint32_t)); // objectCount, phase
+
+		ShaderBinary cullShader = shaderLibrary.loadShader(this->occlusionCullingEnabled ? ShaderId::CullOcclusion : ShaderId::Cull);
+		this->cullPipeline = this->createComputePipeline(cullShader, this->cullPipelineLayout);
+
+		Log::write(LogSeverity::Info, "GPU-driven rendering: %u object(s), culled %s and drawn with %s", objectCount,
+			this->occlusionCullingEnabled ? "against the frustum and a Hi-Z depth pyramid" : "against the frustum",
+			this->occlusionCullingEnabled ? "two vkCmdDrawIndexedIndirectCount calls." : "one vkCmdDrawIndexedIndirectCount.");
+	}
+
+	// Layouts and pipeline for hiz.comp, the culling pass's descriptor set layout for reading the pyramid,
+	// and the sampler both use. The pyramid itself is sized to the swapchain; see createDepthPyramid().
+	void createDepthPyramidPipeline()
+	{
+		std::vector<VkDescriptorSetLayoutBinding> buildBindings(3);
+		buildBindings[0].binding = 0;
+		buildBindings[0].descriptorCount = 1;
+		buildBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER; // depth buffer
+		buildBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		buildBindings[1].binding = 1;
+		buildBindings[1].descriptorCount = HIZ_MAX_LEVELS;
+		buildBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE; // pyramid levels
+		buildBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		buildBindings[2].binding = 2;
+		buildBindings[2].descriptorCount = 1;
+		buildBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER; // PyramidInfo
+		buildBindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		this->depthPyramidBuildSetLayout = this->createComputeDescriptorSetLayout(buildBindings);
+
+		std::vector<VkDescriptorSetLayoutBinding> cullBindings(2);
+		cullBindings[0] = buildBindings[0]; // whole pyramid
+		cullBindings[1] = buildBindings[2];
+		cullBindings[1].binding = 1;
+
+		this->depthPyramidSetLayout = this->createComputeDescriptorSetLayout(cullBindings);
+
+		this->depthPyramidPipelineLayout = this->createComputePipelineLayout({ this->depthPyramidBuildSetLayout }, 4 * sizeof(uint32_t)); // sourceSize, levelCount, workgroupCount
+
+		ShaderLibrary shaderLibrary(this->settings.shaderOverrideDirectory);
+		ShaderBinary pyramidShader = shaderLibrary.loadShader(this->msaaSamples != VK_SAMPLE_COUNT_1_BIT ? ShaderId::DepthPyramidMultisampled : ShaderId::DepthPyramid);
+		this->depthPyramidPipeline = this->createComputePipeline(pyramidShader, this->depthPyramidPipelineLayout);
+
+		// Both shaders only use texelFetch, so filtering never applies.
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+		if (vkCreateSampler(this->logicalDevice, &samplerInfo, this->allocationCallbacks, &this->depthPyramidSampler) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create depth pyramid sampler!");
+		}
+	}
+
+	// Creates the depth pyramid for the current swapchain, with its own descriptor pool so a retired pyramid's
+	// descriptors go away with it. Its contents are only defined once it has been built, so it starts out
+	// marked invalid and the first frame culls against the frustum alone.
+	void createDepthPyramid()
+	{
+		TRACE_FUNCTION();
+
+		if (!this->occlusionCullingEnabled)
+		{
+			return;
+		}
+
+		DepthPyramid& pyramid = this->depthPyramid;
+
+		// Level 0 covers the depth buffer at half resolution. Rounding up to a power of two keeps every mip
+		// at least as large as the rounded-up halving hiz.comp does, for any render extent up to the swapchain's.
+		uint32_t width = roundUpToPowerOfTwo((this->swapChainExtent.width + 1) / 2);
+		uint32_t height = roundUpToPowerOfTwo((this->swapChainExtent.height + 1) / 2);
+		pyramid.levelCount = std::min(getDepthPyramidLevelCount(this->swapChainExtent), HIZ_MAX_LEVELS);
+
+		this->createImage(width, height, pyramid.levelCount, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pyramid.image, pyramid.memory);
+		pyramid.view = this->createImageView(pyramid.image, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, pyramid.levelCount);
+
+		pyramid.levelViews.resize(pyramid.levelCount);
+		for (uint32_t level = 0; level < pyramid.levelCount; level++)
+		{
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = pyramid.image;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = VK_FORMAT_R32_SFLOAT;
+			viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			viewInfo.subresourceRange.baseMipLevel = level;
+			viewInfo.subresourceRange.levelCount = 1;
+			viewInfo.subresourceRange.baseArrayLayer = 0;
+			viewInfo.subresourceRange.layerCount = 1;
+
+			if (vkCreateImageView(this->logicalDevice, &viewInfo, this->allocationCallbacks, &pyramid.levelViews[level]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create depth pyramid level view!");
+			}
+		}
+
+		this->createBuffer(sizeof(uint32_t) * 5, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pyramid.infoBuffer, pyramid.infoBufferMemory);
+
+		std::array<VkDescriptorPoolSize, 3> poolSizes{};
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSizes[0].descriptorCount = 2;
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		poolSizes[1].descriptorCount = HIZ_MAX_LEVELS;
+		poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSizes[2].descriptorCount = 2;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+		poolInfo.maxSets = 2;
+
+		if (vkCreateDescriptorPool(this->logicalDevice, &poolInfo, this->allocationCallbacks, &pyramid.descriptorPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create depth pyramid descriptor pool!");
+		}
+
+		std::array<VkDescriptorSetLayout, 2> layouts = { this->depthPyramidBuildSetLayout, this->depthPyramidSetLayout };
+		std::array<VkDescriptorSet, 2> sets{};
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = pyramid.descriptorPool;
+		allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+		allocInfo.pSetLayouts = layouts.data();
+
+		if (vkAllocateDescriptorSets(this->logicalDevice, &allocInfo, sets.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate depth pyramid descriptor sets!");
+		}
+
+		pyramid.buildDescriptorSet = sets[0];
+		pyramid.cullDescriptorSet = sets[1];
+
+		VkDescriptorImageInfo depthInfo{ this->depthPyramidSampler, this->depthImageView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+		VkDescriptorImageInfo pyramidInfo{ this->depthPyramidSampler, pyramid.view, VK_IMAGE_LAYOUT_GENERAL };
+		VkDescriptorBufferInfo infoBufferInfo{ pyramid.infoBuffer, 0, VK_WHOLE_SIZE };
+
+		// Every array element must be valid; levels past levelCount alias the last level and are never written.
+		std::array<VkDescriptorImageInfo, HIZ_MAX_LEVELS> levelInfos{};
+		for (uint32_t level = 0; level < HIZ_MAX_LEVELS; level++)
+		{
+			levelInfos[level] = { nullptr, pyramid.levelViews[std::min(level, pyramid.levelCount - 1)], VK_IMAGE_LAYOUT_GENERAL };
+		}
+
+		std::array<VkWriteDescriptorSet, 5> descriptorWrites{};
+		for (auto& write : descriptorWrites)
+		{
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.descriptorCount = 1;
+		}
+
+		descriptorWrites[0].dstSet = pyramid.buildDescriptorSet;
+		descriptorWrites[0].dstBinding = 0;
+		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[0].pImageInfo = &depthInfo;
+
+		descriptorWrites[1].dstSet = pyramid.buildDescriptorSet;
+		descriptorWrites[1].dstBinding = 1;
+		descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		descriptorWrites[1].descriptorCount = HIZ_MAX_LEVELS;
+		descriptorWrites[1].pImageInfo = levelInfos.data();
+
+		descriptorWrites[2].dstSet = pyramid.buildDescriptorSet;
+		descriptorWrites[2].dstBinding = 2;
+		descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[2].pBufferInfo = &infoBufferInfo;
+
+		descriptorWrites[3].dstSet = pyramid.cullDescriptorSet;
+		descriptorWrites[3].dstBinding = 0;
+		descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[3].pImageInfo = &pyramidInfo;
+
+		descriptorWrites[4].dstSet = pyramid.cullDescriptorSet;
+		descriptorWrites[4].dstBinding = 1;
+		descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[4].pBufferInfo = &infoBufferInfo;
+
+		vkUpdateDescriptorSets(this->logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+		// Move the pyramid to VK_IMAGE_LAYOUT_GENERAL, where it stays, and zero PyramidInfo. Recorded now but
+		// submitted ahead of the next frame, so a swapchain recreation doesn't have to wait on the queue.
+		if (this->depthPyramidInitCommandBuffer != nullptr)
+		{
+			vkFreeCommandBuffers(this->logicalDevice, this->commandPool, 1, &this->depthPyramidInitCommandBuffer); // never submitted
+		}
+
+		VkCommandBufferAllocateInfo commandBufferInfo{};
+		commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		commandBufferInfo.commandPool = this->commandPool;
+		commandBufferInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(this->logicalDevice, &commandBufferInfo, &this->depthPyramidInitCommandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate depth pyramid command buffer!");
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		vkBeginCommandBuffer(this->depthPyramidInitCommandBuffer, &beginInfo);
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = pyramid.image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = pyramid.levelCount;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(this->depthPyramidInitCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		vkCmdFillBuffer(this->depthPyramidInitCommandBuffer, pyramid.infoBuffer, 0, VK_WHOLE_SIZE, 0);
 
-		vkDestroyBuffer(this->logicalDevice, stagingBuffer, nullptr);
-		vkFreeMemory(this->logicalDevice, stagingBufferMemory, nullptr);
+		vkEndCommandBuffer(this->depthPyramidInitCommandBuffer);
 	}
 
-	void createIndexBuffer()
+	static uint32_t roundUpToPowerOfTwo(uint32_t value)
 	{
-		VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-		void* data;
-		vkMapMemory(this->logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, this->indices.data(), (size_t)bufferSize);
-		vkUnmapMemory(this->logicalDevice, stagingBufferMemory);
+		uint32_t result = 1;
+		while (result < value)
+		{
+			result <<= 1;
+		}
 
-		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->indexBuffer, this->indexBufferMemory);
+		return result;
+	}
 
-		copyBuffer(stagingBuffer, this->indexBuffer, bufferSize);
+	// Levels needed to reduce a depth region of the given extent down to a single texel.
+	static uint32_t getDepthPyramidLevelCount(VkExtent2D extent)
+	{
+		uint32_t size = roundUpToPowerOfTwo(std::max((extent.width + 1) / 2, (extent.height + 1) / 2));
+		uint32_t levelCount = 1;
+		while (size > 1)
+		{
+			size >>= 1;
+			levelCount++;
+		}
 
-		vkDestroyBuffer(this->logicalDevice, stagingBuffer, nullptr);
-		vkFreeMemory(this->logicalDevice, stagingBufferMemory, nullptr);
+		return levelCount;
 	}
 
-	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+	void destroyDepthPyramid(const DepthPyramid& pyramid)
 	{
-		VkBufferCreateInfo bufferInfo{};
-		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferInfo.size = size;
-		bufferInfo.usage = usage;
-		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-		if (vkCreateBuffer(this->logicalDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) 
+		if (pyramid.image == nullptr)
 		{
-			throw std::runtime_error("Failed to create buffer!");
+			return;
 		}
 
-		VkMemoryRequirements memRequirements;
-		vkGetBufferMemoryRequirements(this->logicalDevice, buffer, &memRequirements);
+		vkDestroyDescriptorPool(this->logicalDevice, pyramid.descriptorPool, this->allocationCallbacks);
 
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = this->findMemoryType(memRequirements.memoryTypeBits, properties);
+		vkDestroyBuffer(this->logicalDevice, pyramid.infoBuffer, this->allocationCallbacks);
+		this->freeDeviceMemory(pyramid.infoBufferMemory);
 
-		if (vkAllocateMemory(this->logicalDevice, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) 
+		for (auto levelView : pyramid.levelViews)
 		{
-			throw std::runtime_error("Failed to allocate buffer memory!");
+			vkDestroyImageView(this->logicalDevice, levelView, this->allocationCallbacks);
 		}
 
-		vkBindBufferMemory(this->logicalDevice, buffer, bufferMemory, 0);
+		vkDestroyImageView(this->logicalDevice, pyramid.view, this->allocationCallbacks);
+		vkDestroyImage(this->logicalDevice, pyramid.image, this->allocationCallbacks);
+		this->freeDeviceMemory(pyramid.memory);
 	}
 
-	void createDescriptorSetLayout()
+	VkDescriptorSetLayout createComputeDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
 	{
-		VkDescriptorSetLayoutBinding uboLayoutBinding{};
-		uboLayoutBinding.binding = 0;
-		uboLayoutBinding.descriptorCount = 1;
-		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		uboLayoutBinding.pImmutableSamplers = nullptr;
-		uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-		VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-		samplerLayoutBinding.binding = 1;
-		samplerLayoutBinding.descriptorCount = 1;
-		samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		samplerLayoutBinding.pImmutableSamplers = nullptr;
-		samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-		std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
 		VkDescriptorSetLayoutCreateInfo layoutInfo{};
 		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
 		layoutInfo.pBindings = bindings.data();
 
-		if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &this->descriptorSetLayout) != VK_SUCCESS) 
+		VkDescriptorSetLayout layout;
+		if (vkCreateDescriptorSetLayout(this->logicalDevice, &layoutInfo, this->allocationCallbacks, &layout) != VK_SUCCESS)
 		{
-			throw std::runtime_error("failed to create descriptor set layout!");
+			throw std::runtime_error("Failed to create compute descriptor set layout!");
 		}
+
+		return layout;
 	}
 
-	void createUniformBuffers()
+	VkPipelineLayout createComputePipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, uint32_t pushConstantSize)
 	{
-		VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = pushConstantSize;
 
-		this->uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-		this->uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-		this->uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+		pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) 
+		VkPipelineLayout layout;
+		if (vkCreatePipelineLayout(this->logicalDevice, &pipelineLayoutInfo, this->allocationCallbacks, &layout) != VK_SUCCESS)
 		{
-			this->createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->uniformBuffers[i], this->uniformBuffersMemory[i]);
-			vkMapMemory(this->logicalDevice, this->uniformBuffersMemory[i], 0, bufferSize, 0, &this->uniformBuffersMapped[i]);
+			throw std::runtime_error("Failed to create compute pipeline layout!");
 		}
+
+		return layout;
 	}
 
-	void createDescriptorPool()
+	VkPipeline createComputePipeline(const ShaderBinary& code, VkPipelineLayout layout)
 	{
-		std::array<VkDescriptorPoolSize, 2> poolSizes{};
-		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+		VkShaderModule shaderModule = this->createShaderModule(code);
 
-		VkDescriptorPoolCreateInfo poolInfo{};
-		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		poolInfo.poolSizeCount = 1;
-		poolInfo.pPoolSizes = poolSizes.data();
-		poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = shaderModule;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = layout;
+
+		VkPipeline pipeline;
+		VkResult result = vkCreateComputePipelines(this->logicalDevice, this->pipelineCache.get(), 1, &pipelineInfo, this->allocationCallbacks, &pipeline);
+
+		vkDestroyShaderModule(this->logicalDevice, shaderModule, this->allocationCallbacks);
 
-		if (vkCreateDescriptorPool(this->logicalDevice, &poolInfo, nullptr, &this->descriptorPool) != VK_SUCCESS)
+		if (result != VK_SUCCESS)
 		{
-			throw std::runtime_error("Failed to create descriptor pool!");
+			throw std::runtime_error("Failed to create compute pipeline!");
 		}
+
+		return pipeline;
 	}
 
-	void createDescriptorSets()
+	void destroyCullingResources()
 	{
-		std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, this->descriptorSetLayout);
-		VkDescriptorSetAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		allocInfo.descriptorPool = this->descriptorPool;
-		allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-		allocInfo.pSetLayouts = layouts.data();
+		vkDestroyPipeline(this->logicalDevice, this->cullPipeline, this->allocationCallbacks);
+		vkDestroyPipelineLayout(this->logicalDevice, this->cullPipelineLayout, this->allocationCallbacks);
+		vkDestroyDescriptorSetLayout(this->logicalDevice, this->cullDescriptorSetLayout, this->allocationCallbacks);
 
-		this->descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-		if (vkAllocateDescriptorSets(this->logicalDevice, &allocInfo, this->descriptorSets.data()) != VK_SUCCESS) 
+		vkDestroyPipeline(this->logicalDevice, this->depthPyramidPipeline, this->allocationCallbacks);
+		vkDestroyPipelineLayout(this->logicalDevice, this->depthPyramidPipelineLayout, this->allocationCallbacks);
+		vkDestroyDescriptorSetLayout(this->logicalDevice, this->depthPyramidBuildSetLayout, this->allocationCallbacks);
+		vkDestroyDescriptorSetLayout(this->logicalDevice, this->depthPyramidSetLayout, this->allocationCallbacks);
+		vkDestroySampler(this->logicalDevice, this->depthPyramidSampler, this->allocationCallbacks);
+
+		for (size_t i = 0; i < this->indirectDrawBuffers.size(); i++)
 		{
-			throw std::runtime_error("Failed to allocate descriptor sets!");
+			vkDestroyBuffer(this->logicalDevice, this->indirectDrawBuffers[i], this->allocationCallbacks);
+			this->freeDeviceMemory(this->indirectDrawBuffersMemory[i]);
+			vkDestroyBuffer(this->logicalDevice, this->drawCountBuffers[i], this->allocationCallbacks);
+			this->freeDeviceMemory(this->drawCountBuffersMemory[i]);
+			vkDestroyBuffer(this->logicalDevice, this->cullCounterReadbackBuffers[i], this->allocationCallbacks);
+			this->freeDeviceMemory(this->cullCounterReadbackBuffersMemory[i]);
 		}
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) 
+		for (size_t i = 0; i < this->retestBuffers.size(); i++)
 		{
-			VkDescriptorBufferInfo bufferInfo{};
-			bufferInfo.buffer = this->uniformBuffers[i];
-			bufferInfo.offset = 0;
-			bufferInfo.range = sizeof(UniformBufferObject);
-
-			VkDescriptorImageInfo imageInfo{};
-			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageInfo.imageView = this->textureImageView;
-			imageInfo.sampler = this->textureSampler;
-
-			std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-
-			descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[0].dstSet = this->descriptorSets[i];
-			descriptorWrites[0].dstBinding = 0;
-			descriptorWrites[0].dstArrayElement = 0;
-			descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			descriptorWrites[0].descriptorCount = 1;
-			descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-			descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[1].dstSet = this->descriptorSets[i];
-			descriptorWrites[1].dstBinding = 1;
-			descriptorWrites[1].dstArrayElement = 0;
-			descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorWrites[1].descriptorCount = 1;
-			descriptorWrites[1].pImageInfo = &imageInfo;
+			vkDestroyBuffer(this->logicalDevice, this->retestBuffers[i], this->allocationCallbacks);
+			this->freeDeviceMemory(this->retestBuffersMemory[i]);
+		}
 
-			vkUpdateDescriptorSets(this->logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+		if (this->objectBuffer != nullptr)
+		{
+			vkDestroyBuffer(this->logicalDevice, this->objectBuffer, this->allocationCallbacks);
+			this->freeDeviceMemory(this->objectBufferMemory);
 		}
 	}
 
 	void createTextureImage()
 	{
+		TRACE_FUNCTION();
+
 		int texWidth = 0;
 		int texHeight = 0;
 		int texChannels = 0;
 
-		stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+		stbi_uc* pixels = nullptr;
+		{
+			TRACE_SCOPE("Decode texture");
+			pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+		}
 		VkDeviceSize imageSize = texWidth * texHeight * 4; // 4 bytes per pixel.
 
 		if (!pixels)
@@ -1615,8 +5003,8 @@ private:
 		this->copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
 		//transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL while generating mipmaps
 
-		vkDestroyBuffer(this->logicalDevice, stagingBuffer, nullptr);
-		vkFreeMemory(this->logicalDevice, stagingBufferMemory, nullptr);
+		vkDestroyBuffer(this->logicalDevice, stagingBuffer, this->allocationCallbacks);
+		this->freeDeviceMemory(stagingBufferMemory);
 
 		this->generateMipMaps(textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, mipLevels);
 	}
@@ -1638,7 +5026,7 @@ private:
 		imageInfo.samples = numSamples;
 		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-		if (vkCreateImage(this->logicalDevice, &imageInfo, nullptr, &image) != VK_SUCCESS) 
+		if (vkCreateImage(this->logicalDevice, &imageInfo, this->allocationCallbacks, &image) != VK_SUCCESS) 
 		{
 			throw std::runtime_error("Failed to create image!");
 		}
@@ -1649,9 +5037,15 @@ private:
 		VkMemoryAllocateInfo allocInfo{};
 		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = this->findMemoryType(memRequirements.memoryTypeBits, properties);
 
-		if (vkAllocateMemory(this->logicalDevice, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) 
+		// Lazily allocated memory is a preference: tile-based GPUs keep transient attachments in on-chip
+		// memory and back them on demand, but most desktop GPUs don't offer such a memory type.
+		if (!this->tryFindMemoryType(memRequirements.memoryTypeBits, properties, allocInfo.memoryTypeIndex))
+		{
+			allocInfo.memoryTypeIndex = this->findMemoryType(memRequirements.memoryTypeBits, properties & ~VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+		}
+
+		if (this->allocateDeviceMemory(allocInfo, imageMemory) != VK_SUCCESS) 
 		{
 			throw std::runtime_error("Failed to allocate image memory!");
 		}
@@ -1661,11 +5055,15 @@ private:
 
 	void createTextureImageView()
 	{
+		TRACE_FUNCTION();
+
 		textureImageView = this->createImageView(this->textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, this->mipLevels);
 	}
 
 	void createTextureSampler()
 	{
+		TRACE_FUNCTION();
+
 		VkPhysicalDeviceProperties properties{};
 		vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
 
@@ -1687,7 +5085,7 @@ private:
 		samplerInfo.maxLod = static_cast<float>(this->mipLevels);
 		samplerInfo.mipLodBias = 0.0f; // Optional
 
-		if (vkCreateSampler(this->logicalDevice, &samplerInfo, nullptr, &this->textureSampler) != VK_SUCCESS) 
+		if (vkCreateSampler(this->logicalDevice, &samplerInfo, this->allocationCallbacks, &this->textureSampler) != VK_SUCCESS) 
 		{
 			throw std::runtime_error("Failed to create texture sampler!");
 		}
@@ -1695,35 +5093,90 @@ private:
 
 	void createDepthResources()
 	{
+		TRACE_FUNCTION();
+
 		VkFormat depthFormat = this->findDepthFormat();
 
-		this->createImage(this->swapChainExtent.width, this->swapChainExtent.height, 1, this->msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->depthImage, this->depthImageMemory);
+		// Depth is cleared on load and discarded on store, so it never has to leave tile memory, unless the
+		// depth pyramid is built from it.
+		if (this->occlusionCullingEnabled)
+		{
+			this->createImage(this->swapChainExtent.width, this->swapChainExtent.height, 1, this->msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->depthImage, this->depthImageMemory);
+		}
+		else
+		{
+			this->createImage(this->swapChainExtent.width, this->swapChainExtent.height, 1, this->msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, this->depthImage, this->depthImageMemory);
+		}
+
 		this->depthImageView = createImageView(this->depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 
-		this->transitionImageLayout(this->depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
+		// No layout transition here: both render paths begin from VK_IMAGE_LAYOUT_UNDEFINED every frame, and
+		// a one-time submit would wait on the queue in the middle of a swapchain recreation.
 	}
 
 	void createColorResources()
 	{
+		TRACE_FUNCTION();
+
 		VkFormat colorFormat = this->swapChainImageFormat;
 
-		this->createImage(swapChainExtent.width, swapChainExtent.height, 1, this->msaaSamples, colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->colorImage, this->colorImageMemory);
+		// Only the resolved result is kept, so the multisampled samples never have to leave tile memory, unless
+		// occlusion culling splits the frame into two render passes.
+		if (this->occlusionCullingEnabled)
+		{
+			this->createImage(swapChainExtent.width, swapChainExtent.height, 1, this->msaaSamples, colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->colorImage, this->colorImageMemory);
+		}
+		else
+		{
+			this->createImage(swapChainExtent.width, swapChainExtent.height, 1, this->msaaSamples, colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, this->colorImage, this->colorImageMemory);
+		}
 		this->colorImageView = this->createImageView(this->colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+		if (this->dynamicResolutionEnabled)
+		{
+			// Allocated at the full swapchain extent so scale changes never reallocate; only the top-left
+			// renderExtent region is rendered to and upscaled.
+			this->createImage(swapChainExtent.width, swapChainExtent.height, 1, VK_SAMPLE_COUNT_1_BIT, colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->sceneImage, this->sceneImageMemory);
+			this->sceneImageView = this->createImageView(this->sceneImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+		}
 	}
 
 	void loadModel()
 	{
+		TRACE_FUNCTION();
+
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
+
+		{
+			TRACE_SCOPE("Parse OBJ");
+			parseObj(MODEL_PATH, attrib, shapes);
+		}
+		{
+			TRACE_SCOPE("Deduplicate vertices");
+			deduplicateVertices(attrib, shapes, this->vertices, this->indices);
+		}
+
+		this->quantizePositions();
+		this->buildScene(shapes);
+	}
+
+	static void parseObj(const std::string& path, tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes)
+	{
 		std::vector<tinyobj::material_t> materials;
 		std::string warn;
 		std::string err;
 
-		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str())) 
+		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str())) 
 		{
 			throw std::runtime_error(warn + err);
 		}
+	}
 
+	// Flattens the shapes' per-corner attributes into vertices, emitting each distinct vertex once and
+	// referring to repeats through the index buffer.
+	static void deduplicateVertices(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
 		std::unordered_map<Vertex, uint32_t> uniqueVertices{};
 
 		for (const auto& shape : shapes) 
@@ -1747,6 +5200,16 @@ private:
 
 				vertex.color = { 1.0f, 1.0f, 1.0f };
 
+				if (!attrib.colors.empty())
+				{
+					vertex.color = 
+					{
+						attrib.colors[3 * index.vertex_index + 0],
+						attrib.colors[3 * index.vertex_index + 1],
+						attrib.colors[3 * index.vertex_index + 2]
+					};
+				}
+
 				if (uniqueVertices.count(vertex) == 0) 
 				{
 					uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
@@ -1758,6 +5221,96 @@ private:
 		}
 	}
 
+	// Builds the 16-bit position stream read by SHADER_FEATURE_QUANTIZED_POSITIONS pipelines, scaled so the
+	// largest component uses the full SNORM range.
+	void quantizePositions()
+	{
+		this->positionScale = 0.0f;
+		for (const auto& vertex : this->vertices)
+		{
+			this->positionScale = std::max({ this->positionScale, std::abs(vertex.pos.x), std::abs(vertex.pos.y), std::abs(vertex.pos.z) });
+		}
+
+		if (this->positionScale == 0.0f)
+		{
+			this->positionScale = 1.0f;
+		}
+
+		auto quantize = [this](float value)
+		{
+			return static_cast<int16_t>(std::lround(std::clamp(value / this->positionScale, -1.0f, 1.0f) * 32767.0f));
+		};
+
+		this->quantizedPositions.resize(this->vertices.size());
+		for (size_t i = 0; i < this->vertices.size(); i++)
+		{
+			const glm::vec3& pos = this->vertices[i].pos;
+			this->quantizedPositions[i] = { quantize(pos.x), quantize(pos.y), quantize(pos.z), 0 };
+		}
+	}
+
+	// One entity per shape by default; settings.drawCount instead splits the index buffer into that many
+	// triangle-aligned entities, which lets us stress the recording path with a large draw stream. Every
+	// entity sits at the scene root and uses the one textured material.
+	void buildScene(const std::vector<tinyobj::shape_t>& shapes)
+	{
+		std::vector<MeshComponent> meshes;
+
+		if (this->settings.drawCount == 0)
+		{
+			uint32_t firstIndex = 0;
+			for (const auto& shape : shapes)
+			{
+				uint32_t indexCount = static_cast<uint32_t>(shape.mesh.indices.size());
+				meshes.push_back({ indexCount, firstIndex, 0 });
+				firstIndex += indexCount;
+			}
+		}
+		else
+		{
+			size_t triangleCount = this->indices.size() / 3;
+			size_t drawCount = std::min<size_t>(this->settings.drawCount, triangleCount);
+
+			for (size_t i = 0; i < drawCount; i++)
+			{
+				uint32_t firstTriangle = static_cast<uint32_t>(triangleCount * i / drawCount);
+				uint32_t lastTriangle = static_cast<uint32_t>(triangleCount * (i + 1) / drawCount);
+				meshes.push_back({ (lastTriangle - firstTriangle) * 3, firstTriangle * 3, 0 });
+			}
+		}
+
+		this->scene.clear();
+
+		for (const MeshComponent& mesh : meshes)
+		{
+			this->scene.create(TransformComponent{}, mesh, MaterialComponent{}, { this->computeBoundingSphere(mesh) });
+		}
+
+		this->invalidateCommandBuffers();
+	}
+
+	// A sphere around the vertices the mesh range references, centered on their bounding box.
+	glm::vec4 computeBoundingSphere(const MeshComponent& mesh) const
+	{
+		glm::vec3 minimum(std::numeric_limits<float>::max());
+		glm::vec3 maximum(std::numeric_limits<float>::lowest());
+		for (uint32_t index = mesh.firstIndex; index < mesh.firstIndex + mesh.indexCount; index++)
+		{
+			const glm::vec3& position = this->vertices[this->indices[index] + mesh.vertexOffset].pos;
+			minimum = glm::min(minimum, position);
+			maximum = glm::max(maximum, position);
+		}
+
+		glm::vec3 center = (minimum + maximum) * 0.5f;
+		float radius = 0.0f;
+		for (uint32_t index = mesh.firstIndex; index < mesh.firstIndex + mesh.indexCount; index++)
+		{
+			radius = std::max(radius, glm::distance(center, this->vertices[this->indices[index] + mesh.vertexOffset].pos));
+		}
+
+		return glm::vec4(center, radius);
+	}
+
 	void generateMipMaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels)
 	{
 		// Check if image format supports linear blitting
@@ -1965,21 +5518,61 @@ private:
 		this->endSingleTimeCommands(commandBuffer);
 	}
 
+	// Samples the scene root from the simulation and, with CPU culling, runs the visibility system over
+	// every entity. Runs before both uniform update and recording, which read its results.
+	void updateScene()
+	{
+		// The simulation runs on its own thread at a fixed rate; this only samples its latest snapshots.
+		this->frameTransform = this->simulation.sample(SimulationThread::Clock::now());
+
+		if (!this->settings.cpuCulling || this->gpuDrivenEnabled)
+		{
+			return;
+		}
+
+		UniformBufferObject ubo = computeUniforms(this->frameTransform, this->swapChainExtent);
+
+		// Cached command buffers hold the visible set they were recorded with.
+		if (this->scene.updateVisibility(ubo.proj * ubo.view * ubo.model, &this->jobSystem))
+		{
+			this->invalidateCommandBuffers();
+			this->cpuCullingRecordCount++;
+		}
+
+		this->cpuVisibleTotal += this->scene.getVisibleCount();
+		this->cpuCullingFrames++;
+	}
+
 	void updateUniformBuffer(uint32_t currentImage)
 	{
-		static auto startTime = std::chrono::high_resolution_clock::now();
+		UniformBufferObject ubo = computeUniforms(this->frameTransform, this->swapChainExtent);
 
-		auto currentTime = std::chrono::high_resolution_clock::now();
-		float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+		// Occlusion culling's early phase tests against a pyramid rendered with last frame's transform.
+		ubo.previousModelViewProj = this->previousModelViewProj;
+		this->previousModelViewProj = ubo.proj * ubo.view * ubo.model;
 
+		memcpy(this->uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+
+		// Entity transforms are rewritten only when they have changed since this slot last saw them.
+		uint64_t transformVersion = this->scene.getTransformVersion();
+		if (this->objectTransformVersions[currentImage] != transformVersion)
+		{
+			this->scene.writeModelMatrices(static_cast<glm::mat4*>(this->objectTransformBuffersMapped[currentImage]), &this->jobSystem);
+			this->objectTransformVersions[currentImage] = transformVersion;
+		}
+	}
+
+	// Model, view and projection for a transform; previousModelViewProj is left to the caller.
+	static UniformBufferObject computeUniforms(const TransformState& transform, VkExtent2D extent)
+	{
 		UniformBufferObject ubo{};
-		ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		ubo.model = glm::translate(glm::mat4(1.0f), transform.position) * glm::mat4_cast(transform.rotation);
 		ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		ubo.proj = glm::perspective(glm::radians(45.0f), this->swapChainExtent.width / (float)this->swapChainExtent.height, 0.1f, 10.0f);
+		ubo.proj = glm::perspective(glm::radians(45.0f), extent.width / (float)extent.height, 0.1f, 10.0f);
 
 		ubo.proj[1][1] *= -1;
 
-		memcpy(this->uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+		return ubo;
 	}
 
 	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
@@ -2014,6 +5607,18 @@ private:
 	}
 
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) 
+	{
+		uint32_t typeIndex = 0;
+
+		if (!this->tryFindMemoryType(typeFilter, properties, typeIndex))
+		{
+			throw std::runtime_error("failed to find suitable memory type!");
+		}
+
+		return typeIndex;
+	}
+
+	bool tryFindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t& typeIndex)
 	{
 		VkPhysicalDeviceMemoryProperties memProperties;
 		vkGetPhysicalDeviceMemoryProperties(this->physicalDevice, &memProperties);
@@ -2022,22 +5627,23 @@ private:
 		{
 			if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) 
 			{
-				return i;
+				typeIndex = i;
+				return true;
 			}
 		}
 
-		throw std::runtime_error("failed to find suitable memory type!");
+		return false;
 	}
 
-	VkShaderModule createShaderModule(const std::vector<char>& code)
+	VkShaderModule createShaderModule(const ShaderBinary& code)
 	{
 		VkShaderModuleCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		createInfo.codeSize = code.size();
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+		createInfo.codeSize = code.size;
+		createInfo.pCode = code.code; // Embedded shaders are passed straight from the binary, no copy.
 
 		VkShaderModule shaderModule;
-		if (vkCreateShaderModule(this->logicalDevice, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+		if (vkCreateShaderModule(this->logicalDevice, &createInfo, this->allocationCallbacks, &shaderModule) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to create shader module!");
 		}
@@ -2051,6 +5657,15 @@ private:
 		vkGetPhysicalDeviceProperties(this->physicalDevice, &physicalDeviceProperties);
 
 		VkSampleCountFlags counts = physicalDeviceProperties.limits.framebufferColorSampleCounts & physicalDeviceProperties.limits.framebufferDepthSampleCounts;
+
+		// Sample count bits equal the sample count, so everything above the cap can be masked off.
+		VkSampleCountFlags allowedCounts = 0;
+		for (uint32_t count = 1; count <= this->settings.maxSampleCount && count <= VK_SAMPLE_COUNT_64_BIT; count <<= 1)
+		{
+			allowedCounts |= count;
+		}
+		counts &= allowedCounts;
+
 		if (counts & VK_SAMPLE_COUNT_64_BIT) { return VK_SAMPLE_COUNT_64_BIT; }
 		if (counts & VK_SAMPLE_COUNT_32_BIT) { return VK_SAMPLE_COUNT_32_BIT; }
 		if (counts & VK_SAMPLE_COUNT_16_BIT) { return VK_SAMPLE_COUNT_16_BIT; }
@@ -2061,47 +5676,84 @@ private:
 		return VK_SAMPLE_COUNT_1_BIT;
 	}
 
-	static std::vector<char> readFile(const std::string& filename)
-	{
-		std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
-		if (!file.is_open())
+	static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) 
+	{
+		// Validation tends to repeat the same message every frame, so it is rate-limited by message ID.
+		LogSeverity severity = LogSeverity::Verbose;
+		if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
 		{
-			throw std::runtime_error("Failed to open file!");
+			severity = LogSeverity::Error;
+		}
+		else if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+		{
+			severity = LogSeverity::Warning;
+		}
+		else if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT)
+		{
+			severity = LogSeverity::Info;
 		}
 
-		size_t fileSize = (size_t)file.tellg();
-		std::vector<char> buffer(fileSize);
-
-		file.seekg(0);
-		file.read(buffer.data(), fileSize);
-
-		file.close();
-
-		return buffer;
-	}
-
-	static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) 
-	{
-		std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
+		Log::writeRateLimited(severity, pCallbackData->messageIdNumber, "validation layer: %s", pCallbackData->pMessage);
 		return VK_FALSE;
 	}
 };
 
-int main() 
+int main(int argc, char** argv) 
 {
-	HelloTriangleApplication app;
-
 	try 
 	{
-		app.run();
+		ApplicationSettings settings = parseCommandLine(argc, argv);
+
+		if (!settings.tracePath.empty())
+		{
+			if (!TRACE_COMPILED_IN)
+			{
+				std::cout << "Tracing was compiled out (build with ENABLE_TRACING); --trace is ignored." << std::endl;
+			}
+
+			TRACE_START();
+			TRACE_THREAD_NAME("Main");
+		}
+
+		Log::start(settings.logSeverity);
+
+		if (settings.benchmarkResize)
+		{
+			// Run the storm once per render path so the two can be compared in a single invocation.
+			for (bool dynamicRendering : { false, true })
+			{
+				settings.dynamicRendering = dynamicRendering;
+				HelloTriangleApplication app(settings);
+				app.run();
+			}
+		}
+		else
+		{
+			HelloTriangleApplication app(settings);
+			app.run();
+		}
+
+		if (!settings.tracePath.empty() && TRACE_COMPILED_IN)
+		{
+			if (TRACE_WRITE(settings.tracePath))
+			{
+				Log::write(LogSeverity::Info, "Wrote trace to %s", settings.tracePath.c_str());
+			}
+			else
+			{
+				Log::write(LogSeverity::Error, "Failed to write trace %s", settings.tracePath.c_str());
+			}
+		}
 	}
 	catch (const std::exception& e) 
 	{
+		Log::stop();
 		std::cerr << e.what() << std::endl;
 		return EXIT_FAILURE;
 	}
 
+	Log::stop();
 	std::cout << "Success" << std::endl;
 	return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Microbenchmark harness. Each benchmark runs a few untimed warmup repetitions, then a fixed number of timed
+// repetitions; a repetition calls the body as many times as it takes to last at least
+// minRepetitionMilliseconds, so bodies much shorter than the clock's resolution are still measured
+// accurately. Results keep one sample (milliseconds per call) per repetition and are summarized with
+// order statistics, which a few preempted repetitions can't skew the way they skew a mean.
+class BenchmarkSuite
+{
+public:
+
+	struct Options
+	{
+		uint32_t warmupRepetitions = 3;
+		uint32_t repetitions = 30;
+		double minRepetitionMilliseconds = 20.0;
+	};
+
+	struct Result
+	{
+		std::string name;
+		uint32_t warmupRepetitions = 0;
+		uint64_t callsPerRepetition = 0;
+		std::vector<double> samples{}; // milliseconds per call, one per timed repetition
+		double minimum = 0.0;
+		double median = 0.0;
+		double mean = 0.0;
+		double standardDeviation = 0.0;
+		double p90 = 0.0;
+		double p99 = 0.0;
+		double maximum = 0.0;
+	};
+
+	void configure(const Options& options) { this->options = options; }
+
+	// Recorded in the JSON so results from different machines or settings aren't compared by mistake.
+	void setContext(const std::string& key, const std::string& value);
+
+	const Result& run(const std::string& name, const std::function<void()>& body);
+
+	// For work that can't be repeated in a tight loop, such as frames: adds samples the caller timed itself.
+	const Result& addSamples(const std::string& name, uint32_t warmupRepetitions, std::vector<double> samples);
+
+	const std::vector<Result>& getResults() const { return this->results; }
+
+	void print() const;
+	bool writeJson(const std::string& path) const;
+
+	// Makes the size bytes at data observable, so the optimizer can't drop the computation that produced
+	// them, even with whole-program optimization. Pass a size for results in locals; with size 0 only the
+	// pointer escapes, which suffices for buffers filled by calls the optimizer can't elide anyway.
+	static void keep(const void* data, size_t size = 0);
+
+private:
+
+	Options options{};
+	std::vector<std::pair<std::string, std::string>> context{};
+	std::vector<Result> results{};
+
+	static void summarize(Result& result);
+};
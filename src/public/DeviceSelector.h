@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A format the renderer needs, with the optimal-tiling features it uses the format for.
+struct DeviceFormatRequirement
+{
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkFormatFeatureFlags features = 0;
+};
+
+struct DeviceRanking
+{
+	VkPhysicalDevice device = nullptr;
+	uint32_t index = 0; // in enumeration order, as --device takes it
+	std::string name{};
+	VkPhysicalDeviceType type = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+	bool suitable = false;
+	VkDeviceSize deviceLocalBytes = 0;
+	bool dedicatedTransferQueue = false;
+	bool asyncComputeQueue = false;
+	uint32_t supportedFormatCount = 0;
+	double capabilityScore = 0.0;
+	double probeGigabytesPerSecond = 0.0; // 0 if not probed or the probe failed
+	bool probeCached = false;
+	double score = 0.0;
+};
+
+// Ranks physical devices by what they offer the renderer rather than taking the first that works: device
+// type, device-local memory, dedicated transfer and async compute queue families, and support for the
+// formats the renderer needs. Optionally, each device also runs a short copy bandwidth probe on a throwaway
+// logical device; probe results are cached per device UUID and driver version, so only a new device or
+// driver pays for it.
+class DeviceSelector
+{
+public:
+
+	static const VkDeviceSize PROBE_BUFFER_SIZE = 64ull * 1024 * 1024;
+	static const uint32_t PROBE_COPY_COUNT = 8;
+
+	// probeCachePath may be empty to probe every run without caching.
+	void configure(const VkAllocationCallbacks* allocationCallbacks, std::vector<DeviceFormatRequirement> formats, bool probe, const std::string& probeCachePath);
+
+	// Every device, best first; devices isSuitable rejects are kept, unranked, at the end.
+	std::vector<DeviceRanking> rank(const std::vector<VkPhysicalDevice>& devices, const std::function<bool(VkPhysicalDevice)>& isSuitable);
+
+	// Matches an enumeration index or a case-insensitive substring of the device name. Returns nullptr if
+	// nothing matches.
+	static const DeviceRanking* findOverride(const std::vector<DeviceRanking>& rankings, const std::string& nameOrIndex);
+
+private:
+
+	struct CachedProbe
+	{
+		uint32_t driverVersion = 0;
+		double gigabytesPerSecond = 0.0;
+	};
+
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	std::vector<DeviceFormatRequirement> formats{};
+	bool probe = false;
+	std::string probeCachePath{};
+	std::unordered_map<std::string, CachedProbe> probeCache{}; // keyed by device UUID in hex
+
+	void rateCapabilities(DeviceRanking& ranking) const;
+	double runProbe(VkPhysicalDevice device) const;
+	void loadProbeCache();
+	bool saveProbeCache() const;
+
+	static std::string getUuidString(VkPhysicalDevice device);
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+enum class LatencyMode
+{
+	Uncapped,   // Never waits for vblank; prefers MAILBOX, then IMMEDIATE.
+	Vsync,      // FIFO presentation with the usual frames-in-flight queueing.
+	LowLatency  // FIFO presentation, but frame start is delayed so the frame completes just before its vblank.
+};
+
+LatencyMode parseLatencyMode(const std::string& name);
+const char* getLatencyModeName(LatencyMode mode);
+
+struct FrameTiming
+{
+	uint64_t frame = 0;
+	double cpuMilliseconds = -1.0;          // frame start to submit
+	double gpuMilliseconds = -1.0;          // from timestamp queries, -1 if unavailable
+	double presentMilliseconds = -1.0;      // frame start to the image reaching the display
+	double sleepMilliseconds = 0.0;         // pacing delay before the frame started
+	double inputToPhotonMilliseconds = -1.0; // newest input sampled by the frame to display, -1 if no input
+	bool presentMeasured = false;           // false when the present time is estimated
+};
+
+// Tracks per-frame CPU/GPU/present timing and, in LowLatency mode, computes how long to sleep before
+// acquiring the next image so the frame is started as late as possible while still making its vblank.
+class FramePacer
+{
+public:
+
+	using Clock = std::chrono::steady_clock;
+
+	void configure(LatencyMode mode, double refreshIntervalMilliseconds, bool logTiming);
+
+	LatencyMode getMode() const { return this->mode; }
+
+	// Sleeps until the predicted latest safe start time for the next frame. Only sleeps in LowLatency mode.
+	void waitForFrameStart();
+
+	void beginFrame(uint64_t frame);
+	void frameSubmitted(uint64_t frame);
+	void gpuTimeAvailable(uint64_t frame, double gpuMilliseconds);
+	void presentCompleted(uint64_t frame, Clock::time_point presentTime, bool measured);
+
+	// Safe to call from any thread, e.g. GLFW input callbacks.
+	void notifyInput();
+
+	double getRefreshIntervalMilliseconds() const { return this->refreshIntervalMilliseconds; }
+	double getAverageGpuMilliseconds() const { return this->averageGpuMilliseconds; }
+
+private:
+
+	struct FrameRecord
+	{
+		FrameTiming timing{};
+		Clock::time_point startTime{};
+		int64_t inputTime = 0;
+		bool gpuKnown = false;
+		bool presentKnown = false;
+	};
+
+	static const size_t RECORD_COUNT = 16;
+
+	LatencyMode mode = LatencyMode::Uncapped;
+	bool logTiming = false;
+	double refreshIntervalMilliseconds = 1000.0 / 60.0;
+	double averageCpuMilliseconds = 0.0;
+	double averageGpuMilliseconds = 0.0;
+	double pendingSleepMilliseconds = 0.0;
+	Clock::time_point lastPresentTime{};
+	bool lastPresentMeasured = false;
+	bool hasLastPresent = false;
+	int64_t lastSampledInputTime = 0;
+	std::atomic<int64_t> lastInputTime{ 0 };
+	std::array<FrameRecord, RECORD_COUNT> records{};
+
+	FrameRecord* findRecord(uint64_t frame);
+	void finishFrame(FrameRecord& record);
+
+	static int64_t toNanoseconds(Clock::time_point time);
+	static double toMilliseconds(Clock::duration duration);
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// Paces frames in flight with a single timeline semaphore. Frame N signals value N when its GPU work
+// completes, so frame slot reuse and deferred destruction are both just waits on the timeline.
+class FrameScheduler
+{
+public:
+
+	static const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
+	void create(VkDevice device, const VkAllocationCallbacks* allocationCallbacks, uint32_t framesInFlight);
+	void destroy();
+
+	// Blocks until the GPU has retired the frame that last used the current slot, then runs every
+	// deferred destructor whose frame has completed.
+	void beginFrame();
+
+	// Advances to the next frame slot. Call once the frame's work has been submitted with
+	// getTimelineSemaphore() signalled to getFrameValue().
+	void endFrame();
+
+	// Runs destructor once the GPU has finished every frame that could still reference the resource,
+	// i.e. the frame currently being recorded and all frames before it.
+	void deferDestroy(std::function<void()> destructor);
+
+	// Runs the deferred destructors whose frames have completed, without blocking.
+	void collectGarbage();
+
+	// Waits for all submitted frames and runs every pending destructor.
+	void waitIdle();
+
+	// Blocks until the GPU has finished the frame that signalled value.
+	void waitForFrame(uint64_t value) const;
+
+	uint64_t getCompletedValue() const;
+
+	uint32_t getFramesInFlight() const { return this->framesInFlight; }
+	uint32_t getFrameSlot() const { return this->frameSlot; }
+	uint64_t getFrameValue() const { return this->frameValue; }
+	VkSemaphore getTimelineSemaphore() const { return this->timelineSemaphore; }
+
+private:
+
+	struct DeferredDestruction
+	{
+		uint64_t value;
+		std::function<void()> destructor;
+	};
+
+	VkDevice device = nullptr;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	VkSemaphore timelineSemaphore = nullptr;
+	uint32_t framesInFlight = 0;
+	uint32_t frameSlot = 0;
+	uint64_t frameValue = 1;
+	uint64_t lastSubmittedValue = 0;
+	std::deque<DeferredDestruction> deferredDestructions{};
+
+	void runCompletedDestructors(uint64_t completedValue);
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Named GPU timing scopes and pipeline statistics for each frame, read back without stalling. Every frame
+// slot owns its own range of timestamp queries and one pipeline statistics query, so results are only read
+// once the frame scheduler has retired the frame that wrote them. Each scope keeps a rolling window of its
+// last HISTORY_LENGTH samples for min/avg/p99 reporting.
+class GpuProfiler
+{
+public:
+
+	static const uint32_t MAX_SCOPES = 16;      // per frame, including the whole-frame scope
+	static const uint32_t HISTORY_LENGTH = 256; // frames in the rolling window
+
+	// Rolling statistics of one scope (in milliseconds) or pipeline statistic (a count per frame).
+	struct Summary
+	{
+		std::string name;
+		const char* unit = "";
+		size_t sampleCount = 0;
+		double last = 0.0;
+		double minimum = 0.0;
+		double average = 0.0;
+		double p99 = 0.0;
+	};
+
+	// timestampValidBits comes from the queue family frames are submitted to; 0 disables timing. statistics
+	// may be 0 to skip the pipeline statistics query.
+	void create(VkDevice device, const VkAllocationCallbacks* allocationCallbacks, uint32_t framesInFlight, float timestampPeriod, uint32_t timestampValidBits, VkQueryPipelineStatisticFlags statistics);
+	void destroy();
+
+	// Brackets a frame slot's primary command buffer; the frame itself is the first scope, "Frame". Scopes
+	// nest, and must be recorded outside render passes whose contents are secondary command buffers.
+	// Recording the same slot again replaces its scope layout, so every command buffer cached for a slot
+	// must record the same scopes.
+	void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+	void endFrame(VkCommandBuffer commandBuffer);
+	uint32_t beginScope(VkCommandBuffer commandBuffer, const char* name);
+	void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+	// Reads the results of the frame most recently submitted from frameSlot, which must have completed.
+	// Never waits: results that aren't available are skipped. Returns true if the frame's GPU time was read.
+	bool collect(uint32_t frameSlot);
+
+	bool hasTimestamps() const { return this->timestampQueryPool != nullptr; }
+	VkQueryPipelineStatisticFlags getPipelineStatistics() const { return this->statistics; }
+
+	// From the most recent collect(); -1 (or 0 for statistics) if it had no results.
+	double getFrameMilliseconds() const { return this->lastFrameMilliseconds; }
+	uint64_t getStatistic(VkQueryPipelineStatisticFlagBits statistic) const;
+
+	// Scopes in the order they were first recorded, then pipeline statistics.
+	std::vector<Summary> getSummaries() const;
+	bool writeCsv(const std::string& path) const;
+
+private:
+
+	static const uint32_t QUERIES_PER_SLOT = MAX_SCOPES * 2;
+
+	struct History
+	{
+		std::string name;
+		std::vector<double> samples{}; // ring buffer of up to HISTORY_LENGTH samples
+		size_t next = 0;
+
+		void add(double sample);
+	};
+
+	// The scopes one frame slot's command buffers record, in query order.
+	struct SlotLayout
+	{
+		std::vector<uint32_t> scopes{}; // indices into scopeHistories
+		bool recorded = false;
+	};
+
+	VkDevice device = nullptr;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	VkQueryPool timestampQueryPool = nullptr;
+	VkQueryPool statisticsQueryPool = nullptr;
+	VkQueryPipelineStatisticFlags statistics = 0;
+	double timestampPeriod = 1.0;
+	uint64_t timestampMask = 0;
+	std::vector<SlotLayout> slotLayouts{};
+	uint32_t recordingSlot = 0;
+	std::vector<History> scopeHistories{};
+	std::vector<History> statisticHistories{}; // one per bit set in statistics, in bit order
+	std::vector<uint64_t> lastStatistics{};
+	double lastFrameMilliseconds = -1.0;
+
+	uint32_t findScope(const char* name);
+	static Summary summarize(const History& history, const char* unit);
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// VkAllocationCallbacks that count the host memory the loader, layers and driver allocate, per
+// VkSystemAllocationScope, with live and peak bytes. Optionally, command-scope allocations (which only live
+// for the duration of a single Vulkan call) are served from a linear arena that beginFrame() rewinds, so
+// they never reach malloc. An allocation that doesn't fit in the arena falls back to the heap.
+//
+// Every object must be destroyed with the callbacks it was created with, so create() comes before the
+// instance and destroy() after it. All callbacks are thread-safe.
+class HostAllocator
+{
+public:
+
+	static const uint32_t SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+	struct ScopeStatistics
+	{
+		uint64_t allocations = 0;   // including the new block of each reallocation
+		uint64_t reallocations = 0;
+		uint64_t frees = 0;
+		uint64_t totalBytes = 0;    // allocated over the whole run
+		uint64_t liveBytes = 0;
+		uint64_t peakBytes = 0;
+		uint64_t arenaAllocations = 0;
+		uint64_t internalLiveBytes = 0; // reported through the internal allocation notifications
+		uint64_t internalPeakBytes = 0;
+	};
+
+	// commandArenaSize 0 sends command-scope allocations to the heap like every other scope.
+	void create(size_t commandArenaSize);
+	void destroy();
+
+	const VkAllocationCallbacks* getCallbacks() const { return &this->callbacks; }
+
+	// Rewinds the command arena. If an allocation is still outstanding the arena is left as it is and the
+	// skipped reset is counted; it gets another chance next frame.
+	void beginFrame();
+
+	ScopeStatistics getStatistics(VkSystemAllocationScope scope) const;
+	uint64_t getArenaOverflowCount() const { return this->arenaOverflows.load(std::memory_order_relaxed); }
+	uint64_t getArenaSkippedResetCount() const { return this->arenaSkippedResets.load(std::memory_order_relaxed); }
+	size_t getArenaPeakBytes() const { return this->arenaPeakBytes.load(std::memory_order_relaxed); }
+	size_t getArenaSize() const { return this->arenaSize; }
+
+	static const char* getScopeName(VkSystemAllocationScope scope);
+
+private:
+
+	struct Counters
+	{
+		std::atomic<uint64_t> allocations{ 0 };
+		std::atomic<uint64_t> reallocations{ 0 };
+		std::atomic<uint64_t> frees{ 0 };
+		std::atomic<uint64_t> totalBytes{ 0 };
+		std::atomic<uint64_t> liveBytes{ 0 };
+		std::atomic<uint64_t> peakBytes{ 0 };
+		std::atomic<uint64_t> arenaAllocations{ 0 };
+		std::atomic<uint64_t> internalLiveBytes{ 0 };
+		std::atomic<uint64_t> internalPeakBytes{ 0 };
+	};
+
+	VkAllocationCallbacks callbacks{};
+	Counters counters[SCOPE_COUNT];
+
+	// The arena's state is one word so that allocating and rewinding can't race: the low 40 bits are the
+	// next free offset, the bits above count allocations not yet freed.
+	std::unique_ptr<unsigned char[]> arena{};
+	size_t arenaSize = 0;
+	std::atomic<uint64_t> arenaState{ 0 };
+	std::atomic<size_t> arenaPeakBytes{ 0 };
+	std::atomic<uint64_t> arenaOverflows{ 0 };
+	std::atomic<uint64_t> arenaSkippedResets{ 0 };
+
+	void* allocate(size_t size, size_t alignment, VkSystemAllocationScope scope);
+	void* reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	void release(void* memory);
+	void* allocateFromArena(size_t size, size_t alignment);
+	void notifyInternal(size_t size, VkSystemAllocationScope scope, bool allocated);
+
+	static void* VKAPI_CALL allocationCallback(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static void* VKAPI_CALL reallocationCallback(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static void VKAPI_CALL freeCallback(void* userData, void* memory);
+	static void VKAPI_CALL internalAllocationCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+	static void VKAPI_CALL internalFreeCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+// Tracks a group of jobs: the number still unfinished, and the first exception any of them threw. Errors
+// are kept per counter so wait() only ever rethrows an exception from the jobs it waited for.
+struct JobCounter
+{
+	std::atomic<int32_t> pending{ 0 };
+	std::mutex errorMutex{};
+	std::exception_ptr error = nullptr;
+};
+
+struct Job
+{
+	std::function<void(uint32_t workerIndex)> function;
+	JobCounter* counter = nullptr; // Decremented once the job has finished. Jobs without one must not throw.
+};
+
+// Chase-Lev work-stealing deque. The owning worker pushes and pops at the bottom; any other worker may
+// steal from the top. Capacity is fixed; push() fails when full and the caller runs the job inline.
+class WorkStealingDeque
+{
+public:
+
+	static const int64_t CAPACITY = 4096;
+
+	bool push(Job* job);
+	Job* pop();
+	Job* steal();
+
+private:
+
+	alignas(64) std::atomic<int64_t> top{ 0 };
+	alignas(64) std::atomic<int64_t> bottom{ 0 };
+	std::atomic<Job*> buffer[CAPACITY] = {};
+};
+
+// A set of named tasks with dependencies, executed by JobSystem::run(). The graph can be re-run every
+// frame; after each run it holds per-task timings, from which the critical path is derived.
+class TaskGraph
+{
+public:
+
+	using TaskId = uint32_t;
+
+	struct TaskTiming
+	{
+		uint64_t startNanoseconds = 0;
+		uint64_t endNanoseconds = 0;
+		uint32_t workerIndex = 0;
+	};
+
+	TaskId addTask(const std::string& name, std::function<void()> function);
+
+	// after will not start until before has finished.
+	void addDependency(TaskId before, TaskId after);
+
+	size_t getTaskCount() const { return this->tasks.size(); }
+	const std::string& getTaskName(TaskId task) const { return this->tasks[task].name; }
+	const TaskTiming& getTaskTiming(TaskId task) const { return this->tasks[task].timing; }
+
+	// Longest chain of dependent tasks by measured duration, in execution order.
+	std::vector<TaskId> getCriticalPath() const;
+
+	void printTimings(std::ostream& stream) const;
+
+private:
+
+	friend class JobSystem;
+
+	struct Task
+	{
+		std::string name;
+		std::function<void()> function;
+		std::vector<TaskId> successors;
+		uint32_t dependencyCount = 0;
+		std::atomic<uint32_t> pendingDependencies{ 0 };
+		TaskTiming timing{};
+		Job job{};
+
+		Task() = default;
+		Task(Task&& other) noexcept;
+	};
+
+	std::vector<Task> tasks{};
+	std::atomic<bool> failed{ false }; // A task threw during the current run; the remaining tasks are skipped.
+	uint64_t runStartNanoseconds = 0;
+	uint64_t runEndNanoseconds = 0;
+};
+
+// Work-stealing task scheduler. Worker 0 is the thread that called start(); it executes jobs while it
+// waits, and workers 1..N-1 are background threads. Jobs may only be submitted from worker threads.
+// Long-running work that nothing waits on per frame goes through submitBackground() instead, which runs
+// on a separate thread so it can never delay a worker that the frame is waiting for.
+class JobSystem
+{
+public:
+
+	void start(uint32_t workerCount);
+	void stop();
+
+	uint32_t getWorkerCount() const { return static_cast<uint32_t>(this->deques.size()); }
+
+	// Index of the calling worker thread, or UINT32_MAX when called from outside the job system.
+	static uint32_t getCurrentWorkerIndex();
+
+	void submit(Job* job);
+
+	// Queues a job on the background thread. May be called from any thread. The job's counter, if any, is
+	// decremented when it finishes, and exceptions are reported by the next wait() like any other job.
+	void submitBackground(Job* job);
+
+	// Executes other jobs until counter reaches zero. Rethrows the first exception thrown by one of its jobs.
+	void wait(JobCounter& counter);
+
+	// Calls body(begin, end, workerIndex) over [0, count) in chunks of at most grainSize and returns once
+	// every chunk has finished. chunkIndex is begin / grainSize.
+	void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end, uint32_t workerIndex)>& body);
+
+	// Runs every task in dependency order and returns once all have finished. If a task throws, the tasks
+	// that haven't started yet are skipped and run() rethrows the exception.
+	void run(TaskGraph& graph);
+
+	static uint64_t now();
+
+private:
+
+	std::vector<std::unique_ptr<WorkStealingDeque>> deques{};
+	std::vector<std::thread> threads{};
+	std::atomic<bool> stopping{ false };
+	std::atomic<uint64_t> workEpoch{ 0 };
+	std::atomic<uint32_t> sleepingCount{ 0 };
+	std::mutex sleepMutex{};
+	std::condition_variable sleepCondition{};
+	std::thread backgroundThread{};
+	std::deque<Job*> backgroundJobs{};
+	std::mutex backgroundMutex{};
+	std::condition_variable backgroundCondition{};
+
+	void workerLoop(uint32_t workerIndex);
+	void backgroundLoop();
+	Job* findJob(uint32_t workerIndex);
+	void execute(Job* job, uint32_t workerIndex);
+	void runTask(TaskGraph& graph, TaskGraph::TaskId task, uint32_t workerIndex);
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+enum class LogSeverity
+{
+	Verbose,
+	Info,
+	Warning,
+	Error
+};
+
+LogSeverity parseLogSeverity(const std::string& name);
+
+// Asynchronous logging. Any thread formats its message straight into a slot of a fixed-size lock-free
+// multi-producer ring buffer; a background thread writes the slots out (Info and below to stdout, Warning and
+// above to stderr), so a caller never blocks on the console or takes a lock. Messages below the minimum
+// severity are rejected before they are formatted. When the buffer is full, messages are dropped and
+// counted rather than waiting for the writer.
+//
+// Outside start()/stop() messages are written synchronously, so nothing logged during startup or shutdown
+// is lost. Call stop() once the threads that log have finished.
+namespace Log
+{
+	static const uint32_t MAX_MESSAGE_LENGTH = 2048; // bytes per message, including the terminator; longer ones are truncated
+	static const uint32_t REPEAT_LIMIT = 10;         // messages written per message ID before further repeats are suppressed
+
+	void start(LogSeverity minSeverity);
+	void stop();
+
+	bool isEnabled(LogSeverity severity);
+
+	// printf-style.
+	void write(LogSeverity severity, const char* format, ...);
+
+	// For messages that can repeat every frame, such as validation errors: after REPEAT_LIMIT messages with
+	// the same non-zero messageId, further ones are counted instead of written. stop() reports the counts.
+	void writeRateLimited(LogSeverity severity, int32_t messageId, const char* format, ...);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Wraps a VkPipelineCache that persists across launches. The file is only reused if its header matches
+// the current device and driver; anything else starts an empty cache, so a stale or foreign file costs
+// a cold start and nothing more.
+class PipelineCache
+{
+public:
+
+	void create(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks* allocationCallbacks, const std::string& path);
+
+	// Writes the cache back to disk through a temporary file and a rename, so a crash mid-write never
+	// leaves a truncated cache behind. Returns false if the data could not be written.
+	bool save() const;
+
+	void destroy();
+
+	VkPipelineCache get() const { return this->pipelineCache; }
+
+	// True if the cache was seeded with valid data from a previous run.
+	bool isWarm() const { return this->warm; }
+
+	size_t getInitialSize() const { return this->initialSize; }
+	const std::string& getPath() const { return this->path; }
+
+private:
+
+	VkDevice device = nullptr;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	VkPipelineCache pipelineCache = nullptr;
+	VkPhysicalDeviceProperties deviceProperties{};
+	std::string path{};
+	size_t initialSize = 0;
+	bool warm = false;
+
+	bool validateHeader(const std::vector<char>& data) const;
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "JobSystem.h"
+
+enum class BlendMode : uint8_t
+{
+	Opaque,
+	Alpha,
+	Additive
+};
+
+// Shader paths chosen at pipeline-compile time through specialization constants, so each permutation is
+// compiled with the unused paths eliminated instead of branching at runtime.
+enum ShaderFeatureBits : uint32_t
+{
+	SHADER_FEATURE_TEXTURE = 0x1,             // sample the texture in the fragment shader
+	SHADER_FEATURE_VERTEX_COLOR = 0x2,        // modulate by the interpolated vertex color
+	SHADER_FEATURE_QUANTIZED_POSITIONS = 0x4  // read 16-bit SNORM positions from the quantized position stream
+};
+using ShaderFeatureFlags = uint32_t;
+
+// Parses '+'-separated feature names, e.g. "texture+vertex-color", or "none". Throws std::invalid_argument.
+ShaderFeatureFlags parseShaderFeatures(const std::string& text);
+std::string getShaderFeatureNames(ShaderFeatureFlags features);
+
+// State that varies between pipeline permutations. Everything that is shared by every permutation
+// (shader modules, layout, render pass, sample count, vertex streams) lives in PipelineRegistryContext.
+struct PipelineStateDesc
+{
+	ShaderFeatureFlags shaderFeatures = SHADER_FEATURE_TEXTURE;
+	BlendMode blendMode = BlendMode::Alpha;
+	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	bool depthTest = true;
+	bool depthWrite = true;
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+	bool depthOnly = false; // Vertex stage only with color writes masked off, for a depth prepass.
+
+	bool operator==(const PipelineStateDesc& other) const;
+	uint64_t hash() const;
+
+	// Round-trips through parse(), e.g.
+	// "features=texture blend=alpha polygon=fill cull=back depth-test=1 depth-write=1 depth-compare=less depth-only=0".
+	std::string toString() const;
+
+	// Parses space-separated key=value pairs; omitted keys keep their defaults. Throws std::invalid_argument.
+	static PipelineStateDesc parse(const std::string& text);
+};
+
+struct PipelineStateDescHasher
+{
+	size_t operator()(const PipelineStateDesc& desc) const { return static_cast<size_t>(desc.hash()); }
+};
+
+struct PipelineRegistryContext
+{
+	VkDevice device = nullptr;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	VkPipelineCache pipelineCache = nullptr;
+	VkPipelineLayout pipelineLayout = nullptr;
+	VkRenderPass renderPass = nullptr; // nullptr selects dynamic rendering with the formats below
+	VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+	bool fillModeNonSolid = false;
+	std::vector<VkPipelineShaderStageCreateInfo> shaderStages{};
+	VkVertexInputBindingDescription vertexBinding{};
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes{};
+
+	// Replaces the location 0 attribute for SHADER_FEATURE_QUANTIZED_POSITIONS permutations.
+	VkVertexInputBindingDescription quantizedPositionBinding{};
+	VkVertexInputAttributeDescription quantizedPositionAttribute{};
+	float positionScale = 1.0f; // Model-space extent that SNORM positions are scaled back to.
+};
+
+// Owns every graphics pipeline permutation. Pipelines are compiled on the job system's background thread;
+// until a permutation is ready, get() returns the fallback pipeline, which is compiled up front. Nothing on
+// the render path ever waits for a compile.
+class PipelineRegistry
+{
+public:
+
+	// Compiles the fallback synchronously; every other permutation is compiled on demand.
+	void create(const PipelineRegistryContext& context, JobSystem& jobSystem, const PipelineStateDesc& fallbackDesc);
+
+	// Waits for outstanding compiles, then destroys every pipeline. The device must be idle.
+	void destroy();
+
+	// Returns the pipeline for desc if it has been compiled, otherwise queues it and returns the fallback.
+	// Safe to call from any thread.
+	VkPipeline get(const PipelineStateDesc& desc);
+
+	// Queues desc for compilation without using it.
+	void request(const PipelineStateDesc& desc);
+
+	// Queues every permutation listed in a manifest file, one desc per line; blank lines and lines starting
+	// with '#' are ignored. Returns the number of permutations queued.
+	size_t loadManifest(const std::string& path);
+
+	// Incremented whenever a queued permutation finishes compiling, so callers holding recorded command
+	// buffers know to re-record them with the real pipeline.
+	uint64_t getReadyGeneration() const { return this->readyGeneration.load(std::memory_order_acquire); }
+
+	bool isReady(const PipelineStateDesc& desc);
+	size_t getPendingCount() const { return static_cast<size_t>(this->pendingCompiles.pending.load(std::memory_order_acquire)); }
+
+private:
+
+	enum class EntryState : uint8_t
+	{
+		Pending,
+		Ready,
+		Failed
+	};
+
+	struct Entry
+	{
+		PipelineStateDesc desc{};
+		std::atomic<VkPipeline> pipeline{ nullptr };
+		std::atomic<EntryState> state{ EntryState::Pending };
+		Job job{};
+	};
+
+	PipelineRegistryContext context{};
+	JobSystem* jobSystem = nullptr;
+	VkPipeline fallbackPipeline = nullptr;
+	std::mutex entriesMutex{};
+	std::unordered_map<PipelineStateDesc, std::unique_ptr<Entry>, PipelineStateDescHasher> entries{};
+	JobCounter pendingCompiles{};
+	std::atomic<uint64_t> readyGeneration{ 0 };
+
+	Entry& findOrQueue(const PipelineStateDesc& desc);
+	void compile(Entry& entry);
+	VkPipeline createPipeline(const PipelineStateDesc& desc) const;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+// Picks the render resolution scale from measured GPU frame times so the GPU stays inside a frame-time
+// budget. Scaling down reacts to a single over-budget frame, sized from the overshoot so a load spike is
+// absorbed in one step; scaling back up happens one step at a time after a sustained run of cheap frames.
+class ResolutionController
+{
+public:
+
+	static constexpr double SCALE_STEP = 0.05;
+
+	void configure(double budgetMilliseconds, double minScale, double maxScale = 1.0);
+
+	// Feeds the GPU time of a completed frame; currentFrame is the frame about to be recorded. Frames
+	// recorded before the last scale change are ignored, since they were rendered at the old scale.
+	// Returns true if the scale changed.
+	bool update(uint64_t frame, double gpuMilliseconds, uint64_t currentFrame);
+
+	double getScale() const { return this->scale; }
+	double getBudgetMilliseconds() const { return this->budgetMilliseconds; }
+	uint64_t getChangeCount() const { return this->changeCount; }
+
+private:
+
+	double budgetMilliseconds = 1000.0 / 60.0;
+	double minScale = 0.5;
+	double maxScale = 1.0;
+	double scale = 1.0;
+	double averageGpuMilliseconds = 0.0;
+	uint32_t cheapFrames = 0;
+	uint64_t firstFrameAtScale = 0;
+	uint64_t changeCount = 0;
+
+	void setScale(double newScale, uint64_t currentFrame);
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class JobSystem;
+
+// Stable handle to a scene entity. The generation changes whenever the index is reused, so a handle to a
+// destroyed entity never aliases the entity that takes its place.
+struct Entity
+{
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+
+	bool operator==(const Entity& other) const { return this->index == other.index && this->generation == other.generation; }
+	bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+// Placement relative to the scene root, whose transform comes from the simulation.
+struct TransformComponent
+{
+	glm::vec3 position{ 0.0f };
+	glm::quat rotation{ 1.0f, 0.0f, 0.0f, 0.0f };
+	float scale = 1.0f;
+};
+
+// A range of the shared index buffer.
+struct MeshComponent
+{
+	uint32_t indexCount = 0;
+	uint32_t firstIndex = 0;
+	int32_t vertexOffset = 0;
+};
+
+struct MaterialComponent
+{
+	uint32_t material = 0;
+};
+
+struct BoundsComponent
+{
+	glm::vec4 sphere{ 0.0f }; // center in xyz and radius in w, in the entity's own space
+};
+
+// Renderable objects, stored data-oriented. Every renderable has the same four components, so the scene is
+// a single archetype kept as a sparse set: each component lives in its own contiguous array, all indexed by
+// the same dense index, and a sparse array maps entity indices to dense indices. Destroying an entity moves
+// the last one into its place, so the arrays never have holes and systems stream through them linearly.
+class Scene
+{
+public:
+
+	static const size_t SYSTEM_GRAIN_SIZE = 4096; // entities per job when a system runs in parallel
+
+	Entity create(const TransformComponent& transform, const MeshComponent& mesh, const MaterialComponent& material, const BoundsComponent& bounds);
+	void destroy(Entity entity);
+	void clear();
+
+	bool isAlive(Entity entity) const;
+	size_t size() const { return this->entities.size(); }
+
+	// Position of the entity's components in the arrays below. Changes when another entity is destroyed.
+	uint32_t getDenseIndex(Entity entity) const;
+
+	const std::vector<Entity>& getEntities() const { return this->entities; }
+	const std::vector<TransformComponent>& getTransforms() const { return this->transforms; }
+	const std::vector<MeshComponent>& getMeshes() const { return this->meshes; }
+	const std::vector<MaterialComponent>& getMaterials() const { return this->materials; }
+	const std::vector<BoundsComponent>& getBounds() const { return this->bounds; }
+
+	void setTransform(Entity entity, const TransformComponent& transform);
+
+	// Changes whenever a transform is set or an entity is created or destroyed, so copies of the transforms
+	// can tell when they are stale.
+	uint64_t getTransformVersion() const { return this->transformVersion; }
+
+	// Runs body over consecutive [begin, end) ranges of dense indices, in parallel on the job system when
+	// there is more than one grain of entities and jobSystem isn't null. body may only write to its own range.
+	void forEach(JobSystem* jobSystem, const std::function<void(size_t begin, size_t end)>& body) const;
+
+	// Visibility system: tests every entity's bounding sphere against the frustum of the root's
+	// model-view-projection matrix. Returns true if any entity's visibility changed since the last update.
+	bool updateVisibility(const glm::mat4& modelViewProj, JobSystem* jobSystem);
+
+	// Transform system: writes each entity's model matrix relative to the root, in dense order, to
+	// matrices[0, size()).
+	void writeModelMatrices(glm::mat4* matrices, JobSystem* jobSystem) const;
+
+	// Per dense index, 1 if visible as of the last updateVisibility(); new entities start visible.
+	const std::vector<uint8_t>& getVisibility() const { return this->visibility; }
+	size_t getVisibleCount() const { return this->visibleCount; }
+
+private:
+
+	std::vector<uint32_t> sparse{};      // entity index -> dense index, UINT32_MAX while free
+	std::vector<uint32_t> generations{}; // per entity index
+	std::vector<uint32_t> freeIndices{};
+
+	std::vector<Entity> entities{};
+	std::vector<TransformComponent> transforms{};
+	std::vector<MeshComponent> meshes{};
+	std::vector<MaterialComponent> materials{};
+	std::vector<BoundsComponent> bounds{};
+	std::vector<uint8_t> visibility{};
+	size_t visibleCount = 0;
+	uint64_t transformVersion = 0;
+};
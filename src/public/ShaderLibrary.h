@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class ShaderId
+{
+	Vertex,
+	Fragment,
+	Cull,
+	CullOcclusion,           // cull.comp with OCCLUSION_CULLING defined
+	DepthPyramid,            // hiz.comp
+	DepthPyramidMultisampled // hiz.comp with MULTISAMPLED defined
+};
+
+// SPIR-V for one shader. Embedded shaders point straight into the binary's read-only data; code loaded
+// from an override directory is owned by storage. Move-only so code never outlives its storage.
+struct ShaderBinary
+{
+	const uint32_t* code = nullptr;
+	size_t size = 0; // in bytes, as VkShaderModuleCreateInfo::codeSize expects
+	std::vector<uint32_t> storage{};
+
+	ShaderBinary() = default;
+	ShaderBinary(const ShaderBinary&) = delete;
+	ShaderBinary& operator=(const ShaderBinary&) = delete;
+	ShaderBinary(ShaderBinary&&) = default;
+	ShaderBinary& operator=(ShaderBinary&&) = default;
+};
+
+// Shaders are compiled at build time (src/shaders/compile.bat or compile.sh) and embedded as uint32_t
+// arrays, so startup does no shader file I/O. For development, a non-empty overrideDirectory makes
+// loadShader() read <overrideDirectory>/<file>.spv instead, falling back to the embedded copy if the file
+// is missing.
+class ShaderLibrary
+{
+public:
+
+	explicit ShaderLibrary(const std::string& overrideDirectory = "");
+
+	ShaderBinary loadShader(ShaderId id) const;
+
+	static const char* getFileName(ShaderId id);
+
+private:
+
+	std::string overrideDirectory{};
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+// Single-producer, single-consumer triple buffer. The writer fills the back slot and swaps it with the
+// middle one; the reader swaps the middle slot into the front only when it holds something newer. Neither
+// side ever waits on the other, and the reader always sees the most recently published value.
+template <typename T>
+class TripleBuffer
+{
+public:
+
+	// Slot the writer may fill. Only valid on the writer thread until the next publish().
+	T& getWriteBuffer() { return this->slots[this->backIndex]; }
+
+	void publish()
+	{
+		uint8_t previous = this->middle.exchange(static_cast<uint8_t>(this->backIndex | FRESH_BIT), std::memory_order_acq_rel);
+		this->backIndex = previous & INDEX_MASK;
+	}
+
+	// Returns true if a newer value was published since the last call. The front buffer is stable until the
+	// next call either way.
+	bool update()
+	{
+		if ((this->middle.load(std::memory_order_relaxed) & FRESH_BIT) == 0)
+		{
+			return false;
+		}
+
+		uint8_t previous = this->middle.exchange(this->frontIndex, std::memory_order_acq_rel);
+		this->frontIndex = previous & INDEX_MASK;
+		return true;
+	}
+
+	const T& getReadBuffer() const { return this->slots[this->frontIndex]; }
+
+private:
+
+	static const uint8_t INDEX_MASK = 0x3;
+	static const uint8_t FRESH_BIT = 0x4;
+
+	std::array<T, 3> slots{};
+	uint8_t frontIndex = 0;              // reader only
+	uint8_t backIndex = 1;               // writer only
+	std::atomic<uint8_t> middle{ 2 };    // shared, with FRESH_BIT set when unread
+};
+
+struct TransformState
+{
+	glm::vec3 position{ 0.0f };
+	glm::quat rotation{ 1.0f, 0.0f, 0.0f, 0.0f };
+};
+
+// What the simulation publishes each tick: the two most recent states and when the newer one was reached.
+// Keeping both in one snapshot lets the renderer interpolate without holding on to an older buffer.
+struct SimulationSnapshot
+{
+	uint64_t tick = 0;
+	std::chrono::steady_clock::time_point tickTime{};
+	TransformState previous{};
+	TransformState current{};
+};
+
+// Advances the scene at a fixed timestep on its own thread and publishes snapshots through a triple buffer.
+// A slow renderer only causes snapshots to be skipped, and a slow tick only delays the next snapshot.
+class SimulationThread
+{
+public:
+
+	using Clock = std::chrono::steady_clock;
+
+	~SimulationThread();
+
+	// extraTickMilliseconds busy-waits inside every tick to emulate an expensive simulation.
+	void start(double ticksPerSecond, double extraTickMilliseconds);
+	void stop();
+
+	// Render thread: the transform at time, interpolated between the last two published ticks. The result
+	// lags the simulation by up to one tick so both ends of the interpolation are always known.
+	TransformState sample(Clock::time_point time);
+
+	uint64_t getTickCount() const { return this->tickCount.load(std::memory_order_relaxed); }
+	uint64_t getDroppedTickCount() const { return this->droppedTickCount.load(std::memory_order_relaxed); }
+
+private:
+
+	// Steps beyond this are dropped rather than simulated back-to-back, so a stalled simulation resumes at
+	// real time instead of trying to catch up forever.
+	static const uint32_t MAX_CATCH_UP_TICKS = 5;
+
+	std::thread thread{};
+	std::atomic<bool> running{ false };
+	std::atomic<uint64_t> tickCount{ 0 };
+	std::atomic<uint64_t> droppedTickCount{ 0 };
+	Clock::duration tickDuration{};
+	double extraTickMilliseconds = 0.0;
+	TripleBuffer<SimulationSnapshot> snapshots{};
+
+	void threadMain();
+	static TransformState step(const TransformState& state, uint64_t tick, double tickSeconds);
+};
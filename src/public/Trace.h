@@ -0,0 +1,80 @@
+#pragma once
+
+// CPU instrumentation written out as a Chrome trace (chrome://tracing or https://ui.perfetto.dev). Zones
+// are recorded into per-thread buffers without locks or allocation, timed with a nanosecond steady clock.
+// Build with ENABLE_TRACING defined to compile the zones in; without it every macro expands to nothing and
+// none of the code below exists. Even when compiled in, nothing is recorded until TRACE_START().
+//
+//     TRACE_FUNCTION();            // zone named after the enclosing function
+//     TRACE_SCOPE("acquire");      // zone until the end of the enclosing block
+//
+// Zone names are not copied: they must stay valid until the trace is written (string literals and
+// __func__ always are).
+
+#ifdef ENABLE_TRACING
+
+#include <cstdint>
+#include <string>
+
+namespace Trace
+{
+	// Nanoseconds since the first call in the process.
+	uint64_t now();
+
+	void start();
+	bool isRecording();
+
+	// Names the calling thread in the trace; the name is copied.
+	void setThreadName(const std::string& name);
+
+	void recordZone(const char* name, uint64_t startNanoseconds, uint64_t endNanoseconds);
+
+	// Writes every thread's zones recorded so far. Call while no thread is recording.
+	bool writeChromeTrace(const std::string& path);
+}
+
+class TraceZone
+{
+public:
+
+	explicit TraceZone(const char* name)
+		: name(name), start(Trace::isRecording() ? Trace::now() : 0)
+	{
+	}
+
+	~TraceZone()
+	{
+		if (this->start != 0)
+		{
+			Trace::recordZone(this->name, this->start, Trace::now());
+		}
+	}
+
+	TraceZone(const TraceZone&) = delete;
+	TraceZone& operator=(const TraceZone&) = delete;
+
+private:
+
+	const char* name;
+	uint64_t start;
+};
+
+#define TRACE_CONCATENATE_(a, b) a##b
+#define TRACE_CONCATENATE(a, b) TRACE_CONCATENATE_(a, b)
+#define TRACE_SCOPE(name) TraceZone TRACE_CONCATENATE(traceZone, __COUNTER__)(name)
+#define TRACE_FUNCTION() TRACE_SCOPE(__func__)
+#define TRACE_THREAD_NAME(name) Trace::setThreadName(name)
+#define TRACE_START() Trace::start()
+#define TRACE_WRITE(path) Trace::writeChromeTrace(path)
+#define TRACE_COMPILED_IN true
+
+#else
+
+#define TRACE_SCOPE(name) do { } while (false)
+#define TRACE_FUNCTION() do { } while (false)
+#define TRACE_THREAD_NAME(name) do { } while (false)
+#define TRACE_START() do { } while (false)
+#define TRACE_WRITE(path) false
+#define TRACE_COMPILED_IN false
+
+#endif
@@ -1,3 +1,29 @@
-C:\VulkanSDK\1.3.250.0\Bin\glslc.exe shader.vert -o vert.spv
-C:\VulkanSDK\1.3.250.0\Bin\glslc.exe shader.frag -o frag.spv
-pause
\ No newline at end of file
+@echo off
+rem Compiles the GLSL shaders to SPIR-V, plus the .spv.inc word lists that are embedded into the executable.
+rem Runs as a pre-build step; pass nopause to skip the pause when running it by hand from a script.
+rem Uses glslc from the Vulkan SDK that VULKAN_SDK points at, as set by the SDK installer.
+if "%VULKAN_SDK%"=="" (
+	echo VULKAN_SDK is not set; install the Vulkan SDK or set it to the SDK directory.
+	exit /b 1
+)
+set GLSLC="%VULKAN_SDK%\Bin\glslc.exe"
+pushd "%~dp0"
+%GLSLC% shader.vert -o vert.spv || goto :error
+%GLSLC% shader.frag -o frag.spv || goto :error
+%GLSLC% shader.vert -mfmt=num -o vert.spv.inc || goto :error
+%GLSLC% shader.frag -mfmt=num -o frag.spv.inc || goto :error
+%GLSLC% cull.comp -o cull.spv || goto :error
+%GLSLC% cull.comp -mfmt=num -o cull.spv.inc || goto :error
+%GLSLC% cull.comp -DOCCLUSION_CULLING -o cull_occlusion.spv || goto :error
+%GLSLC% cull.comp -DOCCLUSION_CULLING -mfmt=num -o cull_occlusion.spv.inc || goto :error
+%GLSLC% hiz.comp -o hiz.spv || goto :error
+%GLSLC% hiz.comp -mfmt=num -o hiz.spv.inc || goto :error
+%GLSLC% hiz.comp -DMULTISAMPLED -o hiz_ms.spv || goto :error
+%GLSLC% hiz.comp -DMULTISAMPLED -mfmt=num -o hiz_ms.spv.inc || goto :error
+popd
+if not "%1"=="nopause" pause
+exit /b 0
+
+:error
+popd
+exit /b 1
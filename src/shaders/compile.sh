@@ -0,0 +1,21 @@
+#!/bin/sh
+# Compiles the GLSL shaders to SPIR-V, plus the .spv.inc word lists that are embedded into the executable.
+# Uses glslc from $VULKAN_SDK/bin when VULKAN_SDK is set, otherwise the glslc found on PATH.
+set -e
+cd "$(dirname "$0")"
+
+GLSLC="${VULKAN_SDK:+$VULKAN_SDK/bin/}glslc"
+
+for stage in vert frag; do
+	"$GLSLC" "shader.$stage" -o "$stage.spv"
+	"$GLSLC" "shader.$stage" -mfmt=num -o "$stage.spv.inc"
+done
+
+"$GLSLC" cull.comp -o cull.spv
+"$GLSLC" cull.comp -mfmt=num -o cull.spv.inc
+"$GLSLC" cull.comp -DOCCLUSION_CULLING -o cull_occlusion.spv
+"$GLSLC" cull.comp -DOCCLUSION_CULLING -mfmt=num -o cull_occlusion.spv.inc
+"$GLSLC" hiz.comp -o hiz.spv
+"$GLSLC" hiz.comp -mfmt=num -o hiz.spv.inc
+"$GLSLC" hiz.comp -DMULTISAMPLED -o hiz_ms.spv
+"$GLSLC" hiz.comp -DMULTISAMPLED -mfmt=num -o hiz_ms.spv.inc
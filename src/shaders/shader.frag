@@ -1,5 +1,9 @@
 #version 450
 
+// Specialization constants, set per pipeline by PipelineRegistry.
+layout(constant_id = 0) const bool USE_TEXTURE = true;
+layout(constant_id = 1) const bool USE_VERTEX_COLOR = false;
+
 layout(binding = 1) uniform sampler2D texSampler;
 
 layout(location = 0) in vec3 fragColor;
@@ -9,5 +13,17 @@ layout(location = 0) out vec4 outColor;
 
 void main() 
 {
-        outColor = texture(texSampler, fragTexCoord);
-}
\ No newline at end of file
+        vec4 color = vec4(1.0);
+
+        if (USE_TEXTURE)
+        {
+            color *= texture(texSampler, fragTexCoord);
+        }
+
+        if (USE_VERTEX_COLOR)
+        {
+            color *= vec4(fragColor, 1.0);
+        }
+
+        outColor = color;
+}
@@ -1,5 +1,10 @@
 #version 450
 
+// Specialization constants, set per pipeline by PipelineRegistry. Branches on them are resolved when the
+// pipeline is compiled, so each permutation only contains the path it uses.
+layout(constant_id = 2) const bool QUANTIZED_POSITIONS = false;
+layout(constant_id = 3) const float POSITION_SCALE = 1.0;
+
 layout(binding = 0) uniform UniformBufferObject 
 {
     mat4 model;
@@ -7,6 +12,12 @@ layout(binding = 0) uniform UniformBufferObject
     mat4 proj;
 } ubo;
 
+// Every entity's placement relative to the scene root (ubo.model), indexed by the draw's firstInstance.
+layout(std430, binding = 2) readonly buffer ObjectTransforms
+{
+    mat4 objectTransforms[];
+};
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
@@ -14,9 +25,20 @@ layout(location = 2) in vec2 inTexCoord;
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
+// The depth prepass and the depth-equal main pass run this shader in different pipelines; invariance
+// guarantees both produce bit-identical depth so VK_COMPARE_OP_EQUAL passes exactly the visible fragments.
+invariant gl_Position;
+
 void main()
 {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    // Quantized positions arrive as SNORM in [-1, 1]; scale them back to model units.
+    vec3 position = inPosition;
+    if (QUANTIZED_POSITIONS)
+    {
+        position *= POSITION_SCALE;
+    }
+
+    gl_Position = ubo.proj * ubo.view * ubo.model * objectTransforms[gl_InstanceIndex] * vec4(position, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
-}
\ No newline at end of file
+}